@@ -0,0 +1,161 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * action_batch.cpp -- time of allocating a list node and linking it at the
+ * head of a list, with an undo log transaction and with
+ * pmem::obj::experimental::action_batch
+ */
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/action_batch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#define LAYOUT "action_batch"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+struct node {
+	node(uint64_t v, nvobj::persistent_ptr<node> n) : value(v), next(n)
+	{
+	}
+
+	nvobj::p<uint64_t> value;
+	nvobj::persistent_ptr<node> next;
+};
+
+struct root {
+	nvobj::persistent_ptr<node> head;
+};
+
+/*
+ * measure -- call f(i) for i in [0, n_items) and return the time per call
+ * in microseconds
+ */
+template <typename F>
+double
+measure(uint64_t n_items, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < n_items; ++i)
+		f(i);
+
+	std::chrono::duration<double, std::micro> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / static_cast<double>(n_items);
+}
+
+/*
+ * clear -- free all nodes of the list
+ */
+void
+clear(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	while (r->head != nullptr) {
+		nvobjexp::action_batch batch(pop);
+		auto head = r->head;
+		batch.set(r->head, head->next);
+		batch.free(head);
+		batch.publish();
+	}
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [items]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	uint64_t n_items = argc > 2 ? std::stoull(argv[2]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    n_items * 128);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto r = pop.root();
+
+	double tx = measure(n_items, [&](uint64_t i) {
+		nvobj::transaction::run(pop, [&] {
+			r->head = nvobj::make_persistent<node>(i, r->head);
+		});
+	});
+
+	clear(pop);
+
+	double actions = measure(n_items, [&](uint64_t i) {
+		nvobjexp::action_batch batch(pop);
+		auto n = batch.make_persistent<node>(i, r->head);
+		batch.set(r->head, n);
+		batch.publish();
+	});
+
+	clear(pop);
+
+	std::cout << "transaction [us/op]\t" << tx << std::endl;
+	std::cout << "action_batch [us/op]\t" << actions << std::endl;
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_clear.cpp -- compares the time of clearing
+ * pmem::obj::experimental::concurrent_hash_map with clear() and with
+ * clear(size_type) for different numbers of threads
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#define LAYOUT "concurrent_hash_map_clear"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+typedef nvobjexp::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>
+	persistent_map_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> map;
+};
+
+/*
+ * fill -- insert n_items elements to an empty map
+ */
+void
+fill(persistent_map_type &map, int n_items)
+{
+	for (int i = 0; i < n_items; ++i)
+		map.insert(persistent_map_type::value_type(i, i));
+}
+
+/*
+ * measure -- return the time of f() in milliseconds
+ */
+template <typename F>
+double
+measure(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	f();
+
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count();
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items] [batch-size]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int n_items = argc > 3 ? std::stoi(argv[3]) : 1000000;
+	size_t batch_size = argc > 4 ? std::stoul(argv[4]) : 1024;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 256);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->map);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto &map = *pop.root()->map;
+
+	map.initialize();
+
+	std::cout << "threads\tclear time [ms]" << std::endl;
+
+	fill(map, n_items);
+	std::cout << "serial\t" << measure([&] { map.clear(); }) << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		fill(map, n_items);
+
+		double t = measure([&] { map.clear(threads, batch_size); });
+
+		if (map.size() != 0)
+			std::abort();
+
+		std::cout << threads << "\t" << t << std::endl;
+	}
+
+	pop.close();
+
+	return 0;
+}
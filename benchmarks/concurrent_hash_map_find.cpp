@@ -0,0 +1,173 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_find.cpp -- compares scalability of the locked and the
+ * optimistic lookup in pmem::obj::experimental::concurrent_hash_map
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "concurrent_hash_map_find"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::transactional_node_allocation,
+	nvobj::experimental::no_statistics,
+	nvobj::experimental::load_factor_growth<1>,
+	nvobj::experimental::optimistic_lookup>
+	persistent_map_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+/*
+ * run -- execute ops lookups of random keys in each of the threads and
+ * return throughput in millions of operations per second
+ */
+template <typename Lookup>
+double
+run(size_t threads, size_t ops, int items, Lookup lookup)
+{
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([=]() {
+			std::mt19937 gen(static_cast<unsigned>(t));
+			std::uniform_int_distribution<int> dist(0, items - 1);
+
+			for (size_t i = 0; i < ops; ++i) {
+				if (!lookup(dist(gen))) {
+					std::cerr << "item not found"
+						  << std::endl;
+					std::abort();
+				}
+			}
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(threads * ops) / elapsed.count() / 1e6;
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items] [ops-per-thread]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int items = argc > 3 ? std::stoi(argv[3]) : 100000;
+	size_t ops = argc > 4 ? std::stoul(argv[4]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(items) * 512);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->cons);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto map = pop.root()->cons;
+
+	map->initialize();
+
+	for (int i = 0; i < items; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	/* rehash all buckets, so that both variants do the same work */
+	map->rehash();
+
+	std::cout << "threads\tfind [Mops/s]\tfind_optimistic [Mops/s]"
+		  << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		double locked = run(threads, ops, items, [&](int key) {
+			persistent_map_type::const_accessor acc;
+			return map->find(acc, key);
+		});
+
+		double optimistic = run(threads, ops, items, [&](int key) {
+			nvobj::p<int> value;
+			return map->find_optimistic(key, value);
+		});
+
+		std::cout << threads << "\t" << locked << "\t" << optimistic
+			  << std::endl;
+	}
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_insert.cpp -- compares throughput of the single and
+ * the bulk insert in pmem::obj::experimental::concurrent_hash_map
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "concurrent_hash_map_insert"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::experimental::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>>
+	persistent_map_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+using item_type = std::pair<int, int>;
+using iterator_type = std::vector<item_type>::const_iterator;
+
+/*
+ * run -- insert a separate range of items in each of the threads into an
+ * empty map and return throughput in millions of inserts per second
+ */
+template <typename Insert>
+double
+run(persistent_map_type &map, size_t threads,
+    const std::vector<item_type> &items, Insert insert)
+{
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	map.clear();
+
+	size_t per_thread = items.size() / threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			auto first = items.begin() +
+				static_cast<std::ptrdiff_t>(t * per_thread);
+
+			insert(first,
+			       first + static_cast<std::ptrdiff_t>(per_thread));
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	if (map.size() != threads * per_thread) {
+		std::cerr << "wrong number of items" << std::endl;
+		std::abort();
+	}
+
+	return static_cast<double>(threads * per_thread) / elapsed.count() /
+		1e6;
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items] [batch-size]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int n_items = argc > 3 ? std::stoi(argv[3]) : 1000000;
+	size_t batch_size = argc > 4 ? std::stoul(argv[4]) : 128;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 512);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->cons);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto map = pop.root()->cons;
+
+	map->initialize();
+
+	std::vector<item_type> items;
+	items.reserve(size_t(n_items));
+	for (int i = 0; i < n_items; ++i)
+		items.emplace_back(i, i);
+
+	std::cout << "threads\tinsert [Mops/s]\tinsert_bulk [Mops/s]"
+		  << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		double single =
+			run(*map, threads, items,
+			    [&](iterator_type first, iterator_type last) {
+				    for (; first != last; ++first)
+					    map->insert(*first);
+			    });
+
+		double bulk =
+			run(*map, threads, items,
+			    [&](iterator_type first, iterator_type last) {
+				    map->insert_bulk(first, last, batch_size);
+			    });
+
+		std::cout << threads << "\t" << single << "\t" << bulk
+			  << std::endl;
+	}
+
+	pop.close();
+
+	return 0;
+}
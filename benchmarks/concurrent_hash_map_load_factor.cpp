@@ -0,0 +1,208 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_load_factor.cpp -- compares throughput and number of
+ * buckets of pmem::obj::experimental::concurrent_hash_map for different
+ * maximum load factors
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "concurrent_hash_map_load_factor"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+template <typename GrowthPolicy>
+using persistent_map_type =
+	nvobjexp::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+				      nvobjexp::hash_compare<nvobj::p<int>>,
+				      nvobjexp::compact_bucket_layout,
+				      nvobjexp::atomic_node_allocation,
+				      nvobjexp::no_statistics, GrowthPolicy>;
+
+using half_map_type = persistent_map_type<nvobjexp::load_factor_growth<1, 2>>;
+using one_map_type = persistent_map_type<nvobjexp::load_factor_growth<1>>;
+using two_map_type = persistent_map_type<nvobjexp::load_factor_growth<2>>;
+using four_map_type = persistent_map_type<nvobjexp::load_factor_growth<4>>;
+
+struct root {
+	nvobj::persistent_ptr<half_map_type> half;
+	nvobj::persistent_ptr<one_map_type> one;
+	nvobj::persistent_ptr<two_map_type> two;
+	nvobj::persistent_ptr<four_map_type> four;
+};
+
+/*
+ * run_threads -- call f(begin, end) for a separate range of [0, n) in each
+ * of the threads and return throughput in millions of operations per second
+ */
+template <typename F>
+double
+run_threads(size_t threads, int n, F f)
+{
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	int per_thread = n / static_cast<int>(threads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			int begin = static_cast<int>(t) * per_thread;
+
+			f(begin, begin + per_thread);
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(per_thread) *
+		static_cast<double>(threads) / elapsed.count() / 1e6;
+}
+
+/*
+ * run -- fill an empty map and look up present and absent keys, print the
+ * throughput of each phase, the number of buckets and the load factor
+ */
+template <typename Map>
+void
+run(Map &map, size_t threads, int n_items)
+{
+	double insert = run_threads(threads, n_items, [&](int b, int e) {
+		for (int i = b; i < e; ++i)
+			map.insert(typename Map::value_type(i, i));
+	});
+
+	/* lookups should not rehash buckets on demand */
+	map.rehash();
+
+	double hit = run_threads(threads, n_items, [&](int b, int e) {
+		for (int i = b; i < e; ++i) {
+			typename Map::const_accessor acc;
+			if (!map.find(acc, i))
+				std::abort();
+		}
+	});
+
+	double miss = run_threads(threads, n_items, [&](int b, int e) {
+		for (int i = b + n_items; i < e + n_items; ++i) {
+			typename Map::const_accessor acc;
+			if (map.find(acc, i))
+				std::abort();
+		}
+	});
+
+	std::cout << Map::max_load_factor() << "\t" << threads << "\t"
+		  << insert << "\t" << hit << "\t" << miss << "\t"
+		  << map.bucket_count() << "\t" << map.load_factor()
+		  << std::endl;
+
+	map.clear();
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int n_items = argc > 3 ? std::stoi(argv[3]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 1024);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		auto r = pop.root();
+		nvobj::make_persistent_atomic<half_map_type>(pop, r->half);
+		nvobj::make_persistent_atomic<one_map_type>(pop, r->one);
+		nvobj::make_persistent_atomic<two_map_type>(pop, r->two);
+		nvobj::make_persistent_atomic<four_map_type>(pop, r->four);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto r = pop.root();
+
+	r->half->initialize();
+	r->one->initialize();
+	r->two->initialize();
+	r->four->initialize();
+
+	std::cout << "max load factor\tthreads\tinsert [Mops/s]\t"
+		     "find hit [Mops/s]\tfind miss [Mops/s]\tbuckets\t"
+		     "load factor"
+		  << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		run(*r->half, threads, n_items);
+		run(*r->one, threads, n_items);
+		run(*r->two, threads, n_items);
+		run(*r->four, threads, n_items);
+	}
+
+	pop.close();
+
+	return 0;
+}
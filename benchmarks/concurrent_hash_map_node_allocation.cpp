@@ -0,0 +1,180 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_node_allocation.cpp -- compares insert latency of the
+ * node allocation policies of pmem::obj::experimental::concurrent_hash_map
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "concurrent_hash_map_node_allocation"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+template <typename NodeAllocation>
+using persistent_map_type =
+	nvobjexp::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+				      nvobjexp::hash_compare<nvobj::p<int>>,
+				      nvobjexp::compact_bucket_layout,
+				      NodeAllocation>;
+
+using atomic_map_type = persistent_map_type<nvobjexp::atomic_node_allocation>;
+using tx_map_type =
+	persistent_map_type<nvobjexp::transactional_node_allocation>;
+
+struct root {
+	nvobj::persistent_ptr<atomic_map_type> atomic;
+	nvobj::persistent_ptr<tx_map_type> tx;
+};
+
+/*
+ * run -- insert a separate range of keys into an empty map in each of the
+ * threads, timing every insert, and print the mean, median and 99th
+ * percentile latency
+ */
+template <typename Map>
+void
+run(const char *name, Map &map, size_t threads, int n_items)
+{
+	using clock = std::chrono::steady_clock;
+
+	int per_thread = n_items / static_cast<int>(threads);
+
+	std::vector<std::vector<double>> latencies(threads);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			int begin = static_cast<int>(t) * per_thread;
+			auto &lat = latencies[t];
+
+			lat.reserve(static_cast<size_t>(per_thread));
+
+			for (int i = begin; i < begin + per_thread; ++i) {
+				auto start = clock::now();
+
+				map.insert(typename Map::value_type(i, i));
+
+				std::chrono::duration<double, std::nano> d =
+					clock::now() - start;
+				lat.push_back(d.count());
+			}
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::vector<double> all;
+	for (auto &lat : latencies)
+		all.insert(all.end(), lat.begin(), lat.end());
+
+	std::sort(all.begin(), all.end());
+
+	double sum = 0;
+	for (double l : all)
+		sum += l;
+
+	std::cout << name << "\t" << threads << "\t"
+		  << sum / static_cast<double>(all.size()) << "\t"
+		  << all[all.size() / 2] << "\t"
+		  << all[all.size() * 99 / 100] << std::endl;
+
+	map.clear();
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int n_items = argc > 3 ? std::stoi(argv[3]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 512);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		auto r = pop.root();
+		nvobj::make_persistent_atomic<atomic_map_type>(pop, r->atomic);
+		nvobj::make_persistent_atomic<tx_map_type>(pop, r->tx);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto r = pop.root();
+
+	r->atomic->initialize();
+	r->tx->initialize();
+
+	std::cout << "allocation\tthreads\tmean [ns]\tmedian [ns]\tp99 [ns]"
+		  << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+		run("atomic", *r->atomic, threads, n_items);
+		run("transactional", *r->tx, threads, n_items);
+	}
+
+	pop.close();
+
+	return 0;
+}
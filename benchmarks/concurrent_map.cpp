@@ -0,0 +1,198 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_map.cpp -- throughput of concurrent inserts, lookups and range
+ * scans of pmem::obj::experimental::concurrent_map
+ */
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "concurrent_map"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+typedef nvobjexp::concurrent_map<nvobj::p<int>, nvobj::p<int>>
+	persistent_map_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> map;
+};
+
+/* number of elements visited by a range scan */
+const int scan_length = 100;
+
+/*
+ * run_threads -- call f(begin, end) for a separate range of [0, n) in each
+ * of the threads and return throughput in millions of operations per second
+ */
+template <typename F>
+double
+run_threads(size_t threads, int n, F f)
+{
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+
+	int per_thread = n / static_cast<int>(threads);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < threads; ++t) {
+		workers.emplace_back([&, t]() {
+			int begin = static_cast<int>(t) * per_thread;
+
+			f(begin, begin + per_thread);
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(per_thread) *
+		static_cast<double>(threads) / elapsed.count() / 1e6;
+}
+
+/*
+ * key -- spread the keys of consecutive operations over the whole map, so
+ * that the threads insert to the same regions of the list
+ */
+int
+key(int i, int n_items)
+{
+	return static_cast<int>((static_cast<long long>(i) * 7919) % n_items);
+}
+
+/*
+ * run -- fill an empty map, then look up the keys and scan ranges starting
+ * at them, print the throughput of each phase
+ */
+void
+run(persistent_map_type &map, size_t threads, int n_items)
+{
+	double insert = run_threads(threads, n_items, [&](int b, int e) {
+		for (int i = b; i < e; ++i) {
+			int k = key(i, n_items);
+			map.insert(persistent_map_type::value_type(k, k));
+		}
+	});
+
+	double find = run_threads(threads, n_items, [&](int b, int e) {
+		for (int i = b; i < e; ++i) {
+			if (map.find(key(i, n_items)) == map.end())
+				std::abort();
+		}
+	});
+
+	int n_scans = n_items / scan_length;
+
+	double scan = run_threads(threads, n_scans, [&](int b, int e) {
+		for (int i = b; i < e; ++i) {
+			auto it = map.lower_bound(key(i, n_items));
+			int sum = 0;
+			for (int n = 0; n < scan_length && it != map.end();
+			     ++n, ++it)
+				sum += it->second;
+
+			if (sum < 0)
+				std::abort();
+		}
+	});
+
+	std::cout << threads << "\t" << insert << "\t" << find << "\t"
+		  << scan << std::endl;
+
+	map.clear();
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-threads] [items]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_threads = argc > 2 ? std::stoul(argv[2])
+				      : std::thread::hardware_concurrency();
+	int n_items = argc > 3 ? std::stoi(argv[3]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 512);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->map);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto &map = *pop.root()->map;
+
+	map.initialize();
+
+	std::cout << "threads\tinsert [Mops/s]\tfind [Mops/s]\t"
+		     "scan of "
+		  << scan_length << " [Mops/s]" << std::endl;
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2)
+		run(map, threads, n_items);
+
+	pop.close();
+
+	return 0;
+}
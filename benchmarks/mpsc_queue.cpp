@@ -0,0 +1,216 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mpsc_queue.cpp -- throughput of pmem::obj::experimental::mpsc_queue with
+ * one consumer and a growing number of producers, compared to a transactional
+ * linked list queue like the one in examples/queue
+ */
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/mpsc_queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "mpsc_queue"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+struct record {
+	uint64_t producer;
+	uint64_t payload[7];
+};
+
+typedef nvobjexp::mpsc_queue<record> queue_type;
+
+struct list_node {
+	nvobj::p<record> value;
+	nvobj::persistent_ptr<list_node> next;
+};
+
+struct root {
+	nvobj::persistent_ptr<queue_type> queue;
+	nvobj::persistent_ptr<list_node> head;
+	nvobj::persistent_ptr<list_node> tail;
+};
+
+/* number of records in the ring of each producer */
+const size_t ring_capacity = 1 << 12;
+
+/*
+ * run_queue -- produce n_items records from each of the producers while a
+ * single thread consumes them, return throughput in millions of records per
+ * second
+ */
+double
+run_queue(queue_type &queue, size_t producers, size_t n_items)
+{
+	std::atomic<size_t> done(0);
+	std::vector<std::thread> workers;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t t = 0; t < producers; ++t) {
+		workers.emplace_back([&, t]() {
+			auto producer = queue.register_producer();
+			record r = {t, {0}};
+			for (size_t i = 0; i < n_items;) {
+				r.payload[0] = i;
+				if (producer.try_produce(r))
+					++i;
+				else
+					std::this_thread::yield();
+			}
+			done++;
+		});
+	}
+
+	size_t consumed = 0;
+	while (done.load() != producers || !queue.empty()) {
+		consumed += queue.try_consume_batch(
+			[](queue_type::const_range) {});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(consumed) / elapsed.count() / 1e6;
+}
+
+/*
+ * run_list -- enqueue n_items records to a linked list, one transaction per
+ * record, and dequeue them, return throughput in millions of records per
+ * second
+ */
+double
+run_list(nvobj::pool<root> &pop, size_t n_items)
+{
+	auto r = pop.root();
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < n_items; ++i) {
+		nvobj::transaction::run(pop, [&] {
+			auto n = nvobj::make_persistent<list_node>();
+			n->value = record{0, {i}};
+			n->next = nullptr;
+			if (r->head == nullptr)
+				r->head = n;
+			else
+				r->tail->next = n;
+			r->tail = n;
+		});
+	}
+
+	while (r->head != nullptr) {
+		nvobj::transaction::run(pop, [&] {
+			auto n = r->head;
+			r->head = n->next;
+			if (r->head == nullptr)
+				r->tail = nullptr;
+			nvobj::delete_persistent<list_node>(n);
+		});
+	}
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return static_cast<double>(n_items) / elapsed.count() / 1e6;
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [max-producers] [items]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t max_producers = argc > 2 ? std::stoul(argv[2])
+					: std::thread::hardware_concurrency();
+	size_t n_items = argc > 3 ? std::stoul(argv[3]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    n_items * 256);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->queue = nvobj::make_persistent<queue_type>(
+				max_producers, ring_capacity);
+		});
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	std::cout << "transactional list [Mrecords/s]\t"
+		  << run_list(pop, n_items) << std::endl;
+
+	std::cout << "producers\tmpsc_queue [Mrecords/s]" << std::endl;
+
+	for (size_t producers = 1; producers <= max_producers;
+	     producers *= 2) {
+		std::cout << producers << "\t"
+			  << run_queue(*pop.root()->queue, producers,
+				       n_items / producers)
+			  << std::endl;
+	}
+
+	pop.close();
+
+	return 0;
+}
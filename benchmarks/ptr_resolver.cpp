@@ -0,0 +1,257 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * ptr_resolver.cpp -- time of repeated walks of a list and of lookups in a
+ * binary search tree, with persistent_ptr::get() and with
+ * pmem::obj::experimental::ptr_resolver
+ */
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/ptr_resolver.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define LAYOUT "ptr_resolver"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const uint64_t batch_size = 1000;
+
+struct list_node {
+	list_node(uint64_t v, nvobj::persistent_ptr<list_node> n)
+	    : value(v), next(n)
+	{
+	}
+
+	nvobj::p<uint64_t> value;
+	nvobj::persistent_ptr<list_node> next;
+};
+
+struct tree_node {
+	tree_node(uint64_t k) : key(k)
+	{
+	}
+
+	nvobj::p<uint64_t> key;
+	nvobj::persistent_ptr<tree_node> left;
+	nvobj::persistent_ptr<tree_node> right;
+};
+
+struct root {
+	nvobj::persistent_ptr<list_node> head;
+	nvobj::persistent_ptr<tree_node> tree;
+};
+
+/*
+ * measure -- call f() n_repeats times and return the time in milliseconds
+ */
+template <typename F>
+double
+measure(uint64_t n_repeats, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < n_repeats; ++i)
+		f();
+
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count();
+}
+
+/*
+ * build -- create a list of n_items nodes and a binary search tree of
+ * n_items keys inserted in random order
+ */
+void
+build(nvobj::pool<root> &pop, const std::vector<uint64_t> &keys)
+{
+	auto r = pop.root();
+
+	for (uint64_t first = 0; first < keys.size(); first += batch_size) {
+		uint64_t last = std::min<uint64_t>(first + batch_size,
+						   keys.size());
+
+		nvobj::transaction::run(pop, [&] {
+			for (uint64_t i = first; i < last; ++i) {
+				r->head = nvobj::make_persistent<list_node>(
+					i, r->head);
+
+				auto *link = &r->tree;
+				while (*link != nullptr)
+					link = keys[i] < (*link)->key
+						? &(*link)->left
+						: &(*link)->right;
+
+				*link = nvobj::make_persistent<tree_node>(
+					keys[i]);
+			}
+		});
+	}
+}
+
+/*
+ * sum_list -- sum the values of the list, resolving the pointers with
+ * resolve(ptr)
+ */
+template <typename Resolve>
+uint64_t
+sum_list(nvobj::pool<root> &pop, Resolve resolve)
+{
+	uint64_t sum = 0;
+	for (auto n = resolve(pop.root()->head); n != nullptr;
+	     n = resolve(n->next))
+		sum += n->value;
+
+	return sum;
+}
+
+/*
+ * find_all -- look all the keys up in the tree, resolving the pointers
+ * with resolve(ptr), and return the number of keys found
+ */
+template <typename Resolve>
+uint64_t
+find_all(nvobj::pool<root> &pop, const std::vector<uint64_t> &keys,
+	 Resolve resolve)
+{
+	uint64_t found = 0;
+	for (auto key : keys) {
+		auto n = resolve(pop.root()->tree);
+		while (n != nullptr && n->key != key)
+			n = resolve(key < n->key ? n->left : n->right);
+
+		found += n != nullptr;
+	}
+
+	return found;
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [items] [repeats]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	uint64_t n_items = argc > 2 ? std::stoull(argv[2]) : 10000;
+	uint64_t n_repeats = argc > 3 ? std::stoull(argv[3]) : 100;
+
+	nvobj::pool<root> pop;
+
+	try {
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    n_items * 256);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	std::vector<uint64_t> keys(n_items);
+	for (uint64_t i = 0; i < n_items; ++i)
+		keys[i] = i;
+	std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+
+	build(pop, keys);
+
+	auto get = [](const nvobj::persistent_ptr<list_node> &ptr) {
+		return ptr.get();
+	};
+	auto tree_get = [](const nvobj::persistent_ptr<tree_node> &ptr) {
+		return ptr.get();
+	};
+
+	nvobjexp::ptr_resolver res(pop);
+	auto resolve = [&](const nvobj::persistent_ptr<list_node> &ptr) {
+		return res.get(ptr);
+	};
+	auto tree_resolve = [&](const nvobj::persistent_ptr<tree_node> &ptr) {
+		return res.get(ptr);
+	};
+
+	uint64_t sum[2] = {0, 0}, found[2] = {0, 0};
+	double list_time[2], tree_time[2];
+
+	/* bring the nodes into the cache */
+	sum[0] = sum_list(pop, get);
+	found[0] = find_all(pop, keys, tree_get);
+
+	list_time[0] = measure(n_repeats,
+			       [&] { sum[0] = sum_list(pop, get); });
+	list_time[1] = measure(n_repeats,
+			       [&] { sum[1] = sum_list(pop, resolve); });
+	tree_time[0] = measure(
+		n_repeats, [&] { found[0] = find_all(pop, keys, tree_get); });
+	tree_time[1] = measure(n_repeats, [&] {
+		found[1] = find_all(pop, keys, tree_resolve);
+	});
+
+	if (sum[0] != sum[1] || found[0] != n_items || found[1] != n_items) {
+		std::cerr << "traversal results differ" << std::endl;
+		return 1;
+	}
+
+	std::cout << "list walk, get() [ms]\t" << list_time[0] << std::endl;
+	std::cout << "list walk, ptr_resolver [ms]\t" << list_time[1]
+		  << std::endl;
+	std::cout << "tree lookups, get() [ms]\t" << tree_time[0] << std::endl;
+	std::cout << "tree lookups, ptr_resolver [ms]\t" << tree_time[1]
+		  << std::endl;
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * segment_vector_push_back.cpp -- time of appending elements one by one to
+ * pmem::obj::experimental::segment_vector and pmem::obj::experimental::vector
+ */
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/segment_vector.hpp>
+#include <libpmemobj++/experimental/vector.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#define LAYOUT "segment_vector_push_back"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+typedef nvobjexp::segment_vector<int> segment_vector_type;
+typedef nvobjexp::vector<int> vector_type;
+
+struct root {
+	nvobj::persistent_ptr<segment_vector_type> segments;
+	nvobj::persistent_ptr<vector_type> contiguous;
+};
+
+/*
+ * run -- append n_items elements to an empty container, print the total
+ * time and the time of the slowest push_back, which is the one that grows
+ * the container
+ */
+template <typename Vector>
+void
+run(nvobj::pool<root> &pop, nvobj::persistent_ptr<Vector> &ptr,
+    const char *name, int n_items)
+{
+	nvobj::transaction::run(
+		pop, [&] { ptr = nvobj::make_persistent<Vector>(); });
+
+	auto &v = *ptr;
+
+	std::chrono::duration<double> slowest(0);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n_items; ++i) {
+		auto op_start = std::chrono::steady_clock::now();
+		v.push_back(i);
+		std::chrono::duration<double> op =
+			std::chrono::steady_clock::now() - op_start;
+		if (op > slowest)
+			slowest = op;
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	std::cout << name << "\t" << elapsed.count() << "\t"
+		  << slowest.count() * 1e3 << std::endl;
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<Vector>(ptr);
+		ptr = nullptr;
+	});
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [items]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	int n_items = argc > 2 ? std::stoi(argv[2]) : 1000000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		/* vector needs the old and the new array during reallocation */
+		size_t pool_size = std::max<size_t>(PMEMOBJ_MIN_POOL * 20,
+						    size_t(n_items) * 32);
+		pop = nvobj::pool<root>::create(path, LAYOUT, pool_size,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	std::cout << "container\ttotal [s]\tslowest push_back [ms]"
+		  << std::endl;
+
+	run(pop, pop.root()->segments, "segment_vector", n_items);
+	run(pop, pop.root()->contiguous, "vector", n_items);
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transaction_get_rw.cpp -- time of a single pass of writes to an array of
+ * p<int> in a pmem::obj::transaction, where the pool check of get_rw() is
+ * answered by the known pool range of the transaction, and in a
+ * transaction started with the C API, where every write looks the pool up
+ */
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#define LAYOUT "transaction_get_rw"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+const int n_values = 1024;
+
+struct array {
+	nvobj::p<int> values[n_values];
+};
+
+struct root {
+	nvobj::persistent_ptr<array> arr;
+};
+
+/*
+ * update -- write every value of the array once, from the last one, so
+ * the snapshotted ranges are not appended to but prepended
+ */
+void
+update(array &arr, int v)
+{
+	for (int i = n_values - 1; i >= 0; --i)
+		arr.values[i] = v;
+}
+
+/*
+ * measure -- call f(i) for i in [0, n_txs) and return the time per call
+ * in microseconds
+ */
+template <typename F>
+double
+measure(uint64_t n_txs, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < n_txs; ++i)
+		f(static_cast<int>(i));
+
+	std::chrono::duration<double, std::micro> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / static_cast<double>(n_txs);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [transactions]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	uint64_t n_txs = argc > 2 ? std::stoull(argv[2]) : 10000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 20,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->arr = nvobj::make_persistent<array>();
+		});
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto &arr = *pop.root()->arr;
+
+	/* warm up the undo log */
+	nvobj::transaction::run(pop, [&] { update(arr, 0); });
+
+	double cached = measure(n_txs, [&](int v) {
+		nvobj::transaction::run(pop, [&] { update(arr, v); });
+	});
+
+	double uncached = measure(n_txs, [&](int v) {
+		if (pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_NONE))
+			throw pmem::transaction_error("tx_begin failed");
+		update(arr, v);
+		pmemobj_tx_commit();
+		(void)pmemobj_tx_end();
+	});
+
+	std::cout << "writes per tx\t" << n_values << std::endl;
+	std::cout << "known pool range [us/tx]\t" << cached << std::endl;
+	std::cout << "pool lookups [us/tx]\t" << uncached << std::endl;
+
+	pop.close();
+
+	return 0;
+}
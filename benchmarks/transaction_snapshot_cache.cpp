@@ -0,0 +1,158 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transaction_snapshot_cache.cpp -- time of field-by-field updates of a
+ * structure in a pmem::obj::transaction, which remembers the snapshotted
+ * ranges, and in a transaction started with the C API, where every update
+ * adds its field to the undo log
+ */
+
+#define LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS 1
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#define LAYOUT "transaction_snapshot_cache"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+const int n_fields = 32;
+const int n_passes = 4;
+
+struct record {
+	nvobj::p<uint64_t> fields[n_fields];
+};
+
+struct root {
+	nvobj::persistent_ptr<record> rec;
+};
+
+/*
+ * update -- increment every field of the record, n_passes times
+ */
+void
+update(record &rec)
+{
+	for (int pass = 0; pass < n_passes; ++pass)
+		for (int i = 0; i < n_fields; ++i)
+			rec.fields[i] += 1u;
+}
+
+/*
+ * measure -- call f() n_txs times and return the time per call in
+ * microseconds
+ */
+template <typename F>
+double
+measure(uint64_t n_txs, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < n_txs; ++i)
+		f();
+
+	std::chrono::duration<double, std::micro> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / static_cast<double>(n_txs);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " file-name [transactions]"
+			  << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	uint64_t n_txs = argc > 2 ? std::stoull(argv[2]) : 100000;
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT,
+						PMEMOBJ_MIN_POOL * 20,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->rec = nvobj::make_persistent<record>();
+		});
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << " " << path
+			  << std::endl;
+		return 1;
+	}
+
+	auto &rec = *pop.root()->rec;
+	auto &cache = pmem::detail::get_tx_snapshot_cache();
+	auto misses = cache.misses;
+
+	double cached = measure(n_txs, [&] {
+		nvobj::transaction::run(pop, [&] { update(rec); });
+	});
+
+	double added = static_cast<double>(cache.misses - misses) /
+		static_cast<double>(n_txs);
+
+	double uncached = measure(n_txs, [&] {
+		if (pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_NONE))
+			throw pmem::transaction_error("tx_begin failed");
+		update(rec);
+		pmemobj_tx_commit();
+		(void)pmemobj_tx_end();
+	});
+
+	std::cout << "ranges added per tx (cached)\t" << added << std::endl;
+	std::cout << "ranges added per tx (uncached)\t" << n_fields * n_passes
+		  << std::endl;
+	std::cout << "cached [us/tx]\t" << cached << std::endl;
+	std::cout << "uncached [us/tx]\t" << uncached << std::endl;
+
+	pop.close();
+
+	return 0;
+}
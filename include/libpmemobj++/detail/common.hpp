@@ -40,8 +40,14 @@
 
 #include <libpmemobj++/detail/pexceptions.hpp>
 #include <libpmemobj/tx_base.h>
+#include <cstddef>
+#include <cstdint>
 #include <typeinfo>
 
+#if _MSC_VER
+#include <intrin.h>
+#endif
+
 #if defined(__GNUC__) || defined(__clang__)
 #define POBJ_CPP_DEPRECATED __attribute__((deprecated))
 #elif defined(_MSC_VER)
@@ -110,6 +116,15 @@
 	std::is_trivially_copyable<T>::value
 #endif
 
+/*
+ * Count hits and misses of the transaction snapshot cache. Meant for tests
+ * and benchmarks only, it has to be defined the same way in the whole
+ * program.
+ */
+#if !defined(LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS)
+#define LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS 0
+#endif
+
 namespace pmem
 {
 
@@ -122,6 +137,194 @@ class persistent_ptr;
 namespace detail
 {
 
+/*
+ * Per-thread set of memory ranges already added to the current transaction.
+ *
+ * The ranges are kept sorted, disjoint and not adjacent: a range which
+ * overlaps or touches already stored ones is merged with them. The cache is
+ * enabled only for the duration of an outermost transaction started by
+ * pmem::obj::transaction, whose stage callback clears it, so a range found
+ * here is guaranteed to be already snapshotted. When the cache is full it
+ * is cleared - a missing entry only costs a redundant libpmemobj call.
+ *
+ * The cache also remembers the lowest and the highest address which
+ * pmemobj_pool_by_ptr() found in the pool of the transaction. A pool is
+ * mapped contiguously, so every address between them is in the pool too.
+ */
+struct tx_snapshot_cache {
+	static constexpr std::size_t capacity = 32;
+
+	struct range {
+		std::uintptr_t begin;
+		std::uintptr_t end;
+	};
+
+	bool enabled;
+	std::size_t size;
+	range ranges[capacity];
+
+	PMEMobjpool *pool;
+	std::uintptr_t pool_first;
+	std::uintptr_t pool_last;
+
+#if LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS
+	/* Number of ranges found in (hits) and added to (misses) the cache. */
+	std::size_t hits;
+	std::size_t misses;
+#endif
+
+	void
+	reset(PMEMobjpool *pop) noexcept
+	{
+		enabled = pop != nullptr;
+		size = 0;
+		pool = pop;
+		pool_first = UINTPTR_MAX;
+		pool_last = 0;
+	}
+
+	bool
+	in_pool(std::uintptr_t addr) const noexcept
+	{
+		return pool_first <= addr && addr <= pool_last;
+	}
+
+	void
+	extend_pool(std::uintptr_t addr) noexcept
+	{
+		if (addr < pool_first)
+			pool_first = addr;
+		if (addr > pool_last)
+			pool_last = addr;
+	}
+
+	/* Index of the first range which ends at or after 'addr'. */
+	std::size_t
+	lower_bound(std::uintptr_t addr) const noexcept
+	{
+		std::size_t first = 0, count = size;
+		while (count > 0) {
+			std::size_t step = count / 2;
+			if (ranges[first + step].end < addr) {
+				first += step + 1;
+				count -= step + 1;
+			} else {
+				count = step;
+			}
+		}
+
+		return first;
+	}
+
+	bool
+	contains(std::uintptr_t begin, std::uintptr_t end) const noexcept
+	{
+		std::size_t i = lower_bound(begin);
+		return i < size && ranges[i].begin <= begin &&
+			end <= ranges[i].end;
+	}
+
+	void
+	insert(std::uintptr_t begin, std::uintptr_t end) noexcept
+	{
+		std::size_t first = lower_bound(begin);
+		std::size_t last = first;
+
+		/* ranges [first, last) overlap or touch the new one */
+		while (last < size && ranges[last].begin <= end) {
+			if (ranges[last].begin < begin)
+				begin = ranges[last].begin;
+			if (ranges[last].end > end)
+				end = ranges[last].end;
+			++last;
+		}
+
+		if (first == last) {
+			if (size == capacity) {
+				size = 0;
+				first = last = 0;
+			}
+
+			for (std::size_t i = size; i > first; --i)
+				ranges[i] = ranges[i - 1];
+			++size;
+		} else {
+			std::size_t merged = last - first - 1;
+			for (std::size_t i = last; i < size; ++i)
+				ranges[i - merged] = ranges[i];
+			size -= merged;
+		}
+
+		ranges[first].begin = begin;
+		ranges[first].end = end;
+	}
+};
+
+inline tx_snapshot_cache &
+get_tx_snapshot_cache() noexcept
+{
+	static thread_local tx_snapshot_cache cache;
+	return cache;
+}
+
+/*
+ * Add the range to the current transaction unless the snapshot cache shows
+ * it was already added. Must be called in TX_STAGE_WORK.
+ *
+ * @return 0 on success, error number otherwise.
+ */
+inline int
+tx_add_range(const void *addr, std::size_t size)
+{
+	auto &cache = get_tx_snapshot_cache();
+	auto begin = reinterpret_cast<std::uintptr_t>(addr);
+
+	if (cache.enabled) {
+		if (cache.contains(begin, begin + size)) {
+#if LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS
+			++cache.hits;
+#endif
+			return 0;
+		}
+
+		int ret = pmemobj_tx_add_range_direct(addr, size);
+		if (ret == 0) {
+#if LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS
+			++cache.misses;
+#endif
+			cache.insert(begin, begin + size);
+		}
+
+		return ret;
+	}
+
+	return pmemobj_tx_add_range_direct(addr, size);
+}
+
+/*
+ * Check whether the pointer is within any open pool. Addresses within the
+ * range known to belong to the pool of the current transaction are
+ * accepted without the pool lookup.
+ */
+inline bool
+in_open_pool(const void *ptr) noexcept
+{
+	auto &cache = get_tx_snapshot_cache();
+	auto addr = reinterpret_cast<std::uintptr_t>(ptr);
+
+	if (cache.enabled && cache.in_pool(addr))
+		return true;
+
+	PMEMobjpool *pop = pmemobj_pool_by_ptr(ptr);
+	if (pop == nullptr)
+		return false;
+
+	if (cache.enabled && pop == cache.pool)
+		cache.extend_pool(addr);
+
+	return true;
+}
+
 /*
  * Conditionally add 'count' objects to a transaction.
  *
@@ -143,10 +346,10 @@ conditional_add_to_tx(const T *that, std::size_t count = 1)
 		return;
 
 	/* 'that' is not in any open pool */
-	if (!pmemobj_pool_by_ptr(that))
+	if (!in_open_pool(that))
 		return;
 
-	if (pmemobj_tx_add_range_direct(that, sizeof(*that) * count))
+	if (tx_add_range(that, sizeof(*that) * count))
 		throw transaction_error(
 			"Could not add object(s) to the transaction.");
 }
@@ -194,6 +397,52 @@ next_pow_2(uint32_t v)
 	return v + (v == 0);
 }
 
+/** @returns binary logarithm of @arg x rounded down, for x > 0. */
+constexpr std::size_t
+static_log2(std::size_t x)
+{
+	return x > 1 ? 1 + static_log2(x >> 1) : 0;
+}
+
+/*
+ * Returns the index of the most significant bit set in x. x must not be 0.
+ */
+#if _MSC_VER
+inline int
+Log2(uint64_t x)
+{
+	unsigned long j;
+	_BitScanReverse64(&j, x);
+	return static_cast<int>(j);
+}
+#elif __GNUC__ || __clang__
+inline int
+Log2(uint64_t x)
+{
+	// __builtin_clz builtin count _number_ of leading zeroes
+	return 8 * int(sizeof(x)) - __builtin_clzll(x) - 1;
+}
+#else
+inline int
+Log2(uint64_t x)
+{
+	x |= (x >> 1);
+	x |= (x >> 2);
+	x |= (x >> 4);
+	x |= (x >> 8);
+	x |= (x >> 16);
+	x |= (x >> 32);
+
+	static const int table[64] = {
+		0,  58, 1,  59, 47, 53, 2,  60, 39, 48, 27, 54, 33, 42, 3,  61,
+		51, 37, 40, 49, 18, 28, 20, 55, 30, 34, 11, 43, 14, 22, 4,  62,
+		57, 46, 52, 38, 26, 32, 41, 50, 36, 17, 19, 29, 10, 13, 21, 56,
+		45, 25, 31, 35, 16, 9,  12, 44, 24, 15, 8,  23, 7,  6,  5,  63};
+
+	return table[(x * 0x03f6eaf2cd271461) >> 58];
+}
+#endif
+
 } /* namespace detail */
 
 } /* namespace pmem */
@@ -116,6 +116,17 @@ public:
 	using std::runtime_error::runtime_error;
 };
 
+/**
+ * Custom layout error class.
+ *
+ * Thrown when the layout of persistent data does not match the layout
+ * expected by the program.
+ */
+class layout_error : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
 /**
  * Custom ctl error class.
  *
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Fixed-capacity list of callbacks, which never allocates memory.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_TX_CALLBACK_LIST_HPP
+#define LIBPMEMOBJ_CPP_TX_CALLBACK_LIST_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/*
+ * List of at most 'capacity' callables without arguments. The callables
+ * are type-erased and stored inline, so a callable has to fit in
+ * 'callable_size' bytes. They are never moved.
+ */
+class tx_callback_list {
+public:
+	static constexpr std::size_t capacity = 16;
+	static constexpr std::size_t callable_size = 4 * sizeof(void *);
+
+	tx_callback_list() noexcept : count(0)
+	{
+	}
+
+	~tx_callback_list()
+	{
+		clear();
+	}
+
+	tx_callback_list(const tx_callback_list &) = delete;
+	tx_callback_list &operator=(const tx_callback_list &) = delete;
+
+	/*
+	 * Append the callable.
+	 *
+	 * @return false if the list is full, the callable is not stored then.
+	 */
+	template <typename F>
+	bool
+	push_back(F &&f)
+	{
+		using callable = typename std::decay<F>::type;
+
+		static_assert(sizeof(callable) <= callable_size,
+			      "callback is too big, capture less state or "
+			      "capture it by reference");
+		static_assert(alignof(callable) <= alignof(storage_type),
+			      "callback is overaligned");
+
+		if (count == capacity)
+			return false;
+
+		entry &e = entries[count];
+		new (&e.storage) callable(std::forward<F>(f));
+		e.invoke = &invoke<callable>;
+		e.destroy = &destroy<callable>;
+		++count;
+
+		return true;
+	}
+
+	/*
+	 * Call the callables in the order of registration.
+	 */
+	void
+	run()
+	{
+		for (std::size_t i = 0; i < count; ++i)
+			entries[i].invoke(&entries[i].storage);
+	}
+
+	/*
+	 * Destroy all the callables.
+	 */
+	void
+	clear() noexcept
+	{
+		for (std::size_t i = 0; i < count; ++i)
+			entries[i].destroy(&entries[i].storage);
+
+		count = 0;
+	}
+
+	bool
+	empty() const noexcept
+	{
+		return count == 0;
+	}
+
+private:
+	using storage_type = typename std::aligned_storage<
+		callable_size, alignof(std::max_align_t)>::type;
+
+	struct entry {
+		storage_type storage;
+		void (*invoke)(void *);
+		void (*destroy)(void *);
+	};
+
+	template <typename F>
+	static void
+	invoke(void *f)
+	{
+		(*static_cast<F *>(f))();
+	}
+
+	template <typename F>
+	static void
+	destroy(void *f) noexcept
+	{
+		static_cast<F *>(f)->~F();
+	}
+
+	entry entries[capacity];
+	std::size_t count;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_TX_CALLBACK_LIST_HPP */
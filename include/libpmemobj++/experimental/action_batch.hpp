@@ -0,0 +1,369 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Reserve/publish actions: allocations and 8-byte stores which become
+ * durable together with a single redo log.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_ACTION_BATCH_HPP
+#define LIBPMEMOBJ_CPP_ACTION_BATCH_HPP
+
+#include <libpmemobj++/allocation_flag.hpp>
+#include <libpmemobj++/detail/check_persistent_ptr_array.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pexceptions.hpp>
+#include <libpmemobj++/detail/variadic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj/action_base.h>
+#include <libpmemobj/base.h>
+#include <libpmemobj/tx_base.h>
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * pmem::obj::experimental::action_batch - EXPERIMENTAL set of deferred
+ * allocations, frees and 8-byte stores which are published atomically.
+ *
+ * This is a C++ wrapper over the reserve/publish API of libpmemobj
+ * (pmemobj_reserve, pmemobj_set_value, pmemobj_defer_free, pmemobj_publish
+ * and pmemobj_cancel). Objects allocated with make_persistent() are
+ * reserved and constructed immediately, but they become allocated only when
+ * the batch is published. The stores registered with set() are not visible
+ * until then. publish() applies all the actions with a single redo log, so
+ * allocating an object and linking it into a data structure costs no undo
+ * log and no snapshots.
+ *
+ * Actions which were not published are cancelled by cancel() or by the
+ * destructor, which makes the reservations available again.
+ *
+ * The constructed objects are flushed, but not drained, the fence of
+ * publish() orders them before the redo log.
+ *
+ * The typical usage example would be:
+ * @code
+ * action_batch batch(pop);
+ * auto n = batch.make_persistent<node>(value);
+ * batch.set(n->next, head);
+ * batch.set(root->head, n);
+ * batch.publish();
+ * @endcode
+ *
+ * make_persistent() of action_batch throws inside transactions, the
+ * constructors of the reserved objects would snapshot memory which is not
+ * allocated yet. publish() may be called in a transaction, the actions
+ * then become a part of it.
+ */
+class action_batch {
+public:
+	using size_type = std::size_t;
+
+	/**
+	 * Construct an empty batch of actions in the given pool.
+	 */
+	explicit action_batch(pool_base &pool) noexcept : pop(pool.handle())
+	{
+	}
+
+	/**
+	 * Destructor. Cancels all the actions which were not published.
+	 */
+	~action_batch()
+	{
+		cancel();
+	}
+
+	action_batch(const action_batch &) = delete;
+	action_batch &operator=(const action_batch &) = delete;
+
+	/**
+	 * Reserve memory for an object of type T and construct it. The object
+	 * becomes allocated when the batch is published.
+	 *
+	 * @param[in] flag affects behaviour of allocator.
+	 * @param[in] args arguments passed to the constructor of the object.
+	 *
+	 * @return persistent_ptr to the reserved object.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw std::bad_alloc on reservation failure.
+	 * @throw rethrows constructor exception, the reservation is cancelled
+	 * in that case.
+	 */
+	template <typename T, typename... Args>
+	typename detail::pp_if_not_array<T>::type
+	make_persistent(allocation_flag_atomic flag, Args &&... args)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			throw transaction_scope_error(
+				"action_batch::make_persistent cannot be "
+				"called inside a transaction");
+
+		pobj_action act;
+		PMEMoid oid = pmemobj_xreserve(pop, &act, sizeof(T),
+					       detail::type_num<T>(),
+					       flag.value);
+		if (OID_IS_NULL(oid))
+			throw std::bad_alloc();
+
+		T *ptr = static_cast<T *>(pmemobj_direct(oid));
+		try {
+			detail::create<T, Args...>(ptr,
+						   std::forward<Args>(args)...);
+		} catch (...) {
+			pmemobj_cancel(pop, &act, 1);
+			throw;
+		}
+
+		pmemobj_flush(pop, ptr, sizeof(T));
+		push(act);
+
+		return oid;
+	}
+
+	/**
+	 * Reserve memory for an object of type T and construct it. The object
+	 * becomes allocated when the batch is published.
+	 *
+	 * @param[in] args arguments passed to the constructor of the object.
+	 *
+	 * @return persistent_ptr to the reserved object.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw std::bad_alloc on reservation failure.
+	 * @throw rethrows constructor exception, the reservation is cancelled
+	 * in that case.
+	 */
+	template <typename T, typename... Args>
+	typename std::enable_if<
+		!detail::is_first_arg_same<allocation_flag_atomic,
+					   Args...>::value,
+		typename detail::pp_if_not_array<T>::type>::type
+	make_persistent(Args &&... args)
+	{
+		return make_persistent<T>(allocation_flag_atomic::none(),
+					  std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Free the object when the batch is published. The destructor of the
+	 * object is not called, so T has to be trivially destructible.
+	 *
+	 * @param[in] ptr object to be freed.
+	 */
+	template <typename T>
+	void
+	free(const persistent_ptr<T> &ptr)
+	{
+		static_assert(std::is_trivially_destructible<T>::value,
+			      "action_batch can only free trivially "
+			      "destructible objects");
+
+		if (ptr == nullptr)
+			return;
+
+		pobj_action act;
+		pmemobj_defer_free(pop, ptr.raw(), &act);
+		push(act);
+	}
+
+	/**
+	 * Assign value, converted to persistent_ptr<T>, to the persistent
+	 * pointer field when the batch is published.
+	 *
+	 * @param[in,out] field persistent pointer in the pool to be set.
+	 * @param[in] value new value of the field.
+	 */
+	template <typename T, typename Y>
+	void
+	set(persistent_ptr<T> &field, const Y &value)
+	{
+		const persistent_ptr<T> ptr = value;
+		PMEMoid *dst = field.raw_ptr();
+		const PMEMoid &src = ptr.raw();
+
+		set_value(&dst->pool_uuid_lo, src.pool_uuid_lo);
+		set_value(&dst->off, src.off);
+	}
+
+	/**
+	 * Assign value, converted to T, to the persistent field when the batch
+	 * is published. The field has to be exactly 8 bytes long.
+	 *
+	 * @param[in,out] field persistent field in the pool to be set.
+	 * @param[in] value new value of the field.
+	 */
+	template <typename T, typename Y>
+	void
+	set(p<T> &field, const Y &value)
+	{
+		static_assert(sizeof(p<T>) == sizeof(uint64_t) &&
+				      LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+			      "action_batch can only set trivially copyable "
+			      "8-byte fields");
+
+		const T val = value;
+		uint64_t raw;
+		std::memcpy(&raw, &val, sizeof(raw));
+		set_value(reinterpret_cast<uint64_t *>(&field), raw);
+	}
+
+	/**
+	 * Assign value to the 8-byte word at ptr when the batch is published.
+	 *
+	 * @param[in,out] ptr address in the pool to be set.
+	 * @param[in] value new value of the word.
+	 */
+	void
+	set_value(uint64_t *ptr, uint64_t value)
+	{
+		pobj_action act;
+		pmemobj_set_value(pop, &act, ptr, value);
+		push(act);
+	}
+
+	/**
+	 * Atomically apply all the actions of the batch. In a transaction the
+	 * actions become a part of the transaction instead, which owns them
+	 * from then on: they are cancelled if the transaction aborts. The
+	 * batch is empty afterwards and can be reused.
+	 *
+	 * @throw pmem::transaction_error when publishing failed. Outside of
+	 * a transaction the actions stay in the batch and are cancelled by
+	 * the destructor. In a transaction the failure aborts it, which
+	 * cancels the actions, so the batch is emptied.
+	 */
+	void
+	publish()
+	{
+		if (actions.empty())
+			return;
+
+		if (pmemobj_tx_stage() == TX_STAGE_WORK) {
+			int ret = pmemobj_tx_publish(actions.data(),
+						     actions.size());
+
+			/* the transaction has taken the actions over */
+			actions.clear();
+
+			if (ret != 0)
+				throw transaction_error(
+					"failed to publish actions");
+
+			return;
+		}
+
+		if (pmemobj_publish(pop, actions.data(), actions.size()) != 0)
+			throw transaction_error("failed to publish actions");
+
+		actions.clear();
+	}
+
+	/**
+	 * Cancel all the actions of the batch. The reserved objects are
+	 * released without calling their destructors and none of the stores
+	 * or frees is applied.
+	 */
+	void
+	cancel() noexcept
+	{
+		if (actions.empty())
+			return;
+
+		pmemobj_cancel(pop, actions.data(), actions.size());
+		actions.clear();
+	}
+
+	/**
+	 * @return number of pending actions.
+	 */
+	size_type
+	size() const noexcept
+	{
+		return actions.size();
+	}
+
+	/**
+	 * @return true if there are no pending actions.
+	 */
+	bool
+	empty() const noexcept
+	{
+		return actions.empty();
+	}
+
+private:
+	/**
+	 * Append the action, cancelling it if the batch cannot grow.
+	 */
+	void
+	push(pobj_action &act)
+	{
+		try {
+			actions.push_back(act);
+		} catch (...) {
+			pmemobj_cancel(pop, &act, 1);
+			throw;
+		}
+	}
+
+	PMEMobjpool *pop;
+	std::vector<pobj_action> actions;
+};
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_ACTION_BATCH_HPP */
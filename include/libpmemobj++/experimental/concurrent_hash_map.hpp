@@ -38,6 +38,7 @@
 #ifndef PMEMOBJ_CONCURRENT_HASH_MAP_HPP
 #define PMEMOBJ_CONCURRENT_HASH_MAP_HPP
 
+#include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/experimental/v.hpp>
 #include <libpmemobj++/make_persistent.hpp>
 #include <libpmemobj++/make_persistent_array.hpp>
@@ -47,9 +48,6 @@
 #include <libpmemobj++/p.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/transaction.hpp>
-#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-#include <libpmemobj++/detail/common.hpp>
-#endif
 
 #if LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
 #include "tbb/spin_rw_mutex.h"
@@ -59,15 +57,24 @@
 
 #include <libpmemobj++/detail/persistent_pool_ptr.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <initializer_list>
 #include <iterator> // for std::distance
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #if _MSC_VER
 #include <intrin.h>
@@ -100,6 +107,20 @@ using namespace pmem::obj;
 
 /**
  * hash_compare that is default argument for concurrent_hash_map
+ *
+ * A HashCompare which defines a nested type is_transparent enables the
+ * count(), find(), find_optimistic() and erase() overloads which take a key
+ * of any type K. HashCompare::hash(const K &) and
+ * HashCompare::equal(const K &, const Key &) must be then callable and
+ * consistent with the ones for Key, so that e.g. a string view can be
+ * used to look up string keys without constructing a Key.
+ *
+ * A HashCompare which defines a nested type cache_hash_code makes
+ * concurrent_hash_map store the hash code of the key in each node. Lookups
+ * then compare keys only if their hash codes are equal and rehashing does
+ * not have to hash the keys again, at the cost of a larger node. The layout
+ * of the persistent data depends on it, so a table must be always opened
+ * with a HashCompare which makes the same choice.
  */
 template <typename Key>
 struct hash_compare {
@@ -116,7 +137,184 @@ struct hash_compare {
 	}
 };
 
-template <typename Key, typename T, typename HashCompare = hash_compare<Key>>
+/**
+ * Bucket layout policy of concurrent_hash_map which packs the fields of a
+ * bucket without any padding. This is the default one.
+ */
+struct compact_bucket_layout {
+	static constexpr bool padded = false;
+	static constexpr bool fingerprints = false;
+};
+
+/**
+ * Bucket layout policy of concurrent_hash_map which pads each bucket to
+ * a multiple of the cache line size and allocates the segments of buckets
+ * aligned to it, so that writers of adjacent buckets do not share cache
+ * lines, at the cost of a larger table. The embedded buckets, which are
+ * stored in the table object, are not aligned.
+ *
+ * With Fingerprints, the padding also holds a volatile set of fingerprints
+ * of the hash codes stored in the bucket, which lets lookups of absent keys
+ * skip walking the node list. The set is not valid after a restart until
+ * concurrent_hash_map::initialize() rebuilds it. After a graceful shutdown
+ * initialize() does not visit the nodes, it fills the sets instead, so the
+ * lookups walk the node lists until the sets are cleared again.
+ *
+ * The layout of the persistent data depends on the policy, so a table must
+ * be always opened with the one it was created with, which is checked by
+ * concurrent_hash_map::initialize().
+ */
+template <bool Fingerprints = false>
+struct cache_aligned_bucket_layout {
+	static constexpr bool padded = true;
+	static constexpr bool fingerprints = Fingerprints;
+};
+
+/**
+ * Node allocation policy of concurrent_hash_map which reserves a node,
+ * constructs it and then publishes the allocation together with the pointer
+ * to the node, without a transaction.
+ *
+ * Key and T are constructed outside of a transaction, so the policy is
+ * accepted only for types whose construction cannot need one: trivially
+ * copyable types and p<> of them. Persistent containers, e.g.
+ * experimental::string, require transactional_node_allocation.
+ */
+struct atomic_node_allocation {
+};
+
+/**
+ * Node allocation policy of concurrent_hash_map which allocates and
+ * constructs each node in a separate transaction. This is the default one.
+ */
+struct transactional_node_allocation {
+};
+
+/**
+ * Statistics policy of concurrent_hash_map which does not collect any
+ * counters. This is the default one, it neither changes the layout of the
+ * table nor adds any code to the operations.
+ */
+struct no_statistics {
+	static constexpr bool enabled = false;
+};
+
+/**
+ * Statistics policy of concurrent_hash_map which counts restarts of the
+ * operations, backoff pauses and rehashed buckets. The counters are
+ * volatile, they start from zero every time the pool is opened.
+ *
+ * The counters are stored in the table, so a table must be always opened
+ * with the Statistics policy it was created with.
+ */
+struct collect_statistics {
+	static constexpr bool enabled = true;
+};
+
+/**
+ * Lookup policy of concurrent_hash_map under which find_optimistic() locks
+ * the bucket and the item like find(). This is the default one, it neither
+ * changes the layout of the table nor adds any work to the writers.
+ */
+struct locked_lookup {
+	static constexpr bool optimistic = false;
+};
+
+/**
+ * Lookup policy of concurrent_hash_map which adds a sequence counter to each
+ * bucket and node, so that find_optimistic() reads the item without taking
+ * any lock. Writers update the counters of the buckets and items they
+ * modify.
+ *
+ * The counters are stored in the table, so a table must be always opened
+ * with the Lookup policy it was created with.
+ */
+struct optimistic_lookup {
+	static constexpr bool optimistic = true;
+};
+
+/**
+ * Snapshot of the statistics of concurrent_hash_map, see
+ * concurrent_hash_map::stats().
+ */
+struct concurrent_hash_map_stats {
+	/** Number of bins of the chain length histogram. */
+	static constexpr std::size_t chain_length_bins = 8;
+
+	/** Occupancy of a segment of the table. */
+	struct segment_stats {
+		/** Number of buckets in the segment. */
+		std::size_t buckets;
+
+		/** Number of buckets holding at least one node. */
+		std::size_t used_buckets;
+
+		/** Number of nodes in the segment. */
+		std::size_t nodes;
+	};
+
+	/**
+	 * Number of operations restarted because the table grew
+	 * concurrently or a lock was contended for too long.
+	 */
+	std::size_t restarts;
+
+	/** Number of pauses spent waiting for a contended item. */
+	std::size_t backoff_pauses;
+
+	/** Number of buckets rehashed lazily, by rehash() or rehash_step(). */
+	std::size_t rehashed_buckets;
+
+	/**
+	 * Number of buckets holding i nodes at index i. The last bin counts
+	 * also the buckets with longer chains.
+	 */
+	std::array<std::size_t, chain_length_bins> chain_length;
+
+	/** Occupancy of the enabled segments, indexed by segment. */
+	std::vector<segment_stats> segments;
+};
+
+/**
+ * Growth policy of concurrent_hash_map which keeps the load factor (the
+ * number of elements per bucket) at most Numerator / Denominator. When it
+ * is exceeded, the table doubles the number of buckets. The default load
+ * factor is 1. A higher one saves memory at the cost of longer chains, a
+ * lower one shortens the chains and costs more buckets. With a load factor
+ * below 1 the element counter is summed on every insert, otherwise only
+ * on inserts into non-empty buckets.
+ */
+template <std::size_t Numerator, std::size_t Denominator = 1>
+struct load_factor_growth {
+	static_assert(Numerator > 0 && Denominator > 0,
+		      "Load factor has to be positive");
+
+	/**
+	 * @returns number of buckets needed to store @arg n elements without
+	 * exceeding the load factor.
+	 */
+	static constexpr std::size_t
+	buckets_for(std::size_t n) noexcept
+	{
+		return n / Numerator * Denominator +
+			(n % Numerator * Denominator + Numerator - 1) /
+			Numerator;
+	}
+
+	/** @returns the maximum load factor. */
+	static constexpr float
+	max_load_factor() noexcept
+	{
+		return float(Numerator) / float(Denominator);
+	}
+};
+
+template <typename Key, typename T, typename HashCompare = hash_compare<Key>,
+	  typename BucketLayout = compact_bucket_layout,
+	  typename NodeAllocation = transactional_node_allocation,
+	  typename Statistics = no_statistics,
+	  typename GrowthPolicy = load_factor_growth<1>,
+	  typename Lookup = locked_lookup>
 class concurrent_hash_map;
 
 /** @cond INTERNAL */
@@ -141,41 +339,7 @@ assert_not_locked(pmem::obj::experimental::v<Mutex> &mtx)
 	assert_not_locked<Mutex>(mtx.get());
 }
 
-#if _MSC_VER
-static inline int
-Log2(uint64_t x)
-{
-	unsigned long j;
-	_BitScanReverse64(&j, x);
-	return static_cast<int>(j);
-}
-#elif __GNUC__ || __clang__
-static inline int
-Log2(uint64_t x)
-{
-	// __builtin_clz builtin count _number_ of leading zeroes
-	return 8 * int(sizeof(x)) - __builtin_clzll(x) - 1;
-}
-#else
-static inline int
-Log2(uint64_t x)
-{
-	x |= (x >> 1);
-	x |= (x >> 2);
-	x |= (x >> 4);
-	x |= (x >> 8);
-	x |= (x >> 16);
-	x |= (x >> 32);
-
-	static const int table[64] = {
-		0,  58, 1,  59, 47, 53, 2,  60, 39, 48, 27, 54, 33, 42, 3,  61,
-		51, 37, 40, 49, 18, 28, 20, 55, 30, 34, 11, 43, 14, 22, 4,  62,
-		57, 46, 52, 38, 26, 32, 41, 50, 36, 17, 19, 29, 10, 13, 21, 56,
-		45, 25, 31, 35, 16, 9,  12, 44, 24, 15, 8,  23, 7,  6,  5,  63};
-
-	return table[(x * 0x03f6eaf2cd271461) >> 58];
-}
-#endif
+using pmem::detail::Log2;
 
 class atomic_backoff {
 	/**
@@ -265,6 +429,51 @@ public:
 	}
 }; /* class atomic_backoff */
 
+/**
+ * Splits range [0, n) into concurrency contiguous parts and calls f(first,
+ * last) for each of them in a separate thread. The calling thread processes
+ * the first part. The first exception thrown by f is rethrown after all the
+ * threads finish.
+ * @throw std::system_error if a thread cannot be started.
+ */
+template <typename F>
+void
+parallel_split(size_t n, size_t concurrency, F f)
+{
+	assert(concurrency > 0 && concurrency <= n);
+
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors(concurrency);
+
+	auto worker = [&](size_t i) {
+		try {
+			f(n * i / concurrency, n * (i + 1) / concurrency);
+		} catch (...) {
+			errors[i] = std::current_exception();
+		}
+	};
+
+	try {
+		workers.reserve(concurrency - 1);
+		for (size_t i = 1; i < concurrency; ++i)
+			workers.emplace_back(worker, i);
+	} catch (...) {
+		for (auto &t : workers)
+			t.join();
+		throw;
+	}
+
+	worker(0);
+
+	for (auto &t : workers)
+		t.join();
+
+	for (auto &e : errors) {
+		if (e)
+			std::rethrow_exception(e);
+	}
+}
+
 /**
  * This wrapper for std::atomic<T> allows to initialize volatile atomic fields
  * with custom initializer
@@ -305,7 +514,8 @@ private:
  */
 template <typename T, typename U, typename... Args>
 void
-make_persistent_object(pool_base &pop, persistent_ptr<U> &ptr, Args &&... args)
+make_persistent_object(transactional_node_allocation, pool_base &pop,
+		       persistent_ptr<U> &ptr, Args &&... args)
 {
 #if LIBPMEMOBJ_CPP_CONCURRENT_HASH_MAP_USE_ATOMIC_ALLOCATOR
 	make_persistent_atomic<T>(pop, ptr, std::forward<Args>(args)...);
@@ -320,6 +530,61 @@ make_persistent_object(pool_base &pop, persistent_ptr<U> &ptr, Args &&... args)
 #endif
 }
 
+/**
+ * Wrapper around PMDK reserve/publish API. The object is constructed in
+ * the reserved memory and persisted, then the allocation and the store of
+ * its address to @arg ptr are published at once. No undo log is needed and
+ * nothing leaks if the process is interrupted before the publication.
+ * @throw std::bad_alloc on allocation failure, or the exception thrown by
+ * the constructor of T.
+ */
+template <typename T, typename U, typename... Args>
+void
+make_persistent_object(atomic_node_allocation, pool_base &pop,
+		       persistent_ptr<U> &ptr, Args &&... args)
+{
+	struct pobj_action act[3];
+
+	PMEMoid oid = pmemobj_reserve(pop.handle(), &act[0], sizeof(T),
+				      detail::type_num<T>());
+	if (OID_IS_NULL(oid))
+		throw std::bad_alloc();
+
+	T *obj = static_cast<T *>(pmemobj_direct(oid));
+
+	try {
+		detail::create<T>(obj, std::forward<Args>(args)...);
+	} catch (...) {
+		pmemobj_cancel(pop.handle(), act, 1);
+		throw;
+	}
+
+	pop.persist(obj, sizeof(T));
+
+	pmemobj_set_value(pop.handle(), &act[1], &ptr.raw_ptr()->pool_uuid_lo,
+			  oid.pool_uuid_lo);
+	pmemobj_set_value(pop.handle(), &act[2], &ptr.raw_ptr()->off, oid.off);
+
+	if (pmemobj_publish(pop.handle(), act, 3) != 0) {
+		detail::destroy<T>(*obj);
+		pmemobj_cancel(pop.handle(), act, 3);
+		throw std::bad_alloc();
+	}
+}
+
+/**
+ * Checks whether construction of T can not need a transaction, which is
+ * required by atomic_node_allocation.
+ */
+template <typename T>
+struct is_atomically_constructible
+    : std::integral_constant<bool, LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T)> {
+};
+
+template <typename T>
+struct is_atomically_constructible<p<T>> : is_atomically_constructible<T> {
+};
+
 #if !LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
 class shared_mutex_scoped_lock {
 	using rw_mutex_type = pmem::obj::shared_mutex;
@@ -437,113 +702,837 @@ protected:
 }; /* class shared_mutex_scoped_lock */
 #endif
 
-struct hash_map_node_base {
-#if LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
-	/** Mutex type. */
-	using mutex_t = pmem::obj::experimental::v<tbb::spin_rw_mutex>;
-
-	/** Scoped lock type for mutex. */
-	using scoped_t = tbb::spin_rw_mutex::scoped_lock;
-#else
-	/** Mutex type. */
-	using mutex_t = pmem::obj::shared_mutex;
-
-	/** Scoped lock type for mutex. */
-	using scoped_t = shared_mutex_scoped_lock;
+/**
+ * Sequence counter used to validate optimistic (lock-free) reads.
+ *
+ * A writer, which must hold an exclusive lock on the protected data, makes the
+ * counter odd before the modification and even after it. A reader retries if
+ * the counter was odd or has changed while it was reading.
+ *
+ * The counter is never flushed, so its value after a restart is meaningless.
+ * Starting a write sets the lowest bit instead of incrementing the counter,
+ * which keeps the protocol correct even if a crash left the counter odd.
+ */
+class seq_counter {
+public:
+	seq_counter() noexcept : my_seq(0)
+	{
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&my_seq, sizeof(my_seq));
+#endif
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		VALGRIND_HG_DISABLE_CHECKING(&my_seq, sizeof(my_seq));
 #endif
+	}
 
-	/** Persistent pointer type for next. */
-	using node_base_ptr_t = detail::persistent_pool_ptr<hash_map_node_base>;
+	/** Copy constructor is deleted */
+	seq_counter(const seq_counter &) = delete;
 
-	/** Next node in chain. */
-	node_base_ptr_t next;
+	/** Assignment operator is deleted */
+	seq_counter &operator=(const seq_counter &) = delete;
 
-	/** Node mutex. */
-	mutex_t mutex;
+	/**
+	 * Start an optimistic read.
+	 * @returns value to be passed to read_retry().
+	 */
+	uint64_t
+	read_begin() const
+	{
+		return my_seq.load(std::memory_order_acquire);
+	}
 
-	hash_map_node_base() : next(OID_NULL)
+	/**
+	 * Check if data read since read_begin() might be inconsistent.
+	 * @returns true if the read has to be retried.
+	 */
+	bool
+	read_retry(uint64_t seq) const
 	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		return (seq & 1) ||
+			my_seq.load(std::memory_order_relaxed) != seq;
 	}
 
-	hash_map_node_base(const node_base_ptr_t &_next) : next(_next)
+	/** Mark the beginning of a modification. */
+	void
+	write_begin()
 	{
+		my_seq.store(my_seq.load(std::memory_order_relaxed) | 1,
+			     std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
 	}
 
-	hash_map_node_base(node_base_ptr_t &&_next) : next(std::move(_next))
+	/** Mark the end of a modification. */
+	void
+	write_end()
 	{
+		my_seq.store(my_seq.load(std::memory_order_relaxed) + 1,
+			     std::memory_order_release);
 	}
 
-	/** Copy constructor is deleted */
-	hash_map_node_base(const hash_map_node_base &) = delete;
+	/**
+	 * Marks modification of the counter's data for the lifetime of the
+	 * object.
+	 */
+	class scoped_write {
+	public:
+		scoped_write(seq_counter &seq) : my_counter(seq)
+		{
+			my_counter.write_begin();
+		}
 
-	/** Assignment operator is deleted */
-	hash_map_node_base &operator=(const hash_map_node_base &) = delete;
-}; /* struct hash_map_node_base */
+		~scoped_write()
+		{
+			my_counter.write_end();
+		}
 
-/** Empty bucket flag. */
-static detail::persistent_pool_ptr<hash_map_node_base> const empty_bucket =
-	OID_NULL;
+		scoped_write(const scoped_write &) = delete;
+		scoped_write &operator=(const scoped_write &) = delete;
+
+	private:
+		seq_counter &my_counter;
+	};
+
+private:
+	std::atomic<uint64_t> my_seq;
+}; /* class seq_counter */
 
 /**
- * The class provides the way to access certain properties of segments
- * used by hash map
+ * Counter with the interface of seq_counter which does not store anything,
+ * used when the lookups are not optimistic.
  */
-template <typename Bucket>
-class segment_traits {
+class null_seq_counter {
 public:
-	/** segment index type */
-	using segment_index_t = size_t;
-	using size_type = size_t;
-	using bucket_type = Bucket;
+	uint64_t
+	read_begin() const noexcept
+	{
+		return 0;
+	}
 
-protected:
-	/** PMDK has limitation for allocation size. */
-	constexpr static size_type max_allocation_size = PMEMOBJ_MAX_ALLOC_SIZE;
+	bool
+	read_retry(uint64_t) const noexcept
+	{
+		return false;
+	}
 
-	/** First big block that has fixed size. */
-	constexpr static segment_index_t first_big_block = 27;
-	/* TODO: avoid hardcoded value; need constexpr  similar to:
-	 * Log2(max_allocation_size / sizeof(bucket_type)) */
+	void
+	write_begin() const noexcept
+	{
+	}
 
-	/** Max number of buckets per segment. */
-	constexpr static size_type big_block_size = size_type(1)
-		<< first_big_block;
+	void
+	write_end() const noexcept
+	{
+	}
 
-	/* Block size in bytes cannot exceed max_allocation_size */
-	static_assert((big_block_size * sizeof(bucket_type)) <
-			      max_allocation_size,
-		      "Block size exceeds max_allocation_size");
+	class scoped_write {
+	public:
+		scoped_write(const null_seq_counter &) noexcept
+		{
+		}
+	};
+}; /* class null_seq_counter */
 
-	/** @returns index of the first block in the @arg seg. */
-	constexpr static segment_index_t
-	first_block_in_segment(segment_index_t seg)
+/**
+ * Sequence counter of a bucket or a node, which validates optimistic reads
+ * and is changed by holders of a write lock. The primary template does not
+ * occupy any space as an empty base class.
+ */
+template <bool Enabled>
+class hash_map_seq {
+public:
+	using seq_counter_type = null_seq_counter;
+
+	null_seq_counter
+	seq() const noexcept
 	{
-		return seg < first_big_block
-			? seg
-			: (first_big_block +
-			   (segment_index_t(1) << (seg - first_big_block)) - 1);
+		return null_seq_counter();
 	}
+};
 
-	/** @returns number of blocks in the @arg seg. */
-	constexpr static size_type
-	blocks_in_segment(segment_index_t seg)
+template <>
+class hash_map_seq<true> {
+public:
+	using seq_counter_type = seq_counter;
+
+	seq_counter &
+	seq() noexcept
 	{
-		return seg < first_big_block
-			? segment_index_t(1)
-			: segment_index_t(1) << (seg - first_big_block);
+		return my_seq;
 	}
 
-	/** @returns number of buckets in the @arg b. */
-	constexpr static size_type
-	block_size(segment_index_t b)
+	const seq_counter &
+	seq() const noexcept
 	{
-		return b < first_big_block ? segment_size(b ? b : 1)
-					   : big_block_size;
+		return my_seq;
 	}
 
-public:
-	/** Number of embedded segments*/
-	constexpr static segment_index_t embedded_segments = 1;
+private:
+	seq_counter my_seq;
+};
+
+template <typename...>
+struct make_void {
+	using type = void;
+};
+
+/** Checks if HashCompare defines is_transparent type. */
+template <typename HashCompare, typename = void>
+struct has_is_transparent : std::false_type {
+};
+
+template <typename HashCompare>
+struct has_is_transparent<
+	HashCompare,
+	typename make_void<typename HashCompare::is_transparent>::type>
+	: std::true_type {
+};
+
+/** Checks if HashCompare defines cache_hash_code type. */
+template <typename HashCompare, typename = void>
+struct has_cache_hash_code : std::false_type {
+};
+
+template <typename HashCompare>
+struct has_cache_hash_code<
+	HashCompare,
+	typename make_void<typename HashCompare::cache_hash_code>::type>
+	: std::true_type {
+};
+
+/**
+ * Hash code of the key stored in a node. The primary template does not store
+ * anything, the hash code has to be calculated from the key.
+ */
+template <bool Cached>
+struct hash_map_node_hash {
+	hash_map_node_hash(size_t) noexcept
+	{
+	}
+
+	/** @returns false, the hash code is not stored. */
+	bool
+	cached_hash_code(size_t &) const noexcept
+	{
+		return false;
+	}
+
+	/** @returns true, keys have to be compared. */
+	bool
+	may_have_hash_code(size_t) const noexcept
+	{
+		return true;
+	}
+};
+
+template <>
+struct hash_map_node_hash<true> {
+	hash_map_node_hash(size_t h) noexcept : hash_code(h)
+	{
+	}
+
+	/** @returns true and the stored hash code in @arg h. */
+	bool
+	cached_hash_code(size_t &h) const noexcept
+	{
+		h = hash_code.get_ro();
+		return true;
+	}
+
+	/** @returns true if keys with hash code @arg h may be equal. */
+	bool
+	may_have_hash_code(size_t h) const noexcept
+	{
+		return hash_code.get_ro() == h;
+	}
+
+	/** Hash code of the key. */
+	p<size_t> hash_code;
+};
+
+/** Bits of the incompat layout features of concurrent_hash_map. */
+enum hash_map_incompat_feature : uint32_t {
+	/** Nodes store the hash code of the key. */
+	FEATURE_CACHED_HASH_CODE = 1,
+	/** The table stores volatile statistics counters. */
+	FEATURE_STATISTICS = 2,
+	/** Buckets are padded and their blocks cache aligned. */
+	FEATURE_PADDED_BUCKETS = 4,
+	/** Buckets store sets of fingerprints. */
+	FEATURE_BUCKET_FINGERPRINTS = 8,
+	/** Buckets and nodes store sequence counters for optimistic lookups. */
+	FEATURE_SEQ_LOCK = 16,
+};
+
+/** @returns @arg feature if @arg enabled, no features otherwise. */
+constexpr uint32_t
+hash_map_feature_if(bool enabled, hash_map_incompat_feature feature)
+{
+	return enabled ? static_cast<uint32_t>(feature) : uint32_t(0);
+}
+
+struct hash_map_node_base {
+#if LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
+	/** Mutex type. */
+	using mutex_t = pmem::obj::experimental::v<tbb::spin_rw_mutex>;
+
+	/** Scoped lock type for mutex. */
+	using scoped_t = tbb::spin_rw_mutex::scoped_lock;
+#else
+	/** Mutex type. */
+	using mutex_t = pmem::obj::shared_mutex;
+
+	/** Scoped lock type for mutex. */
+	using scoped_t = shared_mutex_scoped_lock;
+#endif
+
+	/** Persistent pointer type for next. */
+	using node_base_ptr_t = detail::persistent_pool_ptr<hash_map_node_base>;
+
+	/** Next node in chain. */
+	node_base_ptr_t next;
+
+	/** Node mutex. */
+	mutex_t mutex;
+
+	hash_map_node_base() : next(OID_NULL)
+	{
+	}
+
+	hash_map_node_base(const node_base_ptr_t &_next) : next(_next)
+	{
+	}
+
+	hash_map_node_base(node_base_ptr_t &&_next) : next(std::move(_next))
+	{
+	}
+
+	/** Copy constructor is deleted */
+	hash_map_node_base(const hash_map_node_base &) = delete;
+
+	/** Assignment operator is deleted */
+	hash_map_node_base &operator=(const hash_map_node_base &) = delete;
+}; /* struct hash_map_node_base */
+
+/** Empty bucket flag. */
+static detail::persistent_pool_ptr<hash_map_node_base> const empty_bucket =
+	OID_NULL;
+
+/**
+ * Set of fingerprints of the hash codes stored in a bucket. The primary
+ * template does not store anything, every bucket may contain any hash code.
+ */
+template <bool Enabled>
+class hash_map_fingerprints {
+public:
+	/** @returns true, the node list has to be searched. */
+	bool
+	may_contain(size_t) const noexcept
+	{
+		return true;
+	}
+
+	void
+	add_fingerprint(size_t) noexcept
+	{
+	}
+
+	void
+	add_fingerprints(const hash_map_fingerprints &) noexcept
+	{
+	}
+
+	void
+	fill_fingerprints() noexcept
+	{
+	}
+
+	void
+	clear_fingerprints() noexcept
+	{
+	}
+};
+
+/**
+ * Volatile 64-bit set of fingerprints. A fingerprint is added before a node
+ * with the hash code is linked to the bucket and never removed (except by
+ * clear_fingerprints()), so the set may contain fingerprints of nodes which
+ * are gone, but never misses the ones which are present.
+ *
+ * The set is never flushed, so its value after a restart is meaningless
+ * until concurrent_hash_map::initialize() rebuilds or fills it. It is not
+ * wrapped in v<>, which would look up the pool on every access.
+ */
+template <>
+class hash_map_fingerprints<true> {
+public:
+	hash_map_fingerprints() noexcept : my_set(0)
+	{
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&my_set, sizeof(my_set));
+#endif
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		VALGRIND_HG_DISABLE_CHECKING(&my_set, sizeof(my_set));
+#endif
+	}
+
+	/** @returns false if no node with hash code @arg h is stored. */
+	bool
+	may_contain(size_t h) const noexcept
+	{
+		return (fingerprints().load(std::memory_order_relaxed) &
+			fingerprint(h)) != 0;
+	}
+
+	void
+	add_fingerprint(size_t h) noexcept
+	{
+		fingerprints().fetch_or(fingerprint(h),
+					std::memory_order_relaxed);
+	}
+
+	/** Adds all fingerprints from @arg other. */
+	void
+	add_fingerprints(const hash_map_fingerprints &other) noexcept
+	{
+		fingerprints().fetch_or(
+			other.fingerprints().load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+	}
+
+	/** Makes the set contain all fingerprints. */
+	void
+	fill_fingerprints() noexcept
+	{
+		fingerprints().store(full_set, std::memory_order_relaxed);
+	}
+
+	/** Makes the set empty, the bucket must not store any node. */
+	void
+	clear_fingerprints() noexcept
+	{
+		fingerprints().store(0, std::memory_order_relaxed);
+	}
+
+private:
+	static constexpr uint64_t full_set = ~uint64_t(0);
+
+	/**
+	 * @returns single bit fingerprint of @arg h. The low bits of h
+	 * select the bucket, so the bits of h are mixed first.
+	 */
+	static uint64_t
+	fingerprint(size_t h) noexcept
+	{
+		return uint64_t(1)
+			<< ((uint64_t(h) * 0x9E3779B97F4A7C15ULL) >> 58);
+	}
+
+	std::atomic<uint64_t> &
+	fingerprints() const noexcept
+	{
+		return my_set;
+	}
+
+	/* my_set rebuilt by initialize() on restart. */
+	mutable std::atomic<uint64_t> my_set;
+};
+
+/**
+ * Statistics counters of concurrent_hash_map. The primary template does not
+ * count anything and does not occupy any space as an empty base class.
+ */
+template <bool Enabled>
+class hash_map_statistics {
+public:
+	void
+	count_restart() const noexcept
+	{
+	}
+
+	void
+	count_backoff_pause() const noexcept
+	{
+	}
+
+	void
+	count_rehashed_bucket() const noexcept
+	{
+	}
+
+	/** Stores the values of the counters in @arg stats. */
+	void
+	load_counters(concurrent_hash_map_stats &stats) const noexcept
+	{
+		stats.restarts = 0;
+		stats.backoff_pauses = 0;
+		stats.rehashed_buckets = 0;
+	}
+};
+
+/**
+ * Volatile statistics counters, zeroed on restart. The counters are only
+ * incremented on the slow paths, so they are not sharded.
+ */
+template <>
+class hash_map_statistics<true> {
+public:
+	void
+	count_restart() const noexcept
+	{
+		counters().restarts.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void
+	count_backoff_pause() const noexcept
+	{
+		counters().backoff_pauses.fetch_add(1,
+						    std::memory_order_relaxed);
+	}
+
+	void
+	count_rehashed_bucket() const noexcept
+	{
+		counters().rehashed_buckets.fetch_add(
+			1, std::memory_order_relaxed);
+	}
+
+	/** Stores the values of the counters in @arg stats. */
+	void
+	load_counters(concurrent_hash_map_stats &stats) const noexcept
+	{
+		counters_type &c = counters();
+
+		stats.restarts = c.restarts.load(std::memory_order_relaxed);
+		stats.backoff_pauses =
+			c.backoff_pauses.load(std::memory_order_relaxed);
+		stats.rehashed_buckets =
+			c.rehashed_buckets.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct counters_type {
+		counters_type() noexcept
+		    : restarts(0), backoff_pauses(0), rehashed_buckets(0)
+		{
+		}
+
+		std::atomic<size_t> restarts;
+		std::atomic<size_t> backoff_pauses;
+		std::atomic<size_t> rehashed_buckets;
+	};
+
+	counters_type &
+	counters() const noexcept
+	{
+		return const_cast<v<counters_type> &>(my_counters).get();
+	}
+
+	/* my_counters always zeroed on restart. */
+	v<counters_type> my_counters;
+};
+
+/**
+ * Padding of a bucket. The primary template adds @arg Size bytes.
+ */
+template <size_t Size>
+struct hash_map_bucket_padding {
+	char padding[Size];
+};
+
+template <>
+struct hash_map_bucket_padding<0> {
+};
+
+/**
+ * Fields of a bucket. The fingerprints and sequence counter bases are empty
+ * unless the policies enable them, so they do not change the compact layout.
+ */
+template <bool Fingerprints, bool SeqLock>
+struct hash_map_bucket_base : public hash_map_fingerprints<Fingerprints>,
+			      public hash_map_seq<SeqLock> {
+#if LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
+	/** Mutex type for buckets. */
+	using mutex_t = pmem::obj::experimental::v<tbb::spin_rw_mutex>;
+
+	/** Scoped lock type for mutex. */
+	using scoped_t = tbb::spin_rw_mutex::scoped_lock;
+#else
+	/** Mutex type. */
+	using mutex_t = pmem::obj::shared_mutex;
+
+	/** Scoped lock type for mutex. */
+	using scoped_t = shared_mutex_scoped_lock;
+#endif
+
+	/** Bucket mutex. */
+	mutex_t mutex;
+
+	/** Atomic flag to indicate if bucket rehashed */
+	p<std::atomic<bool>> rehashed;
+
+	/** List of the nodes stored in the bucket. */
+	detail::persistent_pool_ptr<hash_map_node_base> node_list;
+
+	/** Pointer used to allocate new node. */
+	persistent_ptr<hash_map_node_base> tmp_node;
+
+	/** Default constructor */
+	hash_map_bucket_base() : node_list(empty_bucket), tmp_node(nullptr)
+	{
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		VALGRIND_HG_DISABLE_CHECKING(&rehashed, sizeof(rehashed));
+#endif
+		rehashed.get_rw() = false;
+	}
+
+	/**
+	 * @returns true if bucket rehashed and ready to use.
+	 * Otherwise, @returns false if rehash is
+	 * required
+	 */
+	bool
+	is_rehashed(std::memory_order order)
+	{
+		return rehashed.get_ro().load(order);
+	}
+
+	void
+	set_rehashed(std::memory_order order)
+	{
+		rehashed.get_rw().store(true, order);
+	}
+
+	/** Copy constructor is deleted */
+	hash_map_bucket_base(const hash_map_bucket_base &) = delete;
+
+	/** Assignment operator is deleted */
+	hash_map_bucket_base &operator=(const hash_map_bucket_base &) = delete;
+}; /* End of struct hash_map_bucket_base */
+
+/** Size of a cache line, buckets are padded to a multiple of it. */
+const size_t hash_map_cache_line_size = 64;
+
+/** @returns size of the padding of a bucket with fields of size @arg sz. */
+constexpr size_t
+hash_map_bucket_padding_size(bool padded, size_t sz)
+{
+	return padded ? (hash_map_cache_line_size -
+			 sz % hash_map_cache_line_size) %
+			hash_map_cache_line_size
+		      : 0;
+}
+
+/**
+ * Bucket of the layout defined by the @arg Layout policy, with a sequence
+ * counter if @arg SeqLock.
+ */
+template <typename Layout, bool SeqLock>
+struct hash_map_bucket
+    : public hash_map_bucket_base<Layout::fingerprints, SeqLock>,
+      public hash_map_bucket_padding<hash_map_bucket_padding_size(
+	      Layout::padded,
+	      sizeof(hash_map_bucket_base<Layout::fingerprints, SeqLock>))> {
+	/** True if blocks of buckets are aligned to the cache line size. */
+	static constexpr bool cache_aligned = Layout::padded;
+}; /* End of struct hash_map_bucket */
+
+/**
+ * Allocates a block of @arg n buckets in the current transaction.
+ *
+ * pmemobj aligns allocations to 16 bytes only, so a cache aligned block is
+ * allocated one cache line bigger and starts at the first cache line
+ * boundary past the beginning of the allocation. The distance between the
+ * two is stored in the 8 bytes preceding the block.
+ *
+ * @throw pmem::transaction_alloc_error on allocation failure.
+ */
+template <typename Bucket>
+persistent_ptr<Bucket[]>
+make_bucket_block(std::size_t n)
+{
+	if (!Bucket::cache_aligned)
+		return make_persistent<Bucket[]>(n);
+
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw transaction_scope_error(
+			"refusing to allocate memory outside of transaction scope");
+
+	PMEMoid oid =
+		pmemobj_tx_alloc(sizeof(Bucket) * n + hash_map_cache_line_size,
+				 detail::type_num<Bucket>());
+	if (OID_IS_NULL(oid))
+		throw transaction_alloc_error(
+			"failed to allocate persistent memory array");
+
+	char *base = static_cast<char *>(pmemobj_direct(oid));
+	uint64_t shift = hash_map_cache_line_size -
+		reinterpret_cast<uintptr_t>(base) % hash_map_cache_line_size;
+
+	assert(shift >= sizeof(uint64_t));
+	*reinterpret_cast<uint64_t *>(base + shift - sizeof(uint64_t)) = shift;
+
+	oid.off += shift;
+	Bucket *data = reinterpret_cast<Bucket *>(base + shift);
+
+	for (std::size_t i = 0; i < n; ++i)
+		detail::create<Bucket>(data + i);
+
+	return persistent_ptr<Bucket[]>(oid);
+}
+
+/**
+ * Allocates a block of @arg n buckets and stores its address in @arg ptr
+ * atomically, without a transaction. See make_bucket_block().
+ *
+ * @throw std::bad_alloc on allocation failure.
+ */
+template <typename Bucket>
+void
+make_bucket_block_atomic(pool_base &pop, persistent_ptr<Bucket[]> &ptr,
+			 std::size_t n)
+{
+	if (!Bucket::cache_aligned) {
+		make_persistent_atomic<Bucket[]>(pop, ptr, n);
+		return;
+	}
+
+	struct pobj_action act[3];
+	std::size_t size = sizeof(Bucket) * n + hash_map_cache_line_size;
+
+	PMEMoid oid = pmemobj_reserve(pop.handle(), &act[0], size,
+				      detail::type_num<Bucket>());
+	if (OID_IS_NULL(oid))
+		throw std::bad_alloc();
+
+	char *base = static_cast<char *>(pmemobj_direct(oid));
+	uint64_t shift = hash_map_cache_line_size -
+		reinterpret_cast<uintptr_t>(base) % hash_map_cache_line_size;
+
+	assert(shift >= sizeof(uint64_t));
+	*reinterpret_cast<uint64_t *>(base + shift - sizeof(uint64_t)) = shift;
+
+	Bucket *data = reinterpret_cast<Bucket *>(base + shift);
+
+	try {
+		for (std::size_t i = 0; i < n; ++i)
+			detail::create<Bucket>(data + i);
+	} catch (...) {
+		pmemobj_cancel(pop.handle(), act, 1);
+		throw;
+	}
+
+	pop.persist(base, size);
+
+	pmemobj_set_value(pop.handle(), &act[1], &ptr.raw_ptr()->pool_uuid_lo,
+			  oid.pool_uuid_lo);
+	pmemobj_set_value(pop.handle(), &act[2], &ptr.raw_ptr()->off,
+			  oid.off + shift);
+
+	if (pmemobj_publish(pop.handle(), act, 3) != 0) {
+		pmemobj_cancel(pop.handle(), act, 3);
+		throw std::bad_alloc();
+	}
+}
+
+/**
+ * Frees a block of @arg n buckets allocated by make_bucket_block() or
+ * make_bucket_block_atomic() in the current transaction.
+ *
+ * @throw pmem::transaction_free_error on failure.
+ */
+template <typename Bucket>
+void
+delete_bucket_block(persistent_ptr<Bucket[]> ptr, std::size_t n)
+{
+	if (!Bucket::cache_aligned) {
+		delete_persistent<Bucket[]>(ptr, n);
+		return;
+	}
+
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw transaction_scope_error(
+			"refusing to free memory outside of transaction scope");
+
+	if (ptr == nullptr)
+		return;
+
+	Bucket *data = ptr.get();
+
+	for (std::size_t i = n; i > 0; --i)
+		detail::destroy<Bucket>(data[i - 1]);
+
+	char *block = reinterpret_cast<char *>(data);
+	PMEMoid oid = ptr.raw();
+	oid.off -= *reinterpret_cast<uint64_t *>(block - sizeof(uint64_t));
+
+	if (pmemobj_tx_free(oid) != 0)
+		throw transaction_free_error(
+			"failed to delete persistent memory object");
+}
+
+using pmem::detail::static_log2;
+
+/**
+ * The class provides the way to access certain properties of segments
+ * used by hash map
+ */
+template <typename Bucket>
+class segment_traits {
+public:
+	/** segment index type */
+	using segment_index_t = size_t;
+	using size_type = size_t;
+	using bucket_type = Bucket;
+
+protected:
+	/** PMDK has limitation for allocation size. */
+	constexpr static size_type max_allocation_size = PMEMOBJ_MAX_ALLOC_SIZE;
+
+	/** First big block that has fixed size. */
+	constexpr static segment_index_t first_big_block =
+		static_log2(max_allocation_size / sizeof(bucket_type));
+
+	/** Max number of buckets per segment. */
+	constexpr static size_type big_block_size = size_type(1)
+		<< first_big_block;
+
+	/* Block size in bytes cannot exceed max_allocation_size */
+	static_assert((big_block_size * sizeof(bucket_type)) <
+			      max_allocation_size,
+		      "Block size exceeds max_allocation_size");
+
+	/** @returns index of the first block in the @arg seg. */
+	constexpr static segment_index_t
+	first_block_in_segment(segment_index_t seg)
+	{
+		return seg < first_big_block
+			? seg
+			: (first_big_block +
+			   (segment_index_t(1) << (seg - first_big_block)) - 1);
+	}
+
+	/** @returns number of blocks in the @arg seg. */
+	constexpr static size_type
+	blocks_in_segment(segment_index_t seg)
+	{
+		return seg < first_big_block
+			? segment_index_t(1)
+			: segment_index_t(1) << (seg - first_big_block);
+	}
+
+	/** @returns number of buckets in the @arg b. */
+	constexpr static size_type
+	block_size(segment_index_t b)
+	{
+		return b < first_big_block ? segment_size(b ? b : 1)
+					   : big_block_size;
+	}
+
+public:
+	/** Number of embedded segments*/
+	constexpr static segment_index_t embedded_segments = 1;
 
 	/** Count of buckets in the embedded segments */
 	constexpr static size_type embedded_buckets = 1 << embedded_segments;
@@ -789,7 +1778,7 @@ public:
 			if (my_seg == embedded_segments) {
 				size_type sz = segment_size(first_block) -
 					embedded_buckets;
-				delete_persistent<bucket_type[]>(
+				delete_bucket_block<bucket_type>(
 					(*my_table)[my_seg], sz);
 			}
 			(*my_table)[my_seg] = nullptr;
@@ -799,7 +1788,7 @@ public:
 			for (segment_index_t b = blocks.first;
 			     b < blocks.second; ++b) {
 				if ((*my_table)[b] != nullptr) {
-					delete_persistent<bucket_type[]>(
+					delete_bucket_block<bucket_type>(
 						(*my_table)[b], block_size(b));
 					(*my_table)[b] = nullptr;
 				}
@@ -858,7 +1847,7 @@ private:
 			size_type sz =
 				segment_size(first_block) - embedded_buckets;
 			(*my_table)[my_seg] =
-				make_persistent<bucket_type[]>(sz);
+				make_bucket_block<bucket_type>(sz);
 
 			persistent_ptr<bucket_type> base =
 				(*my_table)[embedded_segments].raw();
@@ -886,7 +1875,7 @@ private:
 #if LIBPMEMOBJ_CPP_CONCURRENT_HASH_MAP_USE_ATOMIC_ALLOCATOR
 		for (segment_index_t b = blocks.first; b < blocks.second; ++b) {
 			if ((*my_table)[b] == nullptr)
-				make_persistent_atomic<bucket_type[]>(
+				make_bucket_block_atomic<bucket_type>(
 					pop, (*my_table)[b], block_size(b));
 		}
 #else
@@ -896,7 +1885,7 @@ private:
 			for (segment_index_t b = blocks.first;
 			     b < blocks.second; ++b) {
 				assert((*my_table)[b] == nullptr);
-				(*my_table)[b] = make_persistent<bucket_type[]>(
+				(*my_table)[b] = make_bucket_block<bucket_type>(
 					block_size(b));
 			}
 
@@ -918,6 +1907,7 @@ private:
  * Base class of concurrent_hash_map.
  * Implements logic not dependant to Key/Value types.
  */
+template <typename BucketLayout, bool SeqLock>
 class hash_map_base {
 public:
 	/** Size type. */
@@ -936,66 +1926,7 @@ public:
 	using tmp_node_ptr_t = persistent_ptr<node_base>;
 
 	/** Bucket type. */
-	struct bucket {
-#if LIBPMEMOBJ_CPP_USE_TBB_RW_MUTEX
-		/** Mutex type for buckets. */
-		using mutex_t = pmem::obj::experimental::v<tbb::spin_rw_mutex>;
-
-		/** Scoped lock type for mutex. */
-		using scoped_t = tbb::spin_rw_mutex::scoped_lock;
-#else
-		/** Mutex type. */
-		using mutex_t = pmem::obj::shared_mutex;
-
-		/** Scoped lock type for mutex. */
-		using scoped_t = shared_mutex_scoped_lock;
-#endif
-
-		/** Bucket mutex. */
-		mutex_t mutex;
-
-		/** Atomic flag to indicate if bucket rehashed */
-		p<std::atomic<bool>> rehashed;
-
-		/** List of the nodes stored in the bucket. */
-		node_base_ptr_t node_list;
-
-		/** Pointer used to allocate new node. */
-		tmp_node_ptr_t tmp_node;
-
-		/** Default constructor */
-		bucket() : node_list(empty_bucket), tmp_node(nullptr)
-		{
-#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-			VALGRIND_HG_DISABLE_CHECKING(&rehashed,
-						     sizeof(rehashed));
-#endif
-			rehashed.get_rw() = false;
-		}
-
-		/**
-		 * @returns true if bucket rehashed and ready to use.
-		 * Otherwise, @returns false if rehash is
-		 * required
-		 */
-		bool
-		is_rehashed(std::memory_order order)
-		{
-			return rehashed.get_ro().load(order);
-		}
-
-		void
-		set_rehashed(std::memory_order order)
-		{
-			rehashed.get_rw().store(true, order);
-		}
-
-		/** Copy constructor is deleted */
-		bucket(const bucket &) = delete;
-
-		/** Assignment operator is deleted */
-		bucket &operator=(const bucket &) = delete;
-	}; /* End of struct bucket */
+	using bucket = hash_map_bucket<BucketLayout, SeqLock>;
 
 	/** Segment traits */
 	using segment_traits_t = segment_traits<bucket>;
@@ -1035,6 +1966,59 @@ public:
 	/** Type of my_mask field */
 	using mask_type = v<atomic_wrapper<hashcode_t, calculate_mask>>;
 
+	class initial_rehash_cursor {
+	public:
+		hashcode_t
+		operator()(const hash_map_base *) const
+		{
+			/* embedded buckets are always rehashed */
+			return embedded_buckets;
+		}
+	}; /* class initial_rehash_cursor */
+
+	/** Type of my_rehash_cursor field */
+	using rehash_cursor_type =
+		v<atomic_wrapper<hashcode_t, initial_rehash_cursor>>;
+
+	/** Number of shards of the element counter. */
+	static const size_type size_shards = 16;
+
+	/**
+	 * Shard of the element counter. A shard's value alone is meaningless
+	 * (it can wrap around below zero), only the sum of all shards is the
+	 * number of elements. Tables with a single counter are rejected by
+	 * layout_magic.
+	 *
+	 * pmemobj allocations are aligned to 16 bytes only, so the shards are
+	 * not aligned to cache lines. They are padded to the cache line size
+	 * instead, which still puts every shard in a different cache line, so
+	 * that threads do not contend on increments and flushes.
+	 */
+	struct size_shard {
+		p<std::atomic<size_type>> value;
+		char padding[64 - sizeof(p<std::atomic<size_type>>)];
+	};
+
+	/**
+	 * Identifies tables which store my_layout_features, the ones with
+	 * the sharded element counter. Tables created before have no such
+	 * field, they store the element counter at the offset of the magic.
+	 * The counter can never reach this value, which is how the layouts
+	 * are told apart.
+	 */
+	static constexpr uint64_t layout_magic = 0x43484d4c41590001ULL;
+
+	/**
+	 * Layout features of the persistent data. Features in compat can be
+	 * ignored by code which does not know them, features in incompat can
+	 * not.
+	 */
+	struct layout_features_t {
+		p<uint64_t> magic;
+		p<uint32_t> compat;
+		p<uint32_t> incompat;
+	};
+
 	/** ID of persistent memory pool where hash map resides. */
 	p<uint64_t> my_pool_uuid;
 
@@ -1048,10 +2032,18 @@ public:
 	 */
 	blocks_table_t my_table;
 
+	/**
+	 * Layout features of the table, set on construction. The fields
+	 * above are the same in all layouts and the magic is placed where
+	 * the older layout has the element counter, so check_incompat_features
+	 * never reads beyond the end of an older table.
+	 */
+	layout_features_t my_layout_features;
+
 	/* It must be in separate cache line from my_mask due to performance
 	 * effects */
-	/** Size of container in stored items. */
-	p<std::atomic<size_type>> my_size;
+	/** Size of container in stored items, sharded by threads. */
+	size_shard my_size[size_shards];
 
 	/** Zero segment. */
 	bucket my_embedded_segment[embedded_buckets];
@@ -1062,6 +2054,10 @@ public:
 	/** Segment mutex used to enable new segment. */
 	segment_enable_mutex_t my_segment_enable_mutex;
 
+	/** Next bucket to be checked by rehash_step(). */
+	/* my_rehash_cursor always restored on restart. */
+	rehash_cursor_type my_rehash_cursor;
+
 	/** @return true if @arg ptr is valid pointer. */
 	static bool
 	is_valid(void *ptr)
@@ -1095,6 +2091,12 @@ public:
 		return my_mask.get(this);
 	}
 
+	std::atomic<hashcode_t> &
+	rehash_cursor() noexcept
+	{
+		return my_rehash_cursor.get(this);
+	}
+
 	/** Const segment facade type */
 	using const_segment_facade_t =
 		segment_facade_impl<blocks_table_t, segment_traits_t, true>;
@@ -1103,25 +2105,36 @@ public:
 	using segment_facade_t =
 		segment_facade_impl<blocks_table_t, segment_traits_t, false>;
 
-	/** Default constructor */
-	hash_map_base()
+	/**
+	 * Default constructor
+	 * @param[in] incompat_features layout features which the code
+	 * opening the table has to support.
+	 */
+	explicit hash_map_base(uint32_t incompat_features = 0)
 	{
 		static_assert(
 			sizeof(size_type) == sizeof(std::atomic<size_type>),
 			"std::atomic should have the same layout as underlying integral type");
+		static_assert(sizeof(size_shard) == 64,
+			      "size_shard should be as big as a cache line");
 
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 		VALGRIND_HG_DISABLE_CHECKING(&my_size, sizeof(my_size));
 		VALGRIND_HG_DISABLE_CHECKING(&my_mask, sizeof(my_mask));
 #endif
 
-		my_size.get_rw() = 0;
+		for (size_type i = 0; i < size_shards; ++i)
+			my_size[i].value.get_rw() = 0;
 		PMEMoid oid = pmemobj_oid(this);
 
 		assert(!OID_IS_NULL(oid));
 
 		my_pool_uuid = oid.pool_uuid_lo;
 
+		my_layout_features.magic.get_rw() = layout_magic;
+		my_layout_features.compat.get_rw() = 0;
+		my_layout_features.incompat.get_rw() = incompat_features;
+
 		pool_base pop = get_pool_base();
 		/* enable embedded segments */
 		for (size_type i = 0; i < segment_traits_t::embedded_segments;
@@ -1136,6 +2149,27 @@ public:
 		assert(mask() == embedded_buckets - 1);
 	}
 
+	/**
+	 * Check if the table was created with the same incompat layout
+	 * features as the ones the opening code uses. The magic is checked
+	 * first, the rest of the fields of an older table is not read.
+	 * @throw pmem::layout_error if the table has an older layout or the
+	 * features differ.
+	 */
+	void
+	check_incompat_features(uint32_t incompat_features) const
+	{
+		if (my_layout_features.magic.get_ro() != layout_magic)
+			throw pmem::layout_error(
+				"Incompatible table layout, the table was "
+				"created by an older version");
+
+		if (my_layout_features.incompat.get_ro() != incompat_features)
+			throw pmem::layout_error(
+				"Incompat layout features mismatch, the table "
+				"was created with different policies");
+	}
+
 	/**
 	 * Re-calculate mask value on each process restart.
 	 */
@@ -1158,12 +2192,56 @@ public:
 		return m;
 	}
 
+	/**
+	 * Sum the element counter shards.
+	 * @returns number of items in the container.
+	 */
+	size_type
+	size() const
+	{
+		int64_t sz = 0;
+
+		/*
+		 * The shards are read one by one, so the decrement for an
+		 * erased element may be seen without the increment for its
+		 * insertion, which was done in another shard. The sum is
+		 * negative then and must not wrap around.
+		 */
+		for (size_type i = 0; i < size_shards; ++i)
+			sz += static_cast<int64_t>(
+				my_size[i].value.get_ro().load(
+					std::memory_order_relaxed));
+
+		return sz > 0 ? static_cast<size_type>(sz) : 0;
+	}
+
+	/**
+	 * @returns element counter shard assigned to the calling thread.
+	 */
+	p<std::atomic<size_type>> &
+	my_size_shard()
+	{
+		static std::atomic<size_type> next_shard(0);
+		static thread_local size_type shard =
+			next_shard.fetch_add(1, std::memory_order_relaxed) %
+			size_shards;
+
+		return my_size[shard].value;
+	}
+
 	void
 	restore_size(size_type actual_size)
 	{
-		my_size.get_rw().store(actual_size, std::memory_order_relaxed);
 		pool_base pop = get_pool_base();
-		pop.persist(my_size);
+
+		for (size_type i = 0; i < size_shards; ++i) {
+			my_size[i].value.get_rw().store(
+				i == 0 ? actual_size : 0,
+				std::memory_order_relaxed);
+			pop.flush(my_size[i].value);
+		}
+
+		pop.drain();
 	}
 
 	/**
@@ -1202,6 +2280,9 @@ public:
 		assert(is_valid(b->tmp_node));
 		assert(b->tmp_node->next == b->node_list);
 
+		typename bucket::seq_counter_type::scoped_write seq_guard(
+			b->seq());
+
 		b->node_list = b->tmp_node; /* bucket is locked */
 		pop.persist(&(b->node_list), sizeof(b->node_list));
 	}
@@ -1326,6 +2407,8 @@ public:
 
 		if (is_valid(b->tmp_node)) {
 			if (b->tmp_node->next == b->node_list) {
+				/* hash code of the node is not known here */
+				b->fill_fingerprints();
 				insert_new_node(pop, b);
 			} else {
 				b->tmp_node.raw_ptr()->off = 0;
@@ -1337,23 +2420,19 @@ public:
 
 	/**
 	 * Insert a node.
-	 * @return new size.
 	 */
-	size_type
+	void
 	insert_new_node(pool_base &pop, bucket *b)
 	{
 		add_to_bucket(b, pop);
 
-		/* prefix form is to enforce allocation after the first item
-		 * inserted */
-		size_t sz = ++(my_size.get_rw());
-		pop.persist(&my_size, sizeof(my_size));
+		p<std::atomic<size_type>> &shard = my_size_shard();
+		++(shard.get_rw());
+		pop.persist(shard);
 
 		b->tmp_node.raw_ptr()->off = 0;
 		pop.persist(&(b->tmp_node.raw().off),
 			    sizeof(b->tmp_node.raw().off));
-
-		return sz;
 	}
 
 	/**
@@ -1399,7 +2478,7 @@ public:
 
 		--buckets;
 
-		bool is_initial = (my_size.get_ro() == 0);
+		bool is_initial = (size() == 0);
 
 		for (size_type m = mask(); buckets > m; m = mask())
 			enable_segment(
@@ -1423,16 +2502,32 @@ public:
 			this->mask() = table.mask().exchange(
 				this->mask(), std::memory_order_relaxed);
 
+			/* both tables have to be scanned from the beginning */
+			this->rehash_cursor().store(embedded_buckets,
+						    std::memory_order_relaxed);
+			table.rehash_cursor().store(embedded_buckets,
+						    std::memory_order_relaxed);
+
 			/* Swap my_size */
-			this->my_size.get_rw() =
-				table.my_size.get_rw().exchange(
-					this->my_size.get_ro(),
-					std::memory_order_relaxed);
+			for (size_type i = 0; i < size_shards; ++i) {
+				auto &shard = table.my_size[i].value.get_rw();
+
+				this->my_size[i].value.get_rw() =
+					shard.exchange(
+						this->my_size[i].value.get_ro(),
+						std::memory_order_relaxed);
+			}
 
-			for (size_type i = 0; i < embedded_buckets; ++i)
+			for (size_type i = 0; i < embedded_buckets; ++i) {
 				this->my_embedded_segment[i].node_list.swap(
 					table.my_embedded_segment[i].node_list);
 
+				this->my_embedded_segment[i]
+					.fill_fingerprints();
+				table.my_embedded_segment[i]
+					.fill_fingerprints();
+			}
+
 			for (size_type i = segment_traits_t::embedded_segments;
 			     i < block_table_size; ++i)
 				this->my_table[i].swap(table.my_table[i]);
@@ -1492,9 +2587,14 @@ public:
 
 	friend class hash_map_iterator<map_type, true>;
 
+	template <typename Iterator>
+	friend class hash_map_range;
+
 #if !defined(_MSC_VER) || defined(__INTEL_COMPILER)
 private:
-	template <typename Key, typename T, typename HashCompare>
+	template <typename Key, typename T, typename HashCompare,
+		  typename BucketLayout, typename NodeAllocation,
+		  typename Statistics, typename GrowthPolicy, typename Lookup>
 	friend class experimental::concurrent_hash_map;
 #else
 public: /* workaround */
@@ -1508,7 +2608,7 @@ public: /* workaround */
 			my_node = static_cast<node *>(
 				my_bucket->node_list.get(my_map->my_pool_uuid));
 
-			if (!hash_map_base::is_valid(my_node)) {
+			if (!map_type::is_valid(my_node)) {
 				advance_to_next_bucket();
 			}
 		}
@@ -1543,7 +2643,7 @@ public:
 	/** Indirection (dereference). */
 	reference operator*() const
 	{
-		assert(hash_map_base::is_valid(my_node));
+		assert(map_type::is_valid(my_node));
 		return my_node->item;
 	}
 
@@ -1617,7 +2717,7 @@ private:
 			bucket_accessor acc(my_map, k);
 			my_bucket = acc.get();
 
-			if (hash_map_base::is_valid(my_bucket->node_list)) {
+			if (map_type::is_valid(my_bucket->node_list)) {
 				my_node = static_cast<node *>(
 					my_bucket->node_list.get(
 						my_map->my_pool_uuid));
@@ -1652,22 +2752,162 @@ operator!=(const hash_map_iterator<Container, M> &i,
 	return i.my_node != j.my_node || i.my_map != j.my_map;
 }
 
+/**
+ * Range of buckets of concurrent_hash_map which can be split into disjoint
+ * subranges and processed in parallel. Meets requirements of the TBB Range
+ * concept, so it can be passed e.g. to tbb::parallel_for; the splitting
+ * constructor accepts any tag type, including tbb::split.
+ * Iterating over the range is not thread safe with modifications of the
+ * table.
+ */
+template <typename Iterator>
+class hash_map_range {
+public:
+	using iterator = Iterator;
+	using value_type = typename iterator::value_type;
+	using reference = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type = size_t;
+	using map_ptr = typename iterator::map_ptr;
+
+	/**
+	 * Construct range of buckets [first, last) of the map.
+	 */
+	hash_map_range(map_ptr map, size_type first, size_type last,
+		       size_type grainsize = 1)
+	    : my_map(map),
+	      my_first(first),
+	      my_last(last),
+	      my_grainsize(grainsize > 0 ? grainsize : 1)
+	{
+		assert(first <= last);
+
+		set_iterators();
+	}
+
+	/**
+	 * Splitting constructor. Moves the second half of the buckets of
+	 * @arg r to the new range.
+	 */
+	template <typename Split>
+	hash_map_range(hash_map_range &r, Split)
+	    : my_map(r.my_map),
+	      my_first(r.my_first + (r.my_last - r.my_first) / 2),
+	      my_last(r.my_last),
+	      my_grainsize(r.my_grainsize)
+	{
+		assert(r.is_divisible());
+
+		r.my_last = my_first;
+		r.set_iterators();
+		set_iterators();
+	}
+
+	/** @returns true if the range does not contain any items. */
+	bool
+	empty() const
+	{
+		return my_begin == my_end;
+	}
+
+	/** @returns true if the range can be split. */
+	bool
+	is_divisible() const
+	{
+		return my_last - my_first > my_grainsize;
+	}
+
+	/** @returns an iterator to the first item in the range. */
+	const iterator &
+	begin() const
+	{
+		return my_begin;
+	}
+
+	/** @returns an iterator past the last item in the range. */
+	const iterator &
+	end() const
+	{
+		return my_end;
+	}
+
+	/** @returns minimal number of buckets in a divisible range. */
+	size_type
+	grainsize() const
+	{
+		return my_grainsize;
+	}
+
+private:
+	void
+	set_iterators()
+	{
+		/* the end iterator points to the first item of the next
+		 * range, if any */
+		my_begin = iterator(my_map, my_first);
+		my_end = iterator(my_map, my_last);
+	}
+
+	map_ptr my_map;
+
+	/** Bucket range [my_first, my_last). */
+	size_type my_first;
+	size_type my_last;
+
+	size_type my_grainsize;
+
+	iterator my_begin;
+	iterator my_end;
+};
+
 } /* namespace internal */
 /** @endcond */
 
 /**
  * Persistent memory aware implementation of Intel TBB concurrent_hash_map.
+ *
+ * The layout of the persistent data depends on the HashCompare (see
+ * hash_compare), BucketLayout, Statistics and Lookup policies, which are
+ * recorded in the table as incompat layout features. initialize() throws
+ * pmem::layout_error if a table is opened with policies which imply different
+ * features.
+ *
+ * Tables created by versions which did not record the layout features have
+ * a single element counter where newer tables store the layout magic, so
+ * initialize() recognizes them from the data of the older table itself and
+ * throws pmem::layout_error as well. Such tables cannot be converted in
+ * place, the newer header does not fit in the older object; their elements
+ * have to be copied to a new table with the version which created them.
  */
-template <typename Key, typename T, typename HashCompare>
-class concurrent_hash_map : protected internal::hash_map_base {
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+class concurrent_hash_map
+    : protected internal::hash_map_base<BucketLayout, Lookup::optimistic>,
+      protected internal::hash_map_statistics<Statistics::enabled> {
 	template <typename Container, bool is_const>
 	friend class internal::hash_map_iterator;
 
+	using base_type =
+		internal::hash_map_base<BucketLayout, Lookup::optimistic>;
+
+	using statistics_type =
+		internal::hash_map_statistics<Statistics::enabled>;
+
+	static_assert(
+		!std::is_same<NodeAllocation,
+			      atomic_node_allocation>::value ||
+			(internal::is_atomically_constructible<Key>::value &&
+			 internal::is_atomically_constructible<T>::value),
+		"atomic_node_allocation requires Key and T whose construction "
+		"does not need a transaction, use "
+		"transactional_node_allocation");
+
 public:
 	using key_type = Key;
 	using mapped_type = T;
 	using value_type = std::pair<const Key, T>;
-	using size_type = hash_map_base::size_type;
+	using size_type = typename base_type::size_type;
 	using difference_type = ptrdiff_t;
 	using pointer = value_type *;
 	using const_pointer = const value_type *;
@@ -1677,53 +2917,132 @@ public:
 		internal::hash_map_iterator<concurrent_hash_map, false>;
 	using const_iterator =
 		internal::hash_map_iterator<concurrent_hash_map, true>;
+	using range_type = internal::hash_map_range<iterator>;
+	using const_range_type = internal::hash_map_range<const_iterator>;
 
 protected:
+	using typename base_type::bucket;
+	using typename base_type::hashcode_t;
+	using typename base_type::node_base;
+	using typename base_type::node_base_ptr_t;
+	using typename base_type::segment_facade_t;
+	using typename base_type::segment_index_t;
+	using typename base_type::segment_traits_t;
+	using typename base_type::tmp_node_ptr_t;
+
+	using base_type::block_table_size;
+	using base_type::check_incompat_features;
+	using base_type::correct_bucket;
+	using base_type::embedded_buckets;
+	using base_type::first_block;
+	using base_type::get_bucket;
+	using base_type::get_pool_base;
+	using base_type::insert_new_node;
+	using base_type::internal_swap;
+	using base_type::is_valid;
+	using base_type::mask;
+	using base_type::my_pool_uuid;
+	using base_type::my_size;
+	using base_type::my_size_shard;
+	using base_type::my_table;
+	using base_type::rehash_cursor;
+	using base_type::restore_size;
+	using base_type::size_shards;
+	using statistics_type::count_backoff_pause;
+	using statistics_type::count_rehashed_bucket;
+	using statistics_type::count_restart;
+
 	friend class const_accessor;
 	struct node;
 	HashCompare my_hash_compare;
 
+	/** True if nodes store the hash code of the key. */
+	using hash_code_cached = internal::has_cache_hash_code<HashCompare>;
+
+	/** Node hash code storage type. */
+	using node_hash = internal::hash_map_node_hash<hash_code_cached::value>;
+
+	/** Incompat layout features implied by the policies. */
+	static constexpr uint32_t layout_incompat_features =
+		internal::hash_map_feature_if(
+			hash_code_cached::value,
+			internal::FEATURE_CACHED_HASH_CODE) |
+		internal::hash_map_feature_if(Statistics::enabled,
+					      internal::FEATURE_STATISTICS) |
+		internal::hash_map_feature_if(
+			BucketLayout::padded,
+			internal::FEATURE_PADDED_BUCKETS) |
+		internal::hash_map_feature_if(
+			BucketLayout::fingerprints,
+			internal::FEATURE_BUCKET_FINGERPRINTS) |
+		internal::hash_map_feature_if(Lookup::optimistic,
+					      internal::FEATURE_SEQ_LOCK);
+
+	/** Sequence counter storage type of a node. */
+	using node_seq = internal::hash_map_seq<Lookup::optimistic>;
+
 	/**
 	 * Node structure to store Key/Value pair.
 	 */
-	struct node : public node_base {
+	struct node : public node_base, public node_hash, public node_seq {
 		value_type item;
-		node(const Key &key, const node_base_ptr_t &_next = OID_NULL)
-		    : node_base(_next), item(key, T())
+		node(hashcode_t h, const Key &key,
+		     const node_base_ptr_t &_next = OID_NULL)
+		    : node_base(_next), node_hash(h), item(key, T())
 		{
 		}
 
-		node(const Key &key, const T &t,
+		node(hashcode_t h, const Key &key, const T &t,
 		     const node_base_ptr_t &_next = OID_NULL)
-		    : node_base(_next), item(key, t)
+		    : node_base(_next), node_hash(h), item(key, t)
 		{
 		}
 
-		node(const Key &key, T &&t, node_base_ptr_t &&_next = OID_NULL)
-		    : node_base(std::move(_next)), item(key, std::move(t))
+		node(hashcode_t h, const Key &key, T &&t,
+		     node_base_ptr_t &&_next = OID_NULL)
+		    : node_base(std::move(_next)),
+		      node_hash(h),
+		      item(key, std::move(t))
 		{
 		}
 
-		node(value_type &&i, node_base_ptr_t &&_next = OID_NULL)
-		    : node_base(std::move(_next)), item(std::move(i))
+		node(hashcode_t h, value_type &&i,
+		     node_base_ptr_t &&_next = OID_NULL)
+		    : node_base(std::move(_next)),
+		      node_hash(h),
+		      item(std::move(i))
 		{
 		}
 
-		node(value_type &&i, const node_base_ptr_t &_next = OID_NULL)
-		    : node_base(_next), item(std::move(i))
+		node(hashcode_t h, value_type &&i,
+		     const node_base_ptr_t &_next = OID_NULL)
+		    : node_base(_next), node_hash(h), item(std::move(i))
 		{
 		}
 
 		template <typename... Args>
-		node(Args &&... args, node_base_ptr_t &&_next = OID_NULL)
+		node(hashcode_t h, Args &&... args,
+		     node_base_ptr_t &&_next = OID_NULL)
 		    : node_base(std::forward<node_base_ptr_t>(_next)),
+		      node_hash(h),
 		      item(std::forward<Args>(args)...)
 		{
 		}
 
-		node(const value_type &i,
+		node(hashcode_t h, const value_type &i,
+		     const node_base_ptr_t &_next = OID_NULL)
+		    : node_base(_next), node_hash(h), item(i)
+		{
+		}
+
+		template <typename... KeyArgs, typename... MappedArgs>
+		node(hashcode_t h, std::piecewise_construct_t pc,
+		     std::tuple<KeyArgs...> key_args,
+		     std::tuple<MappedArgs...> mapped_args,
 		     const node_base_ptr_t &_next = OID_NULL)
-		    : node_base(_next), item(i)
+		    : node_base(_next),
+		      node_hash(h),
+		      item(pc, std::move(key_args), std::move(mapped_args))
 		{
 		}
 	};
@@ -1741,57 +3060,91 @@ protected:
 	static void
 	allocate_node_copy_construct(pool_base &pop,
 				     persistent_ptr<node> &node_ptr,
-				     const void *param,
+				     hashcode_t h, const void *param,
 				     const node_base_ptr_t &next = OID_NULL)
 	{
 		const value_type *v = static_cast<const value_type *>(param);
-		internal::make_persistent_object<node>(pop, node_ptr, *v, next);
+		internal::make_persistent_object<node>(NodeAllocation(), pop,
+						       node_ptr, h, *v, next);
 	}
 
 	static void
 	allocate_node_move_construct(pool_base &pop,
 				     persistent_ptr<node> &node_ptr,
-				     const void *param,
+				     hashcode_t h, const void *param,
 				     const node_base_ptr_t &next = OID_NULL)
 	{
 		const value_type *v = static_cast<const value_type *>(param);
 		internal::make_persistent_object<node>(
-			pop, node_ptr, std::move(*const_cast<value_type *>(v)),
-			next);
+			NodeAllocation(), pop, node_ptr, h,
+			std::move(*const_cast<value_type *>(v)), next);
 	}
 
 	static void
 	allocate_node_default_construct(pool_base &pop,
 					persistent_ptr<node> &node_ptr,
-					const void *param,
+					hashcode_t h, const void *param,
 					const node_base_ptr_t &next = OID_NULL)
 	{
 		const Key &key = *static_cast<const Key *>(param);
-		internal::make_persistent_object<node>(pop, node_ptr, key,
-						       next);
+		internal::make_persistent_object<node>(NodeAllocation(), pop,
+						       node_ptr, h, key, next);
+	}
+
+	/**
+	 * Constructs the node from @arg param, which points to a pair of
+	 * tuples of references to the key and the mapped value constructor
+	 * arguments, see try_emplace().
+	 */
+	template <typename ArgsTuple>
+	static void
+	allocate_node_piecewise_construct(
+		pool_base &pop, persistent_ptr<node> &node_ptr, hashcode_t h,
+		const void *param, const node_base_ptr_t &next = OID_NULL)
+	{
+		ArgsTuple &args = *const_cast<ArgsTuple *>(
+			static_cast<const ArgsTuple *>(param));
+		internal::make_persistent_object<node>(
+			NodeAllocation(), pop, node_ptr, h,
+			std::piecewise_construct, std::move(args.first),
+			std::move(args.second), next);
 	}
 
 	static void
-	do_not_allocate_node(pool_base &, persistent_ptr<node> &node_ptr,
-			     const void *,
-			     const node_base_ptr_t &next = OID_NULL)
+	do_not_allocate_node(pool_base &, persistent_ptr<node> &, hashcode_t,
+			     const void *, const node_base_ptr_t & = OID_NULL)
 	{
 		assert(false);
 	}
 
+	/**
+	 * @returns true if node @arg n holds @arg key, whose hash code is
+	 * @arg h. Keys are compared only if the hash codes may be equal.
+	 */
+	template <typename K>
+	bool
+	node_has_key(const node *n, const K &key, hashcode_t h) const
+	{
+		return n->may_have_hash_code(h) &&
+			my_hash_compare.equal(key, n->item.first);
+	}
+
+	template <typename K>
 	persistent_node_ptr_t
-	search_bucket(const key_type &key, bucket *b) const
+	search_bucket(const K &key, hashcode_t h, bucket *b) const
 	{
 		assert(b->is_rehashed(std::memory_order_relaxed));
 		assert(!is_valid(b->tmp_node));
 
+		if (!b->may_contain(h))
+			return nullptr;
+
 		persistent_node_ptr_t n =
 			detail::static_persistent_pool_pointer_cast<node>(
 				b->node_list);
 
 		while (is_valid(n) &&
-		       !my_hash_compare.equal(
-			       key, n.get(my_pool_uuid)->item.first)) {
+		       !node_has_key(n.get(my_pool_uuid), key, h)) {
 			n = detail::static_persistent_pool_pointer_cast<node>(
 				n.get(my_pool_uuid)->next);
 		}
@@ -1825,7 +3178,7 @@ protected:
 
 			if (my_b->is_rehashed(std::memory_order_acquire) ==
 				    false &&
-			    try_acquire(my_b->mutex, /*write=*/true)) {
+			    this->try_acquire(my_b->mutex, /*write=*/true)) {
 				if (my_b->is_rehashed(
 					    std::memory_order_relaxed) ==
 				    false) {
@@ -1895,7 +3248,7 @@ protected:
 		 */
 		inline void
 		acquire(concurrent_hash_map *base, const hashcode_t h,
-			bool writer = false)
+			bool = false)
 		{
 			my_b = base->get_bucket(h);
 
@@ -1957,10 +3310,42 @@ protected:
 	hashcode_t
 	get_hash_code(node_base_ptr_t &n)
 	{
-		return my_hash_compare.hash(
-			detail::static_persistent_pool_pointer_cast<node>(n)(
-				my_pool_uuid)
-				->item.first);
+		node *np = detail::static_persistent_pool_pointer_cast<node>(n)(
+			my_pool_uuid);
+		hashcode_t h;
+
+		if (np->cached_hash_code(h))
+			return h;
+
+		return my_hash_compare.hash(np->item.first);
+	}
+
+	/**
+	 * Grow the table if @arg sz elements exceed the maximum load factor
+	 * of the growth policy for mask @arg m, see
+	 * hash_map_base::check_growth().
+	 */
+	bool
+	check_growth(hashcode_t m, size_type sz)
+	{
+		return base_type::check_growth(m,
+					       GrowthPolicy::buckets_for(sz));
+	}
+
+	/**
+	 * Check for a concurrent growth of the table, see
+	 * hash_map_base::check_mask_race(). The caller restarts the
+	 * operation if it returns true, which is counted in the statistics.
+	 */
+	bool
+	check_mask_race(hashcode_t h, hashcode_t &m) const
+	{
+		if (!base_type::check_mask_race(h, m))
+			return false;
+
+		count_restart();
+
+		return true;
 	}
 
 	template <bool serial>
@@ -2020,13 +3405,20 @@ protected:
 					restore_after_crash = false;
 				}
 
-				/* Add to new b_new */
-				*p_new = n;
-				pop.persist(p_new, sizeof(*p_new));
+				{
+					typename bucket::seq_counter_type::
+						scoped_write seq_guard(
+							b_old->seq());
 
-				/* exclude from b_old */
-				*p_old = n(my_pool_uuid)->next;
-				pop.persist(p_old, sizeof(*p_old));
+					/* Add to new b_new */
+					b_new->add_fingerprint(c);
+					*p_new = n;
+					pop.persist(p_new, sizeof(*p_new));
+
+					/* exclude from b_old */
+					*p_old = n(my_pool_uuid)->next;
+					pop.persist(p_old, sizeof(*p_old));
+				}
 
 				p_new = &(n(my_pool_uuid)->next);
 			} else {
@@ -2047,6 +3439,8 @@ protected:
 		/* mark rehashed */
 		b_new->set_rehashed(std::memory_order_release);
 		pop.persist(b_new->rehashed);
+
+		count_rehashed_bucket();
 	}
 
 	struct call_clear_on_leave {
@@ -2076,7 +3470,10 @@ public:
 	 */
 	class const_accessor
 	    : private node::scoped_t /*which derived from no_copy*/ {
-		friend class concurrent_hash_map<Key, T, HashCompare>;
+		friend class concurrent_hash_map<Key, T, HashCompare,
+						  BucketLayout, NodeAllocation,
+						  Statistics, GrowthPolicy,
+						  Lookup>;
 		friend class accessor;
 		using node_ptr_t = pmem::obj::persistent_ptr<node>;
 
@@ -2104,6 +3501,8 @@ public:
 		release()
 		{
 			if (my_node) {
+				if (is_writer())
+					my_node->seq().write_end();
 				node::scoped_t::release();
 				my_node = 0;
 			}
@@ -2139,6 +3538,9 @@ public:
 		 */
 		~const_accessor()
 		{
+			if (my_node && is_writer())
+				my_node->seq().write_end();
+
 			my_node = OID_NULL; // scoped lock's release() is called
 					    // in its destructor
 		}
@@ -2179,10 +3581,28 @@ public:
 		}
 	};
 
+	/**
+	 * Summary of the work done by initialize().
+	 */
+	struct recovery_stats {
+		/** Number of items found in the container. */
+		size_type size;
+
+		/** Number of buckets which were visited. */
+		size_type buckets;
+
+		/** Number of threads which visited the buckets. */
+		size_type threads;
+
+		/** Wall-clock duration of the recovery. */
+		std::chrono::nanoseconds duration;
+	};
+
 	/**
 	 * Construct empty table.
 	 */
-	concurrent_hash_map() : internal::hash_map_base()
+	concurrent_hash_map()
+	    : base_type(layout_incompat_features)
 	{
 	}
 
@@ -2190,16 +3610,17 @@ public:
 	 * Construct empty table with n preallocated buckets. This number
 	 * serves also as initial concurrency level.
 	 */
-	concurrent_hash_map(size_type n) : internal::hash_map_base()
+	concurrent_hash_map(size_type n)
+	    : base_type(layout_incompat_features)
 	{
-		reserve(n);
+		base_type::reserve(n);
 	}
 
 	/**
 	 * Copy constructor
 	 */
 	concurrent_hash_map(const concurrent_hash_map &table)
-	    : internal::hash_map_base()
+	    : base_type(layout_incompat_features)
 	{
 		reserve(table.size());
 
@@ -2210,7 +3631,7 @@ public:
 	 * Move constructor
 	 */
 	concurrent_hash_map(concurrent_hash_map &&table)
-	    : internal::hash_map_base()
+	    : base_type(layout_incompat_features)
 	{
 		swap(table);
 	}
@@ -2220,6 +3641,7 @@ public:
 	 */
 	template <typename I>
 	concurrent_hash_map(I first, I last)
+	    : base_type(layout_incompat_features)
 	{
 		reserve(static_cast<size_type>(std::distance(first, last)));
 
@@ -2230,6 +3652,7 @@ public:
 	 * Construct table with initializer list
 	 */
 	concurrent_hash_map(std::initializer_list<value_type> il)
+	    : base_type(layout_incompat_features)
 	{
 		reserve(il.size());
 
@@ -2240,20 +3663,63 @@ public:
 	 * Intialize persistent concurrent hash map after process restart.
 	 * Should be called everytime after process restart.
 	 * Not thread safe.
+	 *
+	 * After a crash all buckets are visited to correct them and to count
+	 * the items. The buckets are split into contiguous ranges which are
+	 * processed by @arg concurrency threads (the calling thread is one
+	 * of them).
+	 *
+	 * @param[in] graceful_shutdown true if the pool was closed cleanly,
+	 * in which case the nodes are not visited.
+	 * @param[in] concurrency number of threads used to visit the
+	 * buckets, 0 is treated as 1.
+	 *
+	 * @returns summary of the recovery.
+	 *
+	 * @throw pmem::layout_error if the table was created with policies
+	 * which change the layout differently, or by a version which did not
+	 * record the layout features.
+	 * @throw std::system_error if a worker thread cannot be started.
 	 */
-	void
-	initialize(bool graceful_shutdown = false)
+	recovery_stats
+	initialize(bool graceful_shutdown = false, size_type concurrency = 1)
 	{
+		auto start = std::chrono::steady_clock::now();
+
+		this->check_incompat_features(layout_incompat_features);
+
+		recovery_stats stats;
+		stats.buckets = 0;
+		stats.threads = 0;
+
 		if (!graceful_shutdown) {
-			auto actual_size =
-				std::distance(this->begin(), this->end());
-			assert(actual_size >= 0);
-			this->restore_size(size_type(actual_size));
+			stats.buckets = this->mask() + 1;
+			stats.threads = concurrency == 0
+				? 1
+				: (std::min)(concurrency, stats.buckets);
+
+			size_type actual_size =
+				internal_count(stats.buckets, stats.threads);
+			this->restore_size(actual_size);
 		} else {
 			assert(this->size() ==
 			       size_type(std::distance(this->begin(),
 						       this->end())));
+
+			/* fingerprints are not valid after restart */
+			if (BucketLayout::fingerprints) {
+				hashcode_t m = this->mask();
+				for (hashcode_t h = 0; h <= m; ++h)
+					get_bucket(h)->fill_fingerprints();
+			}
 		}
+
+		stats.size = this->size();
+		stats.duration = std::chrono::duration_cast<
+			std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start);
+
+		return stats;
 	}
 
 	/**
@@ -2290,12 +3756,64 @@ public:
 	}
 
 	/**
-	 * Rehashes and optionally resizes the whole table.
-	 * Useful to optimize performance before or after concurrent
-	 * operations.
-	 * Not thread safe.
+	 * Rehashes and optionally resizes the whole table.
+	 * Useful to optimize performance before or after concurrent
+	 * operations.
+	 * Not thread safe.
+	 */
+	void rehash(size_type n = 0);
+
+	/**
+	 * Prepares enough buckets for @arg n elements, so that the table
+	 * does not grow until it holds more than @arg n elements. The
+	 * number of buckets follows the maximum load factor of the growth
+	 * policy. The table never shrinks by this call.
+	 * Not thread safe.
+	 */
+	void
+	reserve(size_type n)
+	{
+		base_type::reserve(GrowthPolicy::buckets_for(n));
+	}
+
+	/**
+	 * Rehashes up to @arg n buckets of the segments enabled by the
+	 * table growth, so that lookup() rarely has to do it on demand.
+	 * Intended to be called periodically, e.g. from an idle loop or
+	 * a background thread. Buckets are visited in order of their
+	 * indices, each call continues where the previous one stopped.
+	 * Thread safe.
+	 *
+	 * @returns number of buckets which were pending rehash. A value
+	 * smaller than @arg n means that no more buckets are pending.
+	 */
+	size_type rehash_step(size_type n = 1);
+
+	/**
+	 * Releases the trailing bucket segments which are not needed for
+	 * the current number of elements. Nodes stored in the released
+	 * segments are moved to the buckets they map to under the reduced
+	 * mask. Every segment is released in a separate transaction, so
+	 * the table stays consistent if the operation is interrupted.
+	 * Iterators are invalidated. Not thread safe.
+	 *
+	 * @throws std::runtime_error in case of PMDK transaction failure
 	 */
-	void rehash(size_type n = 0);
+	void shrink_to_fit();
+
+	/**
+	 * Returns a snapshot of the statistics of the table. The operation
+	 * counters are collected only if the Statistics policy of the
+	 * table is collect_statistics, they are zero otherwise. The chain
+	 * length histogram and the occupancy of the segments are computed
+	 * by this call, visiting every bucket under its read lock. Buckets
+	 * which are not rehashed yet are counted as empty.
+	 * Can be called concurrently with the thread safe operations. Must
+	 * not be called concurrently with initialize(), the assignment
+	 * operators, rehash(), reserve(), swap(), shrink_to_fit(), clear()
+	 * and clear(size_type, size_type).
+	 */
+	concurrent_hash_map_stats stats() const;
 
 	/**
 	 * Clear hash map content
@@ -2304,6 +3822,28 @@ public:
 	 */
 	void clear();
 
+	/**
+	 * Clear hash map content using @arg concurrency threads. The
+	 * buckets are split between the threads and every thread frees
+	 * the nodes of its buckets in transactions of up to
+	 * @arg batch_size nodes. The segments are released at the end.
+	 * Unlike clear(), the operation is not atomic. If it is
+	 * interrupted, the table keeps the nodes which were not freed yet,
+	 * and initialize() has to be called with graceful_shutdown false.
+	 * It is intended for tearing down big tables, before
+	 * delete_persistent() is called for the table. Not thread safe.
+	 *
+	 * @param[in] concurrency number of threads, 0 is treated as 1.
+	 * @param[in] batch_size maximum number of nodes freed in one
+	 * transaction, 0 is treated as 1.
+	 *
+	 * @throws pmem::transaction_scope_error if called inside a
+	 * transaction, which the worker threads could not join.
+	 * @throws std::runtime_error in case of PMDK transaction failure
+	 * @throw std::system_error if a worker thread cannot be started.
+	 */
+	void clear(size_type concurrency, size_type batch_size = 1024);
+
 	/**
 	 * Clear table and destroy it.
 	 */
@@ -2356,13 +3896,67 @@ public:
 		return const_iterator(this, mask() + 1);
 	}
 
+	/**
+	 * @returns a range of all buckets, which can be split into
+	 * subranges of at least @arg grainsize buckets.
+	 * Not thread safe.
+	 */
+	range_type
+	range(size_type grainsize = 1)
+	{
+		return range_type(this, 0, mask() + 1, grainsize);
+	}
+
+	/**
+	 * @returns a range of all buckets, which can be split into
+	 * subranges of at least @arg grainsize buckets.
+	 * Not thread safe.
+	 */
+	const_range_type
+	range(size_type grainsize = 1) const
+	{
+		return const_range_type(this, 0, mask() + 1, grainsize);
+	}
+
+	/**
+	 * Splits the buckets into @arg concurrency disjoint ranges and
+	 * calls f(range_type &) for each of them in a separate thread. The
+	 * calling thread processes the first range. The first exception
+	 * thrown by @arg f is rethrown after all the threads finish.
+	 * Not thread safe with modifications of the table.
+	 *
+	 * @throw std::system_error if a thread cannot be started.
+	 */
+	template <typename F>
+	void
+	parallel_for(size_type concurrency, F f)
+	{
+		internal_parallel_for<range_type>(this, concurrency, f);
+	}
+
+	/**
+	 * Splits the buckets into @arg concurrency disjoint ranges and
+	 * calls f(const_range_type &) for each of them in a separate thread.
+	 * The calling thread processes the first range. The first exception
+	 * thrown by @arg f is rethrown after all the threads finish.
+	 * Not thread safe with modifications of the table.
+	 *
+	 * @throw std::system_error if a thread cannot be started.
+	 */
+	template <typename F>
+	void
+	parallel_for(size_type concurrency, F f) const
+	{
+		internal_parallel_for<const_range_type>(this, concurrency, f);
+	}
+
 	/**
 	 * @returns number of items in table.
 	 */
 	size_type
 	size() const
 	{
-		return my_size.get_ro();
+		return base_type::size();
 	}
 
 	/**
@@ -2371,7 +3965,7 @@ public:
 	bool
 	empty() const
 	{
-		return my_size.get_ro() == 0;
+		return size() == 0;
 	}
 
 	/**
@@ -2392,6 +3986,25 @@ public:
 		return mask() + 1;
 	}
 
+	/**
+	 * @returns the average number of elements per bucket.
+	 */
+	float
+	load_factor() const
+	{
+		return float(size()) / float(bucket_count());
+	}
+
+	/**
+	 * @returns the load factor above which the table grows, set by the
+	 * GrowthPolicy template parameter.
+	 */
+	static constexpr float
+	max_load_factor()
+	{
+		return GrowthPolicy::max_load_factor();
+	}
+
 	/**
 	 * Swap two instances. Iterators are invalidated. Not thread safe.
 	 */
@@ -2431,141 +4044,440 @@ public:
 	 * @return true if item is found, false otherwise.
 	 */
 	bool
-	find(accessor &result, const Key &key)
+	find(accessor &result, const Key &key)
+	{
+		result.release();
+
+		return lookup(/*insert*/ false, key, nullptr, &result,
+			      /*write*/ true, &do_not_allocate_node);
+	}
+
+	/**
+	 * @return count of items (0 or 1)
+	 *
+	 * This overload only participates in overload resolution if
+	 * HashCompare defines is_transparent. It allows using a key of
+	 * any type K without constructing an instance of Key.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  internal::has_is_transparent<HashCompare>::value,
+			  K>::type>
+	size_type
+	count(const K &key) const
+	{
+		return const_cast<concurrent_hash_map *>(this)->lookup(
+			/*insert*/ false, key, nullptr, nullptr,
+			/*write=*/false, &do_not_allocate_node);
+	}
+
+	/**
+	 * Find item and acquire a read lock on the item.
+	 * @return true if item is found, false otherwise.
+	 *
+	 * This overload only participates in overload resolution if
+	 * HashCompare defines is_transparent. It allows using a key of
+	 * any type K without constructing an instance of Key.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  internal::has_is_transparent<HashCompare>::value,
+			  K>::type>
+	bool
+	find(const_accessor &result, const K &key) const
+	{
+		result.release();
+
+		return const_cast<concurrent_hash_map *>(this)->lookup(
+			/*insert*/ false, key, nullptr, &result,
+			/*write=*/false, &do_not_allocate_node);
+	}
+
+	/**
+	 * Find item and acquire a write lock on the item.
+	 * @return true if item is found, false otherwise.
+	 *
+	 * This overload only participates in overload resolution if
+	 * HashCompare defines is_transparent. It allows using a key of
+	 * any type K without constructing an instance of Key.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  internal::has_is_transparent<HashCompare>::value,
+			  K>::type>
+	bool
+	find(accessor &result, const K &key)
+	{
+		result.release();
+
+		return lookup(/*insert*/ false, key, nullptr, &result,
+			      /*write*/ true, &do_not_allocate_node);
+	}
+
+	/**
+	 * Find item and copy its mapped value to @arg value. With the
+	 * optimistic_lookup policy no lock on the bucket or the item is
+	 * acquired; the read is validated with per-bucket and per-item
+	 * sequence counters and retried if it raced with a modification.
+	 * Falls back to find(const_accessor &, const Key &) if the bucket
+	 * has to be rehashed or the retries are not successful. With the
+	 * locked_lookup policy it always uses find(const_accessor &,
+	 * const Key &).
+	 *
+	 * Key comparison and the copy of the mapped value may observe an
+	 * item which is concurrently modified or erased; such results are
+	 * discarded, but Key and T must not dereference pointers stored in
+	 * them when compared or copied (e.g. p<int> is fine, string is not).
+	 *
+	 * @return true if item is found, false otherwise.
+	 */
+	bool
+	find_optimistic(const Key &key, T &value) const
+	{
+		return internal_find_optimistic(key, value);
+	}
+
+	/**
+	 * Find item and copy its mapped value to @arg value, see
+	 * find_optimistic(const Key &, T &).
+	 * @return true if item is found, false otherwise.
+	 *
+	 * This overload only participates in overload resolution if
+	 * HashCompare defines is_transparent. It allows using a key of
+	 * any type K without constructing an instance of Key.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  internal::has_is_transparent<HashCompare>::value,
+			  K>::type>
+	bool
+	find_optimistic(const K &key, T &value) const
+	{
+		return internal_find_optimistic(key, value);
+	}
+
+	/**
+	 * Insert item (if not already present) and
+	 * acquire a read lock on the item.
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(const_accessor &result, const Key &key)
+	{
+		result.release();
+
+		return lookup(/*insert*/ true, key, &key, &result,
+			      /*write=*/false,
+			      &allocate_node_default_construct);
+	}
+
+	/**
+	 * Insert item (if not already present) and
+	 * acquire a write lock on the item.
+	 * @returns true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(accessor &result, const Key &key)
+	{
+		result.release();
+
+		return lookup(/*insert*/ true, key, &key, &result,
+			      /*write=*/true, &allocate_node_default_construct);
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already and
+	 * acquire a read lock on the item.
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(const_accessor &result, const value_type &value)
+	{
+		result.release();
+
+		return lookup(/*insert*/ true, value.first, &value, &result,
+			      /*write=*/false, &allocate_node_copy_construct);
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already and
+	 * acquire a write lock on the item.
+	 * @return true if item is new.
+	 */
+	bool
+	insert(accessor &result, const value_type &value)
+	{
+		result.release();
+
+		return lookup(/*insert*/ true, value.first, &value, &result,
+			      /*write=*/true, &allocate_node_copy_construct);
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already
+	 * @return true if item is inserted.
+	 */
+	bool
+	insert(const value_type &value)
+	{
+		return lookup(/*insert*/ true, value.first, &value, nullptr,
+			      /*write=*/false, &allocate_node_copy_construct);
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already and
+	 * acquire a read lock on the item.
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(const_accessor &result, value_type &&value)
+	{
+		return generic_move_insert(result, std::move(value));
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already and
+	 * acquire a write lock on the item.
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(accessor &result, value_type &&value)
+	{
+		return generic_move_insert(result, std::move(value));
+	}
+
+	/**
+	 * Insert item by copying if there is no such key present already
+	 * @return true if item is inserted.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	bool
+	insert(value_type &&value)
+	{
+		return generic_move_insert(accessor_not_used(),
+					   std::move(value));
+	}
+
+	/**
+	 * Insert range [first, last)
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	template <typename I>
+	void
+	insert(I first, I last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	/**
+	 * Insert range [first, last) in batches. Items of a batch are
+	 * grouped by bucket and inserted in a single transaction, and the
+	 * element counter is updated once per batch. Items with keys which
+	 * are already present in the table are skipped.
+	 * Buckets used by a batch stay locked until it is committed.
+	 *
+	 * @param[in] first iterator to the first item, must be a forward
+	 * iterator.
+	 * @param[in] last iterator past the last item.
+	 * @param[in] batch_size maximum number of items inserted in one
+	 * transaction, 0 is treated as 1.
+	 *
+	 * @returns number of inserted items.
+	 *
+	 * @throw std::bad_alloc on allocation failure.
+	 * @throw std::runtime_error in case of PMDK transaction failure.
+	 */
+	template <typename I>
+	size_type insert_bulk(I first, I last, size_type batch_size = 128);
+
+	/**
+	 * Insert initializer list
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	void
+	insert(std::initializer_list<value_type> il)
+	{
+		insert(il.begin(), il.end());
+	}
+
+	/**
+	 * Construct item from @arg args if there is no such key present
+	 * already and acquire a read lock on the item. The item is first
+	 * constructed in volatile memory, because its key has to be known
+	 * to find the bucket, and then moved into the new node.
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
+	 */
+	template <typename... Args>
+	bool
+	emplace(const_accessor &result, Args &&... args)
 	{
-		result.release();
-
-		return lookup(/*insert*/ false, key, nullptr, &result,
-			      /*write*/ true, &do_not_allocate_node);
+		return generic_move_insert(
+			result, value_type(std::forward<Args>(args)...));
 	}
 
 	/**
-	 * Insert item (if not already present) and
-	 * acquire a read lock on the item.
+	 * Construct item from @arg args if there is no such key present
+	 * already and acquire a write lock on the item, see
+	 * emplace(const_accessor &, Args &&...).
 	 * @return true if item is new.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(const_accessor &result, const Key &key)
+	emplace(accessor &result, Args &&... args)
 	{
-		result.release();
-
-		return lookup(/*insert*/ true, key, &key, &result,
-			      /*write=*/false,
-			      &allocate_node_default_construct);
+		return generic_move_insert(
+			result, value_type(std::forward<Args>(args)...));
 	}
 
 	/**
-	 * Insert item (if not already present) and
-	 * acquire a write lock on the item.
-	 * @returns true if item is new.
+	 * Construct item from @arg args if there is no such key present
+	 * already, see emplace(const_accessor &, Args &&...).
+	 * @return true if item is inserted.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(accessor &result, const Key &key)
+	emplace(Args &&... args)
 	{
-		result.release();
-
-		return lookup(/*insert*/ true, key, &key, &result,
-			      /*write=*/true, &allocate_node_default_construct);
+		return generic_move_insert(
+			accessor_not_used(),
+			value_type(std::forward<Args>(args)...));
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already and
-	 * acquire a read lock on the item.
+	 * Insert item with @arg key if there is no such key present already
+	 * and acquire a read lock on the item. The mapped value is
+	 * constructed from @arg args directly in the new node, nothing is
+	 * constructed if the key is present.
 	 * @return true if item is new.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(const_accessor &result, const value_type &value)
+	try_emplace(const_accessor &result, const Key &key, Args &&... args)
 	{
-		result.release();
-
-		return lookup(/*insert*/ true, value.first, &value, &result,
-			      /*write=*/false, &allocate_node_copy_construct);
+		return generic_try_emplace(result, key,
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already and
-	 * acquire a write lock on the item.
+	 * Insert item with @arg key if there is no such key present already
+	 * and acquire a read lock on the item, see
+	 * try_emplace(const_accessor &, const Key &, Args &&...). The key
+	 * is moved into the new node.
 	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(accessor &result, const value_type &value)
+	try_emplace(const_accessor &result, Key &&key, Args &&... args)
 	{
-		result.release();
-
-		return lookup(/*insert*/ true, value.first, &value, &result,
-			      /*write=*/true, &allocate_node_copy_construct);
+		return generic_try_emplace(result, std::move(key),
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already
-	 * @return true if item is inserted.
+	 * Insert item with @arg key if there is no such key present already
+	 * and acquire a write lock on the item, see
+	 * try_emplace(const_accessor &, const Key &, Args &&...).
+	 * @return true if item is new.
+	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(const value_type &value)
+	try_emplace(accessor &result, const Key &key, Args &&... args)
 	{
-		return lookup(/*insert*/ true, value.first, &value, nullptr,
-			      /*write=*/false, &allocate_node_copy_construct);
+		return generic_try_emplace(result, key,
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already and
-	 * acquire a read lock on the item.
+	 * Insert item with @arg key if there is no such key present already
+	 * and acquire a write lock on the item, see
+	 * try_emplace(const_accessor &, const Key &, Args &&...). The key
+	 * is moved into the new node.
 	 * @return true if item is new.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(const_accessor &result, value_type &&value)
+	try_emplace(accessor &result, Key &&key, Args &&... args)
 	{
-		return generic_move_insert(result, std::move(value));
+		return generic_try_emplace(result, std::move(key),
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already and
-	 * acquire a write lock on the item.
-	 * @return true if item is new.
+	 * Insert item with @arg key if there is no such key present
+	 * already, see try_emplace(const_accessor &, const Key &, Args
+	 * &&...).
+	 * @return true if item is inserted.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(accessor &result, value_type &&value)
+	try_emplace(const Key &key, Args &&... args)
 	{
-		return generic_move_insert(result, std::move(value));
+		return generic_try_emplace(accessor_not_used(), key,
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert item by copying if there is no such key present already
+	 * Insert item with @arg key if there is no such key present
+	 * already, see try_emplace(const_accessor &, const Key &, Args
+	 * &&...). The key is moved into the new node.
 	 * @return true if item is inserted.
 	 * @throw std::bad_alloc on allocation failure.
 	 */
+	template <typename... Args>
 	bool
-	insert(value_type &&value)
+	try_emplace(Key &&key, Args &&... args)
 	{
-		return generic_move_insert(accessor_not_used(),
-					   std::move(value));
+		return generic_try_emplace(accessor_not_used(), std::move(key),
+					   std::forward<Args>(args)...);
 	}
 
 	/**
-	 * Insert range [first, last)
+	 * Insert item with @arg key and mapped value constructed from
+	 * @arg obj if there is no such key present already, or assign
+	 * @arg obj to the mapped value of the existing item otherwise.
+	 * The table is searched once. The assignment is done in a single
+	 * transaction while the write lock on the item is held.
+	 * @return true if item is inserted, false if it was assigned.
 	 * @throw std::bad_alloc on allocation failure.
+	 * @throw pmem::transaction_error in case of PMDK transaction failure.
 	 */
-	template <typename I>
-	void
-	insert(I first, I last)
+	template <typename M>
+	bool
+	insert_or_assign(const Key &key, M &&obj)
 	{
-		for (; first != last; ++first)
-			insert(*first);
+		return generic_insert_or_assign(key, std::forward<M>(obj));
 	}
 
 	/**
-	 * Insert initializer list
+	 * Insert item with @arg key and mapped value constructed from
+	 * @arg obj if there is no such key present already, or assign
+	 * @arg obj to the mapped value of the existing item otherwise, see
+	 * insert_or_assign(const Key &, M &&). The key is moved into the
+	 * new node.
+	 * @return true if item is inserted, false if it was assigned.
 	 * @throw std::bad_alloc on allocation failure.
+	 * @throw pmem::transaction_error in case of PMDK transaction failure.
 	 */
-	void
-	insert(std::initializer_list<value_type> il)
+	template <typename M>
+	bool
+	insert_or_assign(Key &&key, M &&obj)
 	{
-		insert(il.begin(), il.end());
+		return generic_insert_or_assign(std::move(key),
+						std::forward<M>(obj));
 	}
 
 	/**
@@ -2573,16 +4485,59 @@ public:
 	 * @return true if element was deleted by this call
 	 * @throws std::runtime_error in case of PMDK unable to free the memory
 	 */
-	bool erase(const Key &key);
+	bool
+	erase(const Key &key)
+	{
+		return internal_erase(key);
+	}
+
+	/**
+	 * Remove element with corresponding key
+	 * @return true if element was deleted by this call
+	 * @throws std::runtime_error in case of PMDK unable to free the memory
+	 *
+	 * This overload only participates in overload resolution if
+	 * HashCompare defines is_transparent. It allows using a key of
+	 * any type K without constructing an instance of Key.
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  internal::has_is_transparent<HashCompare>::value,
+			  K>::type>
+	bool
+	erase(const K &key)
+	{
+		return internal_erase(key);
+	}
+
+	/**
+	 * Remove element held by @arg item_accessor. The hash code and the
+	 * node stored in the accessor are reused, so the key is neither
+	 * hashed nor compared again. The accessor is released by this call.
+	 * @return true if element was deleted by this call, false if the
+	 * accessor is empty.
+	 * @throws std::runtime_error in case of PMDK unable to free the memory
+	 * @throws std::invalid_argument if the accessor holds an item of
+	 * another map, the accessor is not released in that case.
+	 */
+	bool
+	erase(accessor &item_accessor)
+	{
+		if (item_accessor.empty())
+			return false;
+
+		return internal_erase_node(item_accessor);
+	}
 
 protected:
 	/**
 	 * Insert or find item and optionally acquire a lock on the item.
 	 */
-	bool lookup(bool op_insert, const Key &key, const void *param,
+	template <typename K>
+	bool lookup(bool op_insert, const K &key, const void *param,
 		    const_accessor *result, bool write,
 		    void (*allocate_node)(pool_base &, persistent_ptr<node> &,
-					  const void *,
+					  hashcode_t, const void *,
 					  const node_base_ptr_t &));
 
 	struct accessor_not_used {
@@ -2633,8 +4588,81 @@ protected:
 			      &allocate_node_move_construct);
 	}
 
+	template <typename Accessor, typename K, typename... Args>
+	bool
+	generic_try_emplace(Accessor &&result, K &&key, Args &&... args)
+	{
+		using args_type =
+			std::pair<std::tuple<K &&>, std::tuple<Args &&...>>;
+
+		args_type node_args(
+			std::forward_as_tuple(std::forward<K>(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...));
+
+		result.release();
+		return lookup(/*insert*/ true, static_cast<const Key &>(key),
+			      &node_args, accessor_location(result),
+			      is_write_access_needed(result),
+			      &allocate_node_piecewise_construct<args_type>);
+	}
+
+	template <typename K, typename M>
+	bool
+	generic_insert_or_assign(K &&key, M &&obj)
+	{
+		accessor result;
+
+		/* obj is only bound to the arguments tuple, it is not
+		 * consumed unless the item is inserted */
+		if (generic_try_emplace(result, std::forward<K>(key),
+					std::forward<M>(obj)))
+			return true;
+
+		pool_base pop = get_pool_base();
+
+		{
+			transaction::manual tx(pop);
+
+			result->second = std::forward<M>(obj);
+
+			transaction::commit();
+		}
+
+		return false;
+	}
+
+	/** Result of the optimistic bucket search. */
+	enum class optimistic_result { found, not_found, conflict };
+
+	template <typename K>
+	optimistic_result optimistic_search_bucket(const K &key, hashcode_t h,
+						   bucket *b, T &value) const;
+
+	template <typename K>
+	bool internal_find_optimistic(const K &key, T &value) const;
+
+	template <typename K>
+	bool internal_erase(const K &key);
+
+	bool internal_erase_node(accessor &item_accessor);
+
 	void clear_segment(segment_index_t s);
 
+	void clear_buckets(hashcode_t first, hashcode_t last, size_type batch);
+
+	void merge_segment(segment_index_t s, hashcode_t m);
+
+	template <typename I>
+	size_type insert_batch(std::vector<std::pair<hashcode_t, I>> &batch);
+
+	template <typename Range, typename MapPtr, typename F>
+	static void internal_parallel_for(MapPtr map, size_type concurrency,
+					  F &f);
+
+	size_type count_buckets(hashcode_t first, hashcode_t last);
+
+	size_type internal_count(size_type n_buckets, size_type concurrency);
+
 	/**
 	 * Copy "source" to *this, where *this must start out empty.
 	 */
@@ -2645,13 +4673,17 @@ protected:
 
 }; // class concurrent_hash_map
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename K>
 bool
-concurrent_hash_map<Key, T, HashCompare>::lookup(
-	bool op_insert, const Key &key, const void *param,
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::lookup(
+	bool op_insert, const K &key, const void *param,
 	const_accessor *result, bool write,
-	void (*allocate_node)(pool_base &, persistent_ptr<node> &, const void *,
-			      const node_base_ptr_t &))
+	void (*allocate_node)(pool_base &, persistent_ptr<node> &, hashcode_t,
+			      const void *, const node_base_ptr_t &))
 {
 	assert(!result || !result->my_node);
 
@@ -2662,7 +4694,7 @@ concurrent_hash_map<Key, T, HashCompare>::lookup(
 	ANNOTATE_HAPPENS_AFTER(&my_mask);
 #endif
 	persistent_node_ptr_t n;
-	size_type sz = 0;
+	bool grow = false;
 
 restart : { /* lock scope */
 	assert((m & (m + 1)) == 0);
@@ -2673,7 +4705,7 @@ restart : { /* lock scope */
 	bucket_accessor b(this, h & m);
 
 	/* find a node */
-	n = search_bucket(key, b.get());
+	n = search_bucket(key, h, b.get());
 
 	if (op_insert) {
 		/* [opt] insert a key */
@@ -2681,7 +4713,7 @@ restart : { /* lock scope */
 			if (!b.is_writer() && !b.upgrade_to_writer()) {
 				/* Rerun search_list, in case another thread
 				 * inserted the item during the upgrade. */
-				n = search_bucket(key, b.get());
+				n = search_bucket(key, h, b.get());
 				if (is_valid(n)) {
 					/* unfortunately, it did */
 					b.downgrade_to_reader();
@@ -2700,10 +4732,19 @@ restart : { /* lock scope */
 			allocate_node(pop,
 				      reinterpret_cast<persistent_ptr<node> &>(
 					      b->tmp_node),
-				      param, b->node_list);
+				      h, param, b->node_list);
+
+			/* summing the element counter shards on every insert
+			 * would be costly, so growth is checked only when the
+			 * new node collides with existing ones, unless the
+			 * load factor is below 1, which could be exceeded
+			 * without any collision */
+			grow = is_valid(b->node_list) ||
+				GrowthPolicy::max_load_factor() < 1;
 
 			n = b->tmp_node;
-			sz = insert_new_node(pop, b.get());
+			b->add_fingerprint(h);
+			insert_new_node(pop, b.get());
 			return_value = true;
 		}
 	} else { /* find or count */
@@ -2726,6 +4767,8 @@ exists:
 						write))
 				break;
 
+			count_backoff_pause();
+
 			if (!backoff.bounded_pause()) {
 				/* the wait takes really long, restart the
 				 * operation */
@@ -2737,6 +4780,8 @@ exists:
 
 				m = mask().load(std::memory_order_acquire);
 
+				count_restart();
+
 				goto restart;
 			}
 		}
@@ -2745,72 +4790,261 @@ exists:
 
 	result->my_node = n.get_persistent_ptr(my_pool_uuid);
 	result->my_hash = h;
+
+	if (write)
+		result->my_node->seq().write_begin();
 check_growth:
 	/* [opt] grow the container */
-	check_growth(m, sz);
+	if (grow)
+		check_growth(m, size());
 
 	return return_value;
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename K>
+bool
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::
+	internal_find_optimistic(const K &key, T &value) const
+{
+	hashcode_t const h = my_hash_compare.hash(key);
+	hashcode_t m = mask().load(std::memory_order_acquire);
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+	ANNOTATE_HAPPENS_AFTER(&my_mask);
+#endif
+
+	/* without sequence counters the reads cannot be validated */
+	for (internal::atomic_backoff backoff; Lookup::optimistic;) {
+		bucket *b = get_bucket(h & m);
+
+		/* not rehashed bucket requires the lock to be rehashed */
+		if (!b->is_rehashed(std::memory_order_acquire))
+			break;
+
+		optimistic_result res =
+			optimistic_search_bucket(key, h, b, value);
+
+		if (res == optimistic_result::found)
+			return true;
+
+		if (res == optimistic_result::not_found) {
+			/* not found, but mask could be changed */
+			if (!check_mask_race(h, m))
+				return false;
+		} else {
+			count_backoff_pause();
+
+			/* the item is modified for too long, wait on lock */
+			if (!backoff.bounded_pause())
+				break;
+		}
+	}
+
+	const_accessor acc;
+
+	if (!find(acc, key))
+		return false;
+
+	value = acc->second;
+
+	return true;
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename K>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::optimistic_result
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::
+	optimistic_search_bucket(const K &key, hashcode_t h, bucket *b,
+				 T &value) const
+{
+	uint64_t b_seq = b->seq().read_begin();
+	node_base_ptr_t n = b->node_list;
+
+	if (!b->may_contain(h))
+		return b->seq().read_retry(b_seq) ? optimistic_result::conflict
+						: optimistic_result::not_found;
+
+	/* every pointer is validated before it is dereferenced, because
+	 * erased nodes are freed immediately */
+	while (!b->seq().read_retry(b_seq)) {
+		if (!is_valid(n))
+			return optimistic_result::not_found;
+
+		node *np = static_cast<node *>(n.get(my_pool_uuid));
+
+		if (node_has_key(np, key, h)) {
+			uint64_t n_seq = np->seq().read_begin();
+
+			value = np->item.second;
+
+			if (np->seq().read_retry(n_seq) ||
+			    b->seq().read_retry(b_seq))
+				return optimistic_result::conflict;
+
+			return optimistic_result::found;
+		}
+
+		n = np->next;
+	}
+
+	return optimistic_result::conflict;
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename K>
+bool
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::internal_erase(
+	const K &key)
+{
+	node_base_ptr_t n;
+	hashcode_t const h = my_hash_compare.hash(key);
+	hashcode_t m = mask().load(std::memory_order_acquire);
+	pool_base pop = get_pool_base();
+
+restart : {
+	/* lock scope */
+	/* get bucket */
+	bucket_accessor b(this, h & m);
+
+search:
+	node_base_ptr_t *p = &b->node_list;
+	n = *p;
+
+	while (is_valid(n) &&
+	       !node_has_key(detail::static_persistent_pool_pointer_cast<node>(
+				     n)(my_pool_uuid),
+			     key, h)) {
+		p = &n(my_pool_uuid)->next;
+		n = *p;
+	}
+
+	if (!n) {
+		/* not found, but mask could be changed */
+		if (check_mask_race(h, m))
+			goto restart;
+
+		return false;
+	} else if (!b.is_writer() && !b.upgrade_to_writer()) {
+		if (check_mask_race(h, m)) /* contended upgrade, check mask */
+			goto restart;
+
+		goto search;
+	}
+
+	{
+		/* We cannot remove this element immediately because
+		 * other threads might work with this element via
+		 * accessors. The item_locker required to wait while
+		 * other threads use the node. The wait is bounded, because
+		 * an owner of the accessor may wait for this bucket in
+		 * erase(accessor &). */
+		typename node::scoped_t item_locker;
+
+		for (internal::atomic_backoff backoff(true);
+		     !item_locker.try_acquire(n(my_pool_uuid)->mutex,
+					      /*write=*/true);) {
+			count_backoff_pause();
+
+			if (!backoff.bounded_pause()) {
+				b.release();
+
+				std::this_thread::yield();
+
+				m = mask().load(std::memory_order_acquire);
+
+				count_restart();
+
+				goto restart;
+			}
+		}
+	}
+
+	try {
+		typename bucket::seq_counter_type::scoped_write seq_guard(
+			b->seq());
+		transaction::manual tx(pop);
+
+		tmp_node_ptr_t del = n(my_pool_uuid);
+
+		*p = del->next;
+
+		/* Only one thread can delete it due to write lock on the bucket
+		 */
+		delete_node(del);
+
+		transaction::commit();
+	} catch (const pmem::transaction_free_error &e) {
+		throw std::runtime_error(e);
+	}
+
+	auto &shard = this->my_size_shard();
+	--(shard.get_rw());
+	pop.persist(shard);
+}
+
+	return true;
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 bool
-concurrent_hash_map<Key, T, HashCompare>::erase(const Key &key)
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::
+	internal_erase_node(accessor &item_accessor)
 {
-	node_base_ptr_t n;
-	hashcode_t const h = my_hash_compare.hash(key);
+	node_base_ptr_t const n = item_accessor.my_node;
+	hashcode_t const h = item_accessor.my_hash;
 	hashcode_t m = mask().load(std::memory_order_acquire);
 	pool_base pop = get_pool_base();
 
 restart : {
 	/* lock scope */
-	/* get bucket */
-	bucket_accessor b(this, h & m);
+	/* get bucket, the write lock on the node is held while waiting for
+	 * it, which is safe because no thread blocks on a node lock while
+	 * holding a bucket lock */
+	bucket_accessor b(this, h & m, /*writer=*/true);
 
-search:
 	node_base_ptr_t *p = &b->node_list;
-	n = *p;
 
-	while (is_valid(n) &&
-	       !my_hash_compare.equal(
-		       key,
-		       detail::static_persistent_pool_pointer_cast<node>(n)(
-			       my_pool_uuid)
-			       ->item.first)) {
-		p = &n(my_pool_uuid)->next;
-		n = *p;
-	}
+	while (is_valid(*p) && *p != n)
+		p = &(*p)(my_pool_uuid)->next;
 
-	if (!n) {
-		/* not found, but mask could be changed */
+	if (!is_valid(*p)) {
+		/* the node cannot be erased by other threads while the
+		 * accessor is held, so it was moved by a concurrent rehash */
 		if (check_mask_race(h, m))
 			goto restart;
 
-		return false;
-	} else if (!b.is_writer() && !b.upgrade_to_writer()) {
-		if (check_mask_race(h, m)) /* contended upgrade, check mask */
-			goto restart;
-
-		goto search;
+		/* the node is in none of the buckets of this map */
+		throw std::invalid_argument(
+			"accessor does not hold an item of this map");
 	}
 
 	try {
+		typename bucket::seq_counter_type::scoped_write seq_guard(
+			b->seq());
 		transaction::manual tx(pop);
 
 		tmp_node_ptr_t del = n(my_pool_uuid);
 
 		*p = del->next;
 
-		{
-			/* We cannot remove this element immediately because
-			 * other threads might work with this element via
-			 * accessors. The item_locker required to wait while
-			 * other threads use the node. */
-			typename node::scoped_t item_locker(del->mutex,
-							    /*write=*/true);
-		}
+		/* No other thread can acquire the node lock after the node
+		 * is excluded from the bucket */
+		item_accessor.release();
 
-		/* Only one thread can delete it due to write lock on the bucket
-		 */
 		delete_node(del);
 
 		transaction::commit();
@@ -2818,27 +5052,35 @@ search:
 		throw std::runtime_error(e);
 	}
 
-	--(my_size.get_rw());
-	pop.persist(my_size);
+	auto &shard = this->my_size_shard();
+	--(shard.get_rw());
+	pop.persist(shard);
 }
 
 	return true;
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 void
-concurrent_hash_map<Key, T, HashCompare>::swap(
-	concurrent_hash_map<Key, T, HashCompare> &table)
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::swap(
+	concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+			    Statistics, GrowthPolicy, Lookup> &table)
 {
 	std::swap(this->my_hash_compare, table.my_hash_compare);
 	internal_swap(table);
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 void
-concurrent_hash_map<Key, T, HashCompare>::rehash(size_type sz)
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::rehash(size_type sz)
 {
-	reserve(sz);
+	base_type::reserve(sz);
 	hashcode_t m = mask();
 
 	/* only the last segment should be scanned for rehashing size or first
@@ -2862,9 +5104,51 @@ concurrent_hash_map<Key, T, HashCompare>::rehash(size_type sz)
 	}
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::size_type
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::rehash_step(
+	size_type n)
+{
+	std::atomic<hashcode_t> &cursor = rehash_cursor();
+	size_type rehashed = 0;
+
+	while (rehashed < n) {
+		hashcode_t m = mask().load(std::memory_order_acquire);
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		ANNOTATE_HAPPENS_AFTER(&my_mask);
+#endif
+		hashcode_t h = cursor.load(std::memory_order_relaxed);
+
+		/* claim the bucket, so that other threads skip it */
+		do {
+			if (h > m)
+				return rehashed;
+		} while (!cursor.compare_exchange_weak(
+			h, h + 1, std::memory_order_relaxed));
+
+		if (get_bucket(h)->is_rehashed(std::memory_order_acquire))
+			continue;
+
+		/* rehashes the bucket unless a concurrent lookup does it */
+		bucket_accessor b(this, h);
+
+		++rehashed;
+	}
+
+	return rehashed;
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 void
-concurrent_hash_map<Key, T, HashCompare>::clear()
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::clear()
 {
 	hashcode_t m = mask();
 
@@ -2888,7 +5172,9 @@ concurrent_hash_map<Key, T, HashCompare>::clear()
 
 		transaction::manual tx(pop);
 
-		my_size.get_rw() = 0;
+		for (size_type i = 0; i < size_shards; ++i)
+			my_size[i].value.get_rw() = 0;
+
 		segment_index_t s = segment_traits_t::segment_index_of(m);
 
 		assert(s + 1 == block_table_size ||
@@ -2903,11 +5189,120 @@ concurrent_hash_map<Key, T, HashCompare>::clear()
 		throw std::runtime_error(e);
 	}
 	mask().store(embedded_buckets - 1, std::memory_order_relaxed);
+	rehash_cursor().store(embedded_buckets, std::memory_order_relaxed);
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+void
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy,
+		    Lookup>::clear(size_type concurrency, size_type batch_size)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"concurrent_hash_map::clear(size_type) cannot be called inside a transaction");
+
+	hashcode_t m = mask();
+
+	assert((m & (m + 1)) == 0);
+
+	/* a node can be linked to a bucket which is not rehashed and to its
+	 * parent at the same time, if the rehashing was interrupted */
+	for (hashcode_t b = embedded_buckets; b <= m; ++b) {
+		bucket *bp = get_bucket(b);
+
+		internal::assert_not_locked(bp->mutex);
+
+		if (bp->is_rehashed(std::memory_order_relaxed) == false)
+			rehash_bucket<true>(bp, b);
+	}
+
+	size_type n_buckets = m + 1;
+
+	concurrency = concurrency == 0 ? 1 : (std::min)(concurrency, n_buckets);
+	batch_size = (std::max)(batch_size, size_type(1));
+
+	internal::parallel_split(n_buckets, concurrency,
+				 [&](size_type first, size_type last) {
+					 clear_buckets(hashcode_t(first),
+						       hashcode_t(last),
+						       batch_size);
+				 });
+
+	pool_base pop = get_pool_base();
+	try { /* transaction scope */
+
+		transaction::manual tx(pop);
+
+		for (size_type i = 0; i < size_shards; ++i)
+			my_size[i].value.get_rw() = 0;
+
+		/* all buckets are empty, only the segments are freed */
+		segment_index_t s = segment_traits_t::segment_index_of(m);
+
+		do {
+			clear_segment(s);
+		} while (s-- > 0);
+
+		transaction::commit();
+	} catch (const pmem::transaction_error &e) {
+		throw std::runtime_error(e);
+	}
+	mask().store(embedded_buckets - 1, std::memory_order_relaxed);
+	rehash_cursor().store(embedded_buckets, std::memory_order_relaxed);
+}
+
+/**
+ * Free the nodes of buckets [first, last) in transactions of up to
+ * batch_size nodes.
+ */
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+void
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy,
+		    Lookup>::clear_buckets(hashcode_t first, hashcode_t last,
+					   size_type batch)
+{
+	pool_base pop = get_pool_base();
+
+	try {
+		for (hashcode_t h = first; h < last;) {
+			transaction::manual tx(pop);
+
+			for (size_type freed = 0;
+			     h < last && freed < batch;) {
+				bucket *b = get_bucket(h);
+				node_base_ptr_t n = b->node_list;
+
+				if (!is_valid(n)) {
+					b->clear_fingerprints();
+					++h;
+					continue;
+				}
+
+				b->node_list = n(my_pool_uuid)->next;
+				delete_node(n);
+				++freed;
+			}
+
+			transaction::commit();
+		}
+	} catch (const pmem::transaction_error &e) {
+		throw std::runtime_error(e);
+	}
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 void
-concurrent_hash_map<Key, T, HashCompare>::clear_segment(segment_index_t s)
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::clear_segment(
+	segment_index_t s)
 {
 	segment_facade_t segment(my_table, s);
 
@@ -2920,25 +5315,429 @@ concurrent_hash_map<Key, T, HashCompare>::clear_segment(segment_index_t s)
 			segment[i].node_list = n(my_pool_uuid)->next;
 			delete_node(n);
 		}
+
+		segment[i].clear_fingerprints();
 	}
 
 	if (s >= segment_traits_t::embedded_segments)
 		segment.disable();
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+void
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::shrink_to_fit()
+{
+	hashcode_t m = mask();
+	size_type sz = size();
+
+	assert((m & (m + 1)) == 0);
+
+	/* the smallest mask which check_growth() would not grow at once */
+	const hashcode_t first_block_mask =
+		segment_traits_t::segment_size(first_block) - 1;
+
+	hashcode_t target = m;
+	while (target > embedded_buckets - 1) {
+		hashcode_t prev = target == first_block_mask
+			? embedded_buckets - 1
+			: target >> 1;
+
+		if (GrowthPolicy::buckets_for(sz) >= prev)
+			break;
+
+		target = prev;
+	}
+
+	if (target == m)
+		return;
+
+	/* after that each node is in exactly one bucket, the one it maps
+	 * to; a node can be linked to a bucket which is not rehashed and to
+	 * its parent at the same time, if the rehashing was interrupted */
+	for (hashcode_t b = embedded_buckets; b <= m; ++b) {
+		bucket *bp = get_bucket(b);
+
+		internal::assert_not_locked(bp->mutex);
+
+		if (bp->is_rehashed(std::memory_order_relaxed) == false)
+			rehash_bucket<true>(bp, b);
+	}
+
+	for (hashcode_t b = target + 1; b <= m; ++b)
+		correct_bucket(get_bucket(b));
+
+	pool_base pop = get_pool_base();
+	while (m > target) {
+		segment_index_t last = segment_traits_t::segment_index_of(m);
+		segment_index_t first = last < first_block
+			? segment_traits_t::embedded_segments
+			: last;
+		hashcode_t new_mask = last < first_block
+			? embedded_buckets - 1
+			: segment_traits_t::segment_base(last) - 1;
+
+		try {
+			transaction::manual tx(pop);
+
+			/* the first block is allocated (and freed) with its
+			 * lowest segment, so release it as a whole */
+			for (segment_index_t s = last; s >= first; --s)
+				merge_segment(s, new_mask);
+
+			transaction::commit();
+		} catch (const pmem::transaction_error &e) {
+			throw std::runtime_error(e);
+		}
+
+		mask().store(new_mask, std::memory_order_release);
+		m = new_mask;
+	}
+
+	rehash_cursor().store(embedded_buckets, std::memory_order_relaxed);
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+void
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::merge_segment(
+	segment_index_t s, hashcode_t m)
+{
+	segment_facade_t segment(my_table, s);
+
+	assert(segment.is_valid());
+
+	hashcode_t base = segment_traits_t::segment_base(s);
+	size_type sz = segment.size();
+	for (size_type i = 0; i < sz; ++i) {
+		bucket *b = &(segment[i]);
+
+		/* all buckets were rehashed by shrink_to_fit() */
+		assert(b->is_rehashed(std::memory_order_relaxed));
+
+		if (!is_valid(b->node_list))
+			continue;
+
+		/* all nodes of the bucket map to the same bucket under m */
+		bucket *dst = get_bucket((base + i) & m);
+
+		node_base_ptr_t n = b->node_list;
+		while (is_valid(n(my_pool_uuid)->next))
+			n = n(my_pool_uuid)->next;
+
+		dst->add_fingerprints(*b);
+
+		n(my_pool_uuid)->next = dst->node_list;
+		dst->node_list = b->node_list;
+	}
+
+	segment.disable();
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename I>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::size_type
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::insert_bulk(
+	I first, I last, size_type batch_size)
+{
+	std::vector<std::pair<hashcode_t, I>> batch;
+	size_type inserted = 0;
+
+	if (batch_size == 0)
+		batch_size = 1;
+
+	while (first != last) {
+		batch.clear();
+
+		for (; first != last && batch.size() < batch_size; ++first)
+			batch.emplace_back(my_hash_compare.hash(first->first),
+					   first);
+
+		inserted += insert_batch(batch);
+	}
+
+	return inserted;
+}
+
+/**
+ * Insert a batch of (hashcode, iterator to item) pairs in one transaction.
+ */
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename I>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::size_type
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::insert_batch(
+	std::vector<std::pair<hashcode_t, I>> &batch)
+{
+	using batch_item = std::pair<hashcode_t, I>;
+
+	/* marks the end of modification of the buckets after the transaction
+	 * is committed or aborted */
+	struct seq_guard {
+		std::vector<bucket *> buckets;
+
+		~seq_guard()
+		{
+			for (bucket *b : buckets)
+				b->seq().write_end();
+		}
+	};
+
+	pool_base pop = get_pool_base();
+	hashcode_t m = mask().load(std::memory_order_acquire);
+	size_type inserted = 0;
+
+restart : { /* lock scope */
+	assert((m & (m + 1)) == 0);
+
+	/* buckets are locked in descending order of their indices, which is
+	 * the order used by rehash_bucket() */
+	std::stable_sort(batch.begin(), batch.end(),
+			 [m](const batch_item &a, const batch_item &b) {
+				 return (a.first & m) > (b.first & m);
+			 });
+
+	std::deque<bucket_accessor> buckets;
+
+	for (const batch_item &item : batch) {
+		if (buckets.empty() ||
+		    buckets.back().get() != get_bucket(item.first & m))
+			buckets.emplace_back(this, item.first & m,
+					     /*writer=*/true);
+	}
+
+	for (const batch_item &item : batch) {
+		hashcode_t m_now = m;
+
+		if (check_mask_race(item.first, m_now)) {
+			m = m_now;
+			goto restart; /* buckets are released in ~buckets(). */
+		}
+	}
+
+	seq_guard guard;
+	guard.buckets.reserve(buckets.size());
+
+	for (bucket_accessor &b : buckets) {
+		b->seq().write_begin();
+		guard.buckets.push_back(b.get());
+	}
+
+	try {
+		transaction::manual tx(pop);
+
+		for (const batch_item &item : batch) {
+			bucket *b = get_bucket(item.first & m);
+
+			/* the key is present or was earlier in the batch */
+			if (is_valid(search_bucket(item.second->first,
+						       item.first, b)))
+				continue;
+
+			b->add_fingerprint(item.first);
+			b->node_list = make_persistent<node>(
+				item.first, *item.second, b->node_list);
+
+			++inserted;
+		}
+
+		transaction::commit();
+	} catch (const pmem::transaction_alloc_error &) {
+		throw std::bad_alloc();
+	} catch (const pmem::transaction_error &e) {
+		throw std::runtime_error(e);
+	}
+
+	/* the counter is recalculated by initialize() if a crash happens
+	 * before it is updated */
+	if (inserted) {
+		auto &shard = this->my_size_shard();
+		shard.get_rw() += inserted;
+		pop.persist(shard);
+	}
+} /* lock scope */
+
+	if (inserted)
+		check_growth(m, size());
+
+	return inserted;
+}
+
+/**
+ * Correct buckets in range [first, last) after a crash and count their items.
+ * Each bucket must be visited by only one thread.
+ */
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::size_type
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::count_buckets(
+	hashcode_t first, hashcode_t last)
+{
+	size_type sz = 0;
+
+	for (hashcode_t h = first; h < last; ++h) {
+		bucket *b = get_bucket(h);
+
+		correct_bucket(b);
+
+		assert(is_valid(b->node_list) ||
+		       b->node_list == internal::empty_bucket ||
+		       b->is_rehashed(std::memory_order_relaxed) == false);
+
+		/* fingerprints are not valid after restart */
+		b->clear_fingerprints();
+
+		for (node_base_ptr_t n = b->node_list; is_valid(n);
+		     n = n(my_pool_uuid)->next) {
+			if (BucketLayout::fingerprints)
+				b->add_fingerprint(get_hash_code(n));
+			++sz;
+		}
+	}
+
+	return sz;
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+concurrent_hash_map_stats
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::stats() const
+{
+	concurrent_hash_map_stats result;
+
+	this->load_counters(result);
+	result.chain_length.fill(0);
+
+	hashcode_t m = mask().load(std::memory_order_acquire);
+
+	result.segments.resize(segment_traits_t::segment_index_of(m) + 1,
+			       concurrent_hash_map_stats::segment_stats());
+
+	for (hashcode_t h = 0; h <= m; ++h) {
+		bucket *b = get_bucket(h);
+		size_type length = 0;
+
+		{
+			typename bucket::scoped_t lock(b->mutex,
+						       /*write=*/false);
+
+			if (b->is_rehashed(std::memory_order_acquire)) {
+				for (node_base_ptr_t n = b->node_list;
+				     is_valid(n); n = n(my_pool_uuid)->next)
+					++length;
+			}
+		}
+
+		auto &segment = result.segments[segment_traits_t::
+							segment_index_of(h)];
+
+		++segment.buckets;
+		segment.used_buckets += length > 0;
+		segment.nodes += length;
+
+		++result.chain_length[std::min(
+			length,
+			concurrent_hash_map_stats::chain_length_bins - 1)];
+	}
+
+	return result;
+}
+
+/**
+ * Count items in the first n_buckets buckets using concurrency threads.
+ */
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+typename concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+			     NodeAllocation, Statistics,
+			     GrowthPolicy, Lookup>::size_type
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::internal_count(
+	size_type n_buckets, size_type concurrency)
+{
+	std::atomic<size_type> sz(0);
+
+	internal::parallel_split(n_buckets, concurrency,
+				 [&](size_type first, size_type last) {
+					 sz += count_buckets(hashcode_t(first),
+							     hashcode_t(last));
+				 });
+
+	return sz.load();
+}
+
+/**
+ * Build concurrency ranges of buckets and call f for each of them in
+ * a separate thread.
+ */
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
+template <typename Range, typename MapPtr, typename F>
+void
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::internal_parallel_for(
+	MapPtr map, size_type concurrency, F &f)
+{
+	size_type n_buckets = map->mask() + 1;
+
+	concurrency = concurrency == 0 ? 1 : (std::min)(concurrency, n_buckets);
+
+	/* ranges are built before the threads start, because the iterators
+	 * of adjacent ranges visit the same bucket */
+	std::vector<Range> ranges;
+	ranges.reserve(concurrency);
+
+	for (size_type i = 0; i < concurrency; ++i)
+		ranges.emplace_back(map, n_buckets * i / concurrency,
+				    n_buckets * (i + 1) / concurrency);
+
+	internal::parallel_split(concurrency, concurrency,
+				 [&](size_type first, size_type) {
+					 f(ranges[first]);
+				 });
+}
+
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 void
-concurrent_hash_map<Key, T, HashCompare>::internal_copy(
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::internal_copy(
 	const concurrent_hash_map &source)
 {
-	reserve(source.my_size.get_ro());
+	reserve(source.size());
 	internal_copy(source.begin(), source.end());
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 template <typename I>
 void
-concurrent_hash_map<Key, T, HashCompare>::internal_copy(I first, I last)
+concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+		    Statistics, GrowthPolicy, Lookup>::internal_copy(
+	I first, I last)
 {
 	hashcode_t m = mask();
 	pool_base pop = get_pool_base();
@@ -2952,26 +5751,34 @@ concurrent_hash_map<Key, T, HashCompare>::internal_copy(I first, I last)
 		allocate_node_copy_construct(
 			pop,
 			reinterpret_cast<persistent_ptr<node> &>(b->tmp_node),
-			&(*first), b->node_list);
+			h, &(*first), b->node_list);
 
+		b->add_fingerprint(h);
 		insert_new_node(pop, b);
 	}
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 inline bool
-operator==(const concurrent_hash_map<Key, T, HashCompare> &a,
-	   const concurrent_hash_map<Key, T, HashCompare> &b)
+operator==(const concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+				       NodeAllocation, Statistics,
+				       GrowthPolicy, Lookup> &a,
+	   const concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+				     NodeAllocation, Statistics,
+				     GrowthPolicy, Lookup> &b)
 {
+	using map_type = concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+					     NodeAllocation, Statistics,
+					     GrowthPolicy, Lookup>;
+
 	if (a.size() != b.size())
 		return false;
 
-	typename concurrent_hash_map<Key, T, HashCompare>::const_iterator i(
-		a.begin()),
-		i_end(a.end());
+	typename map_type::const_iterator i(a.begin()), i_end(a.end());
 
-	typename concurrent_hash_map<Key, T, HashCompare>::const_iterator j,
-		j_end(b.end());
+	typename map_type::const_iterator j, j_end(b.end());
 
 	for (; i != i_end; ++i) {
 		j = b.equal_range(i->first).first;
@@ -2983,18 +5790,28 @@ operator==(const concurrent_hash_map<Key, T, HashCompare> &a,
 	return true;
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 inline bool
-operator!=(const concurrent_hash_map<Key, T, HashCompare> &a,
-	   const concurrent_hash_map<Key, T, HashCompare> &b)
+operator!=(const concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+				       NodeAllocation, Statistics,
+				       GrowthPolicy, Lookup> &a,
+	   const concurrent_hash_map<Key, T, HashCompare, BucketLayout,
+				     NodeAllocation, Statistics,
+				     GrowthPolicy, Lookup> &b)
 {
 	return !(a == b);
 }
 
-template <typename Key, typename T, typename HashCompare>
+template <typename Key, typename T, typename HashCompare,
+	  typename BucketLayout, typename NodeAllocation, typename Statistics,
+	  typename GrowthPolicy, typename Lookup>
 inline void
-swap(concurrent_hash_map<Key, T, HashCompare> &a,
-     concurrent_hash_map<Key, T, HashCompare> &b)
+swap(concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+			 Statistics, GrowthPolicy, Lookup> &a,
+     concurrent_hash_map<Key, T, HashCompare, BucketLayout, NodeAllocation,
+			 Statistics, GrowthPolicy, Lookup> &b)
 {
 	a.swap(b);
 }
@@ -0,0 +1,1060 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * A persistent version of concurrent ordered map, implemented as a skip list.
+ * Ref: M. Herlihy, Y. Lev, V. Luchangco, N. Shavit, "A Simple Optimistic
+ * Skiplist Algorithm"
+ */
+
+#ifndef PMEMOBJ_CONCURRENT_MAP_HPP
+#define PMEMOBJ_CONCURRENT_MAP_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pexceptions.hpp>
+#include <libpmemobj++/experimental/v.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+template <typename Key, typename T, typename Compare>
+class concurrent_map;
+
+namespace internal
+{
+
+/**
+ * Node of the skip list. The node is followed in memory by an array of
+ * height() offsets of the next nodes, one for each level. An offset is
+ * relative to the pool and 0 means the end of the list.
+ */
+template <typename Key, typename T>
+class skip_list_node {
+public:
+	using value_type = std::pair<const Key, T>;
+	using size_type = std::size_t;
+	using next_type = std::atomic<uint64_t>;
+
+	template <typename... Args>
+	skip_list_node(size_type height, Args &&... args)
+	    : item(std::forward<Args>(args)...), my_height(height)
+	{
+		for (size_type i = 0; i < height; ++i)
+			new (next_array() + i) next_type(0);
+	}
+
+	/** Number of bytes needed by a node with the given height. */
+	static size_type
+	allocation_size(size_type height)
+	{
+		return sizeof(skip_list_node) + height * sizeof(next_type);
+	}
+
+	size_type
+	height() const
+	{
+		return my_height.get_ro();
+	}
+
+	next_type *
+	next_array()
+	{
+		return reinterpret_cast<next_type *>(this + 1);
+	}
+
+	const next_type *
+	next_array() const
+	{
+		return reinterpret_cast<const next_type *>(this + 1);
+	}
+
+	next_type &
+	next(size_type level)
+	{
+		assert(level < height());
+		return next_array()[level];
+	}
+
+	const next_type &
+	next(size_type level) const
+	{
+		assert(level < height());
+		return next_array()[level];
+	}
+
+	value_type item;
+
+private:
+	p<size_type> my_height;
+};
+
+/**
+ * Translate an offset stored in the skip list to a node pointer.
+ */
+template <typename Node>
+Node *
+skip_list_get_node(uint64_t pool_uuid, uint64_t off)
+{
+	if (off == 0)
+		return nullptr;
+
+	return static_cast<Node *>(pmemobj_direct(PMEMoid{pool_uuid, off}));
+}
+
+/**
+ * Random height of a new node. The heights have the geometric distribution
+ * with p = 1/2, which keeps the expected number of nodes visited by a
+ * lookup logarithmic.
+ */
+inline std::size_t
+skip_list_random_height(std::size_t max_height)
+{
+	static thread_local std::mt19937 generator(static_cast<unsigned>(
+		std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+	std::size_t height = 1;
+	uint32_t bits = static_cast<uint32_t>(generator());
+
+	while (height < max_height && (bits & 1)) {
+		++height;
+		bits >>= 1;
+	}
+
+	return height;
+}
+
+/**
+ * Volatile spin locks which guard the links of the skip list. A lock is
+ * picked by the address of the array of links of a node, so a node never
+ * needs a lock of its own.
+ */
+class skip_list_locks {
+public:
+	static constexpr std::size_t lock_bits = 8;
+
+	skip_list_locks()
+	{
+		for (auto &l : locks)
+			l.store(false, std::memory_order_relaxed);
+	}
+
+	std::size_t
+	index_of(const void *links) const
+	{
+		uint64_t a = static_cast<uint64_t>(
+			reinterpret_cast<uintptr_t>(links));
+
+		return static_cast<std::size_t>(
+			((a >> 4) * 0x9E3779B97F4A7C15ULL) >> (64 - lock_bits));
+	}
+
+	void
+	lock(std::size_t i)
+	{
+		while (locks[i].exchange(true, std::memory_order_acquire)) {
+			while (locks[i].load(std::memory_order_relaxed))
+				std::this_thread::yield();
+		}
+	}
+
+	void
+	unlock(std::size_t i)
+	{
+		locks[i].store(false, std::memory_order_release);
+	}
+
+private:
+	std::array<std::atomic<bool>, std::size_t(1) << lock_bits> locks;
+};
+
+/**
+ * Scoped lock of the predecessors of a node which is being linked. The
+ * locks are taken in the order of their indexes, so two writers never wait
+ * for each other in a cycle.
+ */
+class skip_list_scoped_lock {
+public:
+	template <typename Links>
+	skip_list_scoped_lock(skip_list_locks &locks, Links *const *preds,
+			      std::size_t height)
+	    : my_locks(locks), my_count(0)
+	{
+		assert(height <= my_indexes.size());
+
+		for (std::size_t i = 0; i < height; ++i)
+			my_indexes[i] = locks.index_of(preds[i]);
+
+		std::sort(my_indexes.begin(), my_indexes.begin() + height);
+		my_count = static_cast<std::size_t>(
+			std::unique(my_indexes.begin(),
+				    my_indexes.begin() + height) -
+			my_indexes.begin());
+
+		for (std::size_t i = 0; i < my_count; ++i)
+			my_locks.lock(my_indexes[i]);
+	}
+
+	~skip_list_scoped_lock()
+	{
+		for (std::size_t i = 0; i < my_count; ++i)
+			my_locks.unlock(my_indexes[i]);
+	}
+
+	skip_list_scoped_lock(const skip_list_scoped_lock &) = delete;
+	skip_list_scoped_lock &
+	operator=(const skip_list_scoped_lock &) = delete;
+
+private:
+	skip_list_locks &my_locks;
+	std::array<std::size_t, 64> my_indexes;
+	std::size_t my_count;
+};
+
+/**
+ * Meets requirements of a forward iterator for STL. The iterator walks the
+ * lowest level of the skip list and stays valid while other threads insert
+ * new elements.
+ */
+template <typename Map, bool IsConst>
+class skip_list_iterator {
+	using node = typename Map::node;
+
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = ptrdiff_t;
+	using value_type = typename Map::value_type;
+	using reference =
+		typename std::conditional<IsConst, const value_type &,
+					  value_type &>::type;
+	using pointer = typename std::conditional<IsConst, const value_type *,
+						  value_type *>::type;
+
+	template <typename M, bool C, bool U>
+	friend bool operator==(const skip_list_iterator<M, C> &i,
+			       const skip_list_iterator<M, U> &j);
+
+	template <typename M, bool C, bool U>
+	friend bool operator!=(const skip_list_iterator<M, C> &i,
+			       const skip_list_iterator<M, U> &j);
+
+	friend class skip_list_iterator<Map, true>;
+
+#if !defined(_MSC_VER) || defined(__INTEL_COMPILER)
+private:
+	template <typename Key, typename T, typename Compare>
+	friend class experimental::concurrent_map;
+#else
+public: /* workaround */
+#endif
+	skip_list_iterator(uint64_t pool_uuid, node *n)
+	    : my_pool_uuid(pool_uuid), my_node(n)
+	{
+	}
+
+public:
+	/** Construct undefined iterator. */
+	skip_list_iterator() : my_pool_uuid(0), my_node(nullptr)
+	{
+	}
+
+	/** Copy constructor for const iterator from non-const iterator */
+	template <typename U = void,
+		  typename = typename std::enable_if<IsConst, U>::type>
+	skip_list_iterator(const skip_list_iterator<Map, false> &other)
+	    : my_pool_uuid(other.my_pool_uuid), my_node(other.my_node)
+	{
+	}
+
+	/** Indirection (dereference). */
+	reference operator*() const
+	{
+		assert(my_node != nullptr);
+		return my_node->item;
+	}
+
+	/** Member access. */
+	pointer operator->() const
+	{
+		return &operator*();
+	}
+
+	/** Prefix increment. */
+	skip_list_iterator &
+	operator++()
+	{
+		assert(my_node != nullptr);
+		my_node = skip_list_get_node<node>(
+			my_pool_uuid,
+			my_node->next(0).load(std::memory_order_acquire));
+
+		return *this;
+	}
+
+	/** Postfix increment. */
+	skip_list_iterator
+	operator++(int)
+	{
+		skip_list_iterator old(*this);
+		operator++();
+		return old;
+	}
+
+private:
+	uint64_t my_pool_uuid;
+
+	node *my_node;
+};
+
+template <typename Map, bool C, bool U>
+bool
+operator==(const skip_list_iterator<Map, C> &i,
+	   const skip_list_iterator<Map, U> &j)
+{
+	return i.my_node == j.my_node;
+}
+
+template <typename Map, bool C, bool U>
+bool
+operator!=(const skip_list_iterator<Map, C> &i,
+	   const skip_list_iterator<Map, U> &j)
+{
+	return i.my_node != j.my_node;
+}
+
+} /* namespace internal */
+
+/**
+ * Persistent memory aware implementation of a concurrent ordered map, a
+ * skip list of persistent nodes.
+ *
+ * Lookups, bounds and iteration do not take any locks, they follow the
+ * links with acquire loads. An insert finds the predecessors of the new
+ * node at each of its levels, locks them with volatile spin locks and,
+ * if no other thread linked a node after them in the meantime, allocates
+ * and links the node in a single transaction. A crash leaves either the
+ * whole node linked or no trace of it.
+ *
+ * Nodes are never unlinked concurrently with other operations, so
+ * unsafe_erase() and clear() must not run concurrently with anything else.
+ *
+ * The number of elements is volatile, initialize() has to be called every
+ * time the pool is opened to count them.
+ *
+ * The operations start their own transactions and must not be called inside
+ * a transaction, except the constructors and the destructor. The locks of an
+ * insert are released when its transaction commits, a nested transaction
+ * would publish the node before the outer one could roll it back, so the
+ * inserts throw pmem::transaction_scope_error in that case.
+ */
+template <typename Key, typename T, typename Compare = std::less<Key>>
+class concurrent_map {
+	template <typename Map, bool IsConst>
+	friend class internal::skip_list_iterator;
+
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<const Key, T>;
+	using size_type = std::size_t;
+	using difference_type = ptrdiff_t;
+	using key_compare = Compare;
+	using reference = value_type &;
+	using const_reference = const value_type &;
+	using pointer = value_type *;
+	using const_pointer = const value_type *;
+	using iterator = internal::skip_list_iterator<concurrent_map, false>;
+	using const_iterator =
+		internal::skip_list_iterator<concurrent_map, true>;
+
+	/** Maximum height of a node. */
+	static constexpr size_type max_height = 32;
+
+	/**
+	 * Construct empty map.
+	 */
+	concurrent_map()
+	{
+		PMEMoid oid = pmemobj_oid(this);
+
+		assert(!OID_IS_NULL(oid));
+
+		my_pool_uuid = oid.pool_uuid_lo;
+
+		for (size_type i = 0; i < max_height; ++i)
+			my_head[i].store(0, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Construct map with copying iteration range.
+	 */
+	template <typename I>
+	concurrent_map(I first, I last) : concurrent_map()
+	{
+		insert(first, last);
+	}
+
+	/**
+	 * Construct map with initializer list.
+	 */
+	concurrent_map(std::initializer_list<value_type> il)
+	    : concurrent_map(il.begin(), il.end())
+	{
+	}
+
+	concurrent_map(const concurrent_map &) = delete;
+	concurrent_map &operator=(const concurrent_map &) = delete;
+
+	/**
+	 * Clear map and destroy it.
+	 */
+	~concurrent_map()
+	{
+		clear();
+	}
+
+	/**
+	 * Intialize persistent concurrent map after process restart.
+	 * Counts the elements. Should be called everytime after process
+	 * restart. Not thread safe.
+	 */
+	void
+	initialize()
+	{
+		size_type n = 0;
+
+		for (node *it = first_node(); it != nullptr; it = next_node(it))
+			++n;
+
+		size_counter().store(n, std::memory_order_relaxed);
+	}
+
+	//--------------------------------------------------------------------
+	// STL support
+	//--------------------------------------------------------------------
+
+	iterator
+	begin()
+	{
+		return iterator(my_pool_uuid, first_node());
+	}
+
+	iterator
+	end()
+	{
+		return iterator(my_pool_uuid, nullptr);
+	}
+
+	const_iterator
+	begin() const
+	{
+		return const_iterator(my_pool_uuid, first_node());
+	}
+
+	const_iterator
+	end() const
+	{
+		return const_iterator(my_pool_uuid, nullptr);
+	}
+
+	const_iterator
+	cbegin() const
+	{
+		return begin();
+	}
+
+	const_iterator
+	cend() const
+	{
+		return end();
+	}
+
+	/**
+	 * @returns number of elements in the map.
+	 */
+	size_type
+	size() const
+	{
+		return size_counter().load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @returns true if the map has no elements.
+	 */
+	bool
+	empty() const
+	{
+		return first_node() == nullptr;
+	}
+
+	/**
+	 * @returns the key comparison object.
+	 */
+	key_compare
+	key_comp() const
+	{
+		return key_compare();
+	}
+
+	//--------------------------------------------------------------------
+	// concurrent lookups
+	//--------------------------------------------------------------------
+
+	/**
+	 * Find the element with the given key.
+	 * @returns iterator to the element or end().
+	 */
+	iterator
+	find(const key_type &key)
+	{
+		return iterator(my_pool_uuid, internal_find(key));
+	}
+
+	/**
+	 * Find the element with the given key.
+	 * @returns iterator to the element or end().
+	 */
+	const_iterator
+	find(const key_type &key) const
+	{
+		return const_iterator(my_pool_uuid, internal_find(key));
+	}
+
+	/**
+	 * @returns 1 if the element with the given key is in the map,
+	 * 0 otherwise.
+	 */
+	size_type
+	count(const key_type &key) const
+	{
+		return internal_find(key) == nullptr ? 0 : 1;
+	}
+
+	/**
+	 * @returns iterator to the first element whose key is not less than
+	 * @arg key, or end().
+	 */
+	iterator
+	lower_bound(const key_type &key)
+	{
+		return iterator(my_pool_uuid, internal_lower_bound(key));
+	}
+
+	/**
+	 * @returns iterator to the first element whose key is not less than
+	 * @arg key, or end().
+	 */
+	const_iterator
+	lower_bound(const key_type &key) const
+	{
+		return const_iterator(my_pool_uuid, internal_lower_bound(key));
+	}
+
+	/**
+	 * @returns iterator to the first element whose key is greater than
+	 * @arg key, or end().
+	 */
+	iterator
+	upper_bound(const key_type &key)
+	{
+		return iterator(my_pool_uuid, internal_upper_bound(key));
+	}
+
+	/**
+	 * @returns iterator to the first element whose key is greater than
+	 * @arg key, or end().
+	 */
+	const_iterator
+	upper_bound(const key_type &key) const
+	{
+		return const_iterator(my_pool_uuid, internal_upper_bound(key));
+	}
+
+	/**
+	 * @returns range of the elements with the given key.
+	 */
+	std::pair<iterator, iterator>
+	equal_range(const key_type &key)
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+
+	/**
+	 * @returns range of the elements with the given key.
+	 */
+	std::pair<const_iterator, const_iterator>
+	equal_range(const key_type &key) const
+	{
+		return std::make_pair(lower_bound(key), upper_bound(key));
+	}
+
+	//--------------------------------------------------------------------
+	// concurrent inserts
+	//--------------------------------------------------------------------
+
+	/**
+	 * Insert the element unless an element with the same key exists.
+	 * @returns iterator to the element with the key and true if the
+	 * element was inserted.
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	std::pair<iterator, bool>
+	insert(const value_type &value)
+	{
+		return internal_emplace(value.first, value);
+	}
+
+	/**
+	 * Insert the element unless an element with the same key exists.
+	 * @returns iterator to the element with the key and true if the
+	 * element was inserted.
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	std::pair<iterator, bool>
+	insert(value_type &&value)
+	{
+		return internal_emplace(value.first, std::move(value));
+	}
+
+	/**
+	 * Insert the elements of the range [first, last).
+	 */
+	template <typename I>
+	void
+	insert(I first, I last)
+	{
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	/**
+	 * Insert the elements of the initializer list.
+	 */
+	void
+	insert(std::initializer_list<value_type> il)
+	{
+		insert(il.begin(), il.end());
+	}
+
+	/**
+	 * Insert the element constructed from @arg args unless an element
+	 * with the same key exists. The element is first constructed as a
+	 * volatile object to get its key.
+	 * @returns iterator to the element with the key and true if the
+	 * element was inserted.
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	template <typename... Args>
+	std::pair<iterator, bool>
+	emplace(Args &&... args)
+	{
+		value_type value(std::forward<Args>(args)...);
+
+		return internal_emplace(value.first, std::move(value));
+	}
+
+	/**
+	 * Insert the element with @arg key and the mapped value constructed
+	 * from @arg args unless an element with the key exists. Nothing is
+	 * constructed otherwise.
+	 * @returns iterator to the element with the key and true if the
+	 * element was inserted.
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	template <typename... Args>
+	std::pair<iterator, bool>
+	try_emplace(const key_type &key, Args &&... args)
+	{
+		return internal_emplace(
+			key, std::piecewise_construct,
+			std::forward_as_tuple(key),
+			std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+	/**
+	 * Insert the element with @arg key and the mapped value constructed
+	 * from @arg args unless an element with the key exists. Nothing is
+	 * constructed or moved from otherwise.
+	 * @returns iterator to the element with the key and true if the
+	 * element was inserted.
+	 * @throw pmem::transaction_scope_error if called inside a
+	 * transaction.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	template <typename... Args>
+	std::pair<iterator, bool>
+	try_emplace(key_type &&key, Args &&... args)
+	{
+		return internal_emplace(
+			key, std::piecewise_construct,
+			std::forward_as_tuple(std::move(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...));
+	}
+
+	//--------------------------------------------------------------------
+	// not thread safe modifiers
+	//--------------------------------------------------------------------
+
+	/**
+	 * Remove the element with the given key. Not thread safe.
+	 * @returns number of removed elements.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	size_type unsafe_erase(const key_type &key);
+
+	/**
+	 * Remove all elements in a single transaction. Not thread safe.
+	 * @throw pmem::transaction_error when the transaction fails.
+	 */
+	void clear();
+
+private:
+	using node = internal::skip_list_node<Key, T>;
+	using next_type = typename node::next_type;
+
+	static_assert(alignof(node) >= alignof(next_type),
+		      "links have to be aligned after the node");
+
+	node *
+	get_node(uint64_t off) const
+	{
+		return internal::skip_list_get_node<node>(my_pool_uuid, off);
+	}
+
+	node *
+	first_node() const
+	{
+		return get_node(my_head[0].load(std::memory_order_acquire));
+	}
+
+	node *
+	next_node(node *n) const
+	{
+		return get_node(n->next(0).load(std::memory_order_acquire));
+	}
+
+	std::atomic<size_type> &
+	size_counter() const
+	{
+		return const_cast<concurrent_map *>(this)->my_size.get();
+	}
+
+	pool_base
+	get_pool_base() const
+	{
+		PMEMobjpool *pop =
+			pmemobj_pool_by_oid(PMEMoid{my_pool_uuid, 0});
+
+		return pool_base(pop);
+	}
+
+	template <typename Before>
+	node *internal_bound(Before before) const;
+
+	node *
+	internal_lower_bound(const key_type &key) const
+	{
+		key_compare less;
+
+		return internal_bound(
+			[&](const key_type &k) { return less(k, key); });
+	}
+
+	node *
+	internal_upper_bound(const key_type &key) const
+	{
+		key_compare less;
+
+		return internal_bound(
+			[&](const key_type &k) { return !less(key, k); });
+	}
+
+	node *
+	internal_find(const key_type &key) const
+	{
+		node *n = internal_lower_bound(key);
+
+		if (n != nullptr && key_compare()(key, n->item.first))
+			return nullptr;
+
+		return n;
+	}
+
+	void internal_find_position(const key_type &key, next_type **preds,
+				    uint64_t *succs) const;
+
+	template <typename... Args>
+	std::pair<iterator, bool> internal_emplace(const key_type &key,
+						   Args &&... args);
+
+	void delete_node(node *n);
+
+	p<uint64_t> my_pool_uuid;
+
+	/** Links of the head of the list, one for each level. */
+	next_type my_head[max_height];
+
+	v<internal::skip_list_locks> my_locks;
+
+	v<std::atomic<size_type>> my_size;
+}; /* class concurrent_map */
+
+/**
+ * Walk down the levels and return the first node of the lowest level whose
+ * key does not satisfy @arg before.
+ */
+template <typename Key, typename T, typename Compare>
+template <typename Before>
+typename concurrent_map<Key, T, Compare>::node *
+concurrent_map<Key, T, Compare>::internal_bound(Before before) const
+{
+	const next_type *pred = my_head;
+	node *succ = nullptr;
+
+	for (size_type level = max_height; level-- > 0;) {
+		succ = get_node(pred[level].load(std::memory_order_acquire));
+
+		while (succ != nullptr && before(succ->item.first)) {
+			pred = succ->next_array();
+			succ = get_node(
+				pred[level].load(std::memory_order_acquire));
+		}
+	}
+
+	return succ;
+}
+
+/**
+ * Find the last links before @arg key at each level (@arg preds) and the
+ * offsets they store (@arg succs).
+ */
+template <typename Key, typename T, typename Compare>
+void
+concurrent_map<Key, T, Compare>::internal_find_position(const key_type &key,
+							next_type **preds,
+							uint64_t *succs) const
+{
+	key_compare less;
+	next_type *pred = const_cast<next_type *>(my_head);
+
+	for (size_type level = max_height; level-- > 0;) {
+		uint64_t succ = pred[level].load(std::memory_order_acquire);
+		node *n = get_node(succ);
+
+		while (n != nullptr && less(n->item.first, key)) {
+			pred = n->next_array();
+			succ = pred[level].load(std::memory_order_acquire);
+			n = get_node(succ);
+		}
+
+		preds[level] = pred;
+		succs[level] = succ;
+	}
+}
+
+template <typename Key, typename T, typename Compare>
+template <typename... Args>
+std::pair<typename concurrent_map<Key, T, Compare>::iterator, bool>
+concurrent_map<Key, T, Compare>::internal_emplace(const key_type &key,
+						  Args &&... args)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"concurrent_map insert cannot be called inside a "
+			"transaction");
+
+	next_type *preds[max_height];
+	uint64_t succs[max_height];
+	size_type height = internal::skip_list_random_height(max_height);
+
+	for (;;) {
+		internal_find_position(key, preds, succs);
+
+		node *succ = get_node(succs[0]);
+		if (succ != nullptr && !key_compare()(key, succ->item.first))
+			return std::make_pair(iterator(my_pool_uuid, succ),
+					      false);
+
+		internal::skip_list_scoped_lock lock(my_locks.get(), preds,
+						     height);
+
+		/* other thread could link a node after the predecessors */
+		bool valid = true;
+		for (size_type i = 0; valid && i < height; ++i)
+			valid = preds[i][i].load(std::memory_order_relaxed) ==
+				succs[i];
+
+		if (!valid)
+			continue;
+
+		pool_base pop = get_pool_base();
+		node *n;
+
+		transaction::manual tx(pop);
+
+		PMEMoid oid = pmemobj_tx_alloc(node::allocation_size(height),
+					       detail::type_num<node>());
+		if (OID_IS_NULL(oid))
+			throw transaction_alloc_error(
+				"failed to allocate persistent memory object");
+
+		n = static_cast<node *>(pmemobj_direct(oid));
+		detail::create<node>(n, height, std::forward<Args>(args)...);
+
+		for (size_type i = 0; i < height; ++i)
+			n->next(i).store(succs[i], std::memory_order_relaxed);
+
+		/* the lowest level publishes the node to lookups */
+		for (size_type i = 0; i < height; ++i) {
+			detail::conditional_add_to_tx(&preds[i][i]);
+			preds[i][i].store(oid.off, std::memory_order_release);
+		}
+
+		transaction::commit();
+
+		size_counter().fetch_add(1, std::memory_order_relaxed);
+
+		return std::make_pair(iterator(my_pool_uuid, n), true);
+	}
+}
+
+template <typename Key, typename T, typename Compare>
+typename concurrent_map<Key, T, Compare>::size_type
+concurrent_map<Key, T, Compare>::unsafe_erase(const key_type &key)
+{
+	next_type *preds[max_height];
+	uint64_t succs[max_height];
+
+	internal_find_position(key, preds, succs);
+
+	node *n = get_node(succs[0]);
+	if (n == nullptr || key_compare()(key, n->item.first))
+		return 0;
+
+	pool_base pop = get_pool_base();
+
+	transaction::manual tx(pop);
+
+	for (size_type i = 0; i < n->height(); ++i) {
+		assert(preds[i][i].load(std::memory_order_relaxed) ==
+		       succs[0]);
+
+		detail::conditional_add_to_tx(&preds[i][i]);
+		preds[i][i].store(n->next(i).load(std::memory_order_relaxed),
+				  std::memory_order_relaxed);
+	}
+
+	delete_node(n);
+
+	transaction::commit();
+
+	size_counter().fetch_sub(1, std::memory_order_relaxed);
+
+	return 1;
+}
+
+template <typename Key, typename T, typename Compare>
+void
+concurrent_map<Key, T, Compare>::clear()
+{
+	pool_base pop = get_pool_base();
+
+	transaction::manual tx(pop);
+
+	for (node *n = first_node(); n != nullptr;) {
+		node *next = next_node(n);
+
+		delete_node(n);
+		n = next;
+	}
+
+	detail::conditional_add_to_tx(my_head, max_height);
+	for (size_type i = 0; i < max_height; ++i)
+		my_head[i].store(0, std::memory_order_relaxed);
+
+	transaction::commit();
+
+	size_counter().store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Destroy the element and free the node, must be called in a transaction.
+ */
+template <typename Key, typename T, typename Compare>
+void
+concurrent_map<Key, T, Compare>::delete_node(node *n)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+
+	detail::destroy<node>(*n);
+
+	if (pmemobj_tx_free(pmemobj_oid(n)) != 0)
+		throw transaction_free_error(
+			"failed to delete persistent memory object");
+}
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* PMEMOBJ_CONCURRENT_MAP_HPP */
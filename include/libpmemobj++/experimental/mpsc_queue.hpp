@@ -0,0 +1,494 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * A persistent multi-producer single-consumer queue, implemented as a set of
+ * per-producer ring buffers.
+ */
+
+#ifndef PMEMOBJ_MPSC_QUEUE_HPP
+#define PMEMOBJ_MPSC_QUEUE_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/pexceptions.hpp>
+#include <libpmemobj++/experimental/slice.hpp>
+#include <libpmemobj++/experimental/v.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace pmem
+{
+namespace obj
+{
+namespace experimental
+{
+
+namespace internal
+{
+
+/**
+ * Positions of a single producer ring. Both are counters of records ever
+ * written to and read from the ring, the slot is the counter modulo the ring
+ * capacity. The tail is written only by the producer and the head only by the
+ * consumer, so they are kept on separate cache lines.
+ *
+ * The head may be visible to other threads before it is persisted, so the
+ * producer reads published_head instead, which the consumer updates only
+ * after the head is persisted. Otherwise the producer could overwrite
+ * records which are still in the queue after a crash.
+ */
+struct mpsc_queue_ring {
+	static constexpr std::size_t cache_line_size = 64;
+
+	mpsc_queue_ring()
+	{
+		tail.store(0, std::memory_order_relaxed);
+		head.store(0, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64_t> tail;
+	/* set while a producer handle owns the ring */
+	v<std::atomic<bool>> registered;
+	char tail_padding[cache_line_size - sizeof(std::atomic<uint64_t>) -
+			  sizeof(v<std::atomic<bool>>)];
+
+	std::atomic<uint64_t> head;
+	v<std::atomic<uint64_t>> published_head;
+	char head_padding[cache_line_size - sizeof(std::atomic<uint64_t>) -
+			  sizeof(v<std::atomic<uint64_t>>)];
+}; /* struct mpsc_queue_ring */
+
+} /* namespace internal */
+
+/**
+ * Persistent multi-producer single-consumer queue of trivially copyable
+ * records.
+ *
+ * Every producer owns a ring buffer, so producers never contend with each
+ * other and the queue does not use transactions after it is constructed.
+ * A producer copies the records into its ring, flushes them and drains, and
+ * only then publishes them by advancing and persisting the tail of the ring.
+ * The consumer persists the tail it observed before handing the records out,
+ * so it never consumes a record which could disappear after a crash, and
+ * advances and persists the head once the records are processed. Only then
+ * the producer may reuse the slots of the consumed records.
+ *
+ * After a crash, all published records which were not consumed yet are
+ * still in the queue. Records consumed right before the crash may be
+ * delivered again if the head was not persisted yet, so the consumer has to
+ * tolerate duplicates (at-least-once delivery).
+ *
+ * Records produced by a single producer are consumed in the order they were
+ * produced. There is no ordering between producers.
+ *
+ * Producers are registered with register_producer() and unregistered when
+ * the producer handle is destroyed. The registrations are volatile, producers
+ * have to register again after the pool is reopened. Only one thread may
+ * consume at a time.
+ */
+template <typename T>
+class mpsc_queue {
+	static_assert(LIBPMEMOBJ_CPP_IS_TRIVIALLY_COPYABLE(T),
+		      "mpsc_queue requires a trivially copyable value_type");
+
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+	using pointer = value_type *;
+	using const_pointer = const value_type *;
+	using const_range = slice<const_pointer>;
+
+	/**
+	 * Handle used by a single thread to append records to the queue.
+	 * Obtained from register_producer(). Destroying the handle
+	 * unregisters the producer, which has to happen before the pool is
+	 * closed. The records it produced stay in the queue.
+	 */
+	class producer {
+	public:
+		producer(const producer &) = delete;
+		producer &operator=(const producer &) = delete;
+
+		producer(producer &&other) noexcept
+		    : queue(other.queue), index(other.index)
+		{
+			other.queue = nullptr;
+		}
+
+		producer &
+		operator=(producer &&other) noexcept
+		{
+			if (this != &other) {
+				release();
+				queue = other.queue;
+				index = other.index;
+				other.queue = nullptr;
+			}
+
+			return *this;
+		}
+
+		~producer()
+		{
+			release();
+		}
+
+		/**
+		 * Appends value to the queue.
+		 *
+		 * @return false if the ring of the producer is full.
+		 */
+		bool
+		try_produce(const value_type &value)
+		{
+			return try_produce(&value, &value + 1);
+		}
+
+		/**
+		 * Appends the records [first, last) to the queue. Either all of
+		 * them are appended and published at once, or none of them.
+		 *
+		 * @return false if there is not enough free space in the ring
+		 * of the producer.
+		 */
+		bool
+		try_produce(const_pointer first, const_pointer last)
+		{
+			return queue->internal_produce(index, first, last);
+		}
+
+	private:
+		friend class mpsc_queue;
+
+		producer(mpsc_queue *q, size_type idx) : queue(q), index(idx)
+		{
+		}
+
+		void
+		release() noexcept
+		{
+			if (queue != nullptr)
+				queue->unregister_producer(index);
+
+			queue = nullptr;
+		}
+
+		mpsc_queue *queue;
+		size_type index;
+	}; /* class producer */
+
+	/**
+	 * Construct an empty queue with a ring of at least @arg capacity
+	 * records for each of @arg max_producers producers. The capacity is
+	 * rounded up to a power of two.
+	 *
+	 * @pre must be called in transaction scope.
+	 *
+	 * @throw std::invalid_argument if max_producers or capacity is 0.
+	 * @throw std::length_error if the rings do not fit in a single
+	 * allocation.
+	 * @throw pmem::transaction_alloc_error when allocation failed.
+	 */
+	mpsc_queue(size_type max_producers, size_type capacity)
+	{
+		if (max_producers == 0 || capacity == 0)
+			throw std::invalid_argument(
+				"mpsc_queue requires at least one producer and "
+				"non-zero capacity");
+
+		size_type ring_size = static_cast<size_type>(
+			detail::next_pow_2(static_cast<uint64_t>(capacity)));
+		if (ring_size > PMEMOBJ_MAX_ALLOC_SIZE / sizeof(value_type) /
+				max_producers)
+			throw std::length_error("Capacity exceeds max size.");
+
+		my_capacity = ring_size;
+		my_max_producers = max_producers;
+		my_rings = make_persistent<internal::mpsc_queue_ring[]>(
+			max_producers);
+
+		persistent_ptr<T[]> res = pmemobj_tx_alloc(
+			sizeof(value_type) * ring_size * max_producers,
+			detail::type_num<value_type>());
+		if (res == nullptr)
+			throw transaction_alloc_error(
+				"Failed to allocate persistent memory object");
+
+		my_data = res;
+	}
+
+	mpsc_queue(const mpsc_queue &) = delete;
+	mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+	/**
+	 * Destroy the queue together with all records which were not
+	 * consumed.
+	 */
+	~mpsc_queue()
+	{
+		free_data();
+	}
+
+	/**
+	 * Register a new producer, which takes over a ring no other producer
+	 * uses at the moment. Thread safe.
+	 *
+	 * @throw std::length_error if max_producers() producers are already
+	 * registered.
+	 */
+	producer
+	register_producer()
+	{
+		for (size_type i = 0; i < my_max_producers; ++i) {
+			std::atomic<bool> &registered =
+				ring(i).registered.get(false);
+
+			bool expected = false;
+			if (registered.compare_exchange_strong(expected, true))
+				return producer(this, i);
+		}
+
+		throw std::length_error(
+			"All producers of mpsc_queue are registered.");
+	}
+
+	/**
+	 * Hand all published records to @arg f and remove them from the
+	 * queue. @arg f is called with a const_range once for every
+	 * contiguous part of a ring, which means at most twice per producer.
+	 * The records of a ring are removed after @arg f returns for all its
+	 * parts; if @arg f throws, the records of the current ring stay in the
+	 * queue and the exception is rethrown.
+	 *
+	 * May run concurrently with producers, but not with another consumer.
+	 *
+	 * @return number of consumed records.
+	 */
+	template <typename F>
+	size_type
+	try_consume_batch(F &&f)
+	{
+		pool_base pb = get_pool();
+		size_type consumed = 0;
+
+		for (size_type i = 0; i < my_max_producers; ++i) {
+			internal::mpsc_queue_ring &r = ring(i);
+			std::atomic<uint64_t> &published = published_head(r);
+
+			uint64_t head = r.head.load(std::memory_order_relaxed);
+			uint64_t tail = r.tail.load(std::memory_order_acquire);
+			if (head == tail)
+				continue;
+
+			/*
+			 * The producer may not have persisted the tail yet,
+			 * records must not be consumed before they are durably
+			 * published.
+			 */
+			pb.persist(&r.tail, sizeof(r.tail));
+
+			const_pointer data = ring_data(i);
+			size_type n = static_cast<size_type>(tail - head);
+			size_type first = static_cast<size_type>(head) &
+				(my_capacity - 1);
+			size_type count = (std::min)(n, my_capacity - first);
+
+			f(const_range(data + first, data + first + count));
+			if (count != n)
+				f(const_range(data, data + n - count));
+
+			r.head.store(tail, std::memory_order_relaxed);
+			pb.persist(&r.head, sizeof(r.head));
+			published.store(tail, std::memory_order_release);
+
+			consumed += n;
+		}
+
+		return consumed;
+	}
+
+	/**
+	 * @return number of records in the queue. The result is exact only if
+	 * no producer or consumer runs concurrently.
+	 */
+	size_type
+	size() const
+	{
+		size_type n = 0;
+		for (size_type i = 0; i < my_max_producers; ++i) {
+			const internal::mpsc_queue_ring &r = ring(i);
+			n += static_cast<size_type>(
+				r.tail.load(std::memory_order_acquire) -
+				r.head.load(std::memory_order_acquire));
+		}
+
+		return n;
+	}
+
+	/**
+	 * @return true if there are no records in the queue. The result is
+	 * exact only if no producer or consumer runs concurrently.
+	 */
+	bool
+	empty() const
+	{
+		return size() == 0;
+	}
+
+	/**
+	 * @return number of records which fit in the ring of a single
+	 * producer.
+	 */
+	size_type
+	capacity() const noexcept
+	{
+		return my_capacity;
+	}
+
+	/**
+	 * @return maximum number of producers registered at the same time.
+	 */
+	size_type
+	max_producers() const noexcept
+	{
+		return my_max_producers;
+	}
+
+private:
+	bool
+	internal_produce(size_type idx, const_pointer first, const_pointer last)
+	{
+		internal::mpsc_queue_ring &r = ring(idx);
+		size_type n = static_cast<size_type>(last - first);
+
+		uint64_t tail = r.tail.load(std::memory_order_relaxed);
+		uint64_t head =
+			published_head(r).load(std::memory_order_acquire);
+		if (n > my_capacity - static_cast<size_type>(tail - head))
+			return false;
+
+		pool_base pb = get_pool();
+		pointer data = ring_data(idx);
+		size_type pos =
+			static_cast<size_type>(tail) & (my_capacity - 1);
+		size_type count = (std::min)(n, my_capacity - pos);
+
+		std::copy(first, first + count, data + pos);
+		pb.flush(data + pos, sizeof(value_type) * count);
+		if (count != n) {
+			std::copy(first + count, last, data);
+			pb.flush(data, sizeof(value_type) * (n - count));
+		}
+		pb.drain();
+
+		r.tail.store(tail + n, std::memory_order_release);
+		pb.persist(&r.tail, sizeof(r.tail));
+
+		return true;
+	}
+
+	void
+	unregister_producer(size_type idx) noexcept
+	{
+		ring(idx).registered.get(false).store(
+			false, std::memory_order_release);
+	}
+
+	/*
+	 * The published head is initialized from the head in every run of the
+	 * application, before the consumer changes the head in that run.
+	 */
+	std::atomic<uint64_t> &
+	published_head(internal::mpsc_queue_ring &r) const noexcept
+	{
+		return r.published_head.get(
+			r.head.load(std::memory_order_acquire));
+	}
+
+	void
+	free_data()
+	{
+		delete_persistent<internal::mpsc_queue_ring[]>(
+			my_rings, my_max_producers);
+
+		if (pmemobj_tx_free(*my_data.raw_ptr()) != 0)
+			throw transaction_free_error(
+				"failed to delete persistent memory object");
+	}
+
+	internal::mpsc_queue_ring &
+	ring(size_type idx) const
+	{
+		return my_rings.get()[idx];
+	}
+
+	pointer
+	ring_data(size_type idx) const
+	{
+		return my_data.get() + idx * my_capacity;
+	}
+
+	pool_base
+	get_pool() const noexcept
+	{
+		auto pop = pmemobj_pool_by_ptr(this);
+		assert(pop != nullptr);
+		return pool_base(pop);
+	}
+
+	p<size_type> my_capacity;
+
+	p<size_type> my_max_producers;
+
+	persistent_ptr<internal::mpsc_queue_ring[]> my_rings;
+
+	/** Records of all rings, ring i starts at index i * my_capacity. */
+	persistent_ptr<T[]> my_data;
+}; /* class mpsc_queue */
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* PMEMOBJ_MPSC_QUEUE_HPP */
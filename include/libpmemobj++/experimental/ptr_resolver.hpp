@@ -0,0 +1,138 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Pool-scoped translation of persistent pointers to direct pointers.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_PTR_RESOLVER_HPP
+#define LIBPMEMOBJ_CPP_PTR_RESOLVER_HPP
+
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj/base.h>
+
+#include <cstdint>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * pmem::obj::experimental::ptr_resolver - EXPERIMENTAL cache of the address
+ * of a single pool, which turns persistent pointers into direct pointers.
+ *
+ * persistent_ptr::get() calls pmemobj_direct(), which looks up the pool
+ * by its uuid on every dereference. The resolver performs the lookup once,
+ * remembers where the pool is mapped and then translates every pointer to
+ * the same pool with a comparison and an addition. Pointers to other pools
+ * and null pointers are handled by persistent_ptr::get().
+ *
+ * The resolver is meant to be a local object of a traversal:
+ * @code
+ * ptr_resolver r(pop);
+ * for (auto n = r.get(root->head); n != nullptr; n = r.get(n->next))
+ *	sum += n->value;
+ * @endcode
+ *
+ * The resolver must not be used after the pool is closed. It is not
+ * synchronized and should not be shared between threads.
+ */
+class ptr_resolver {
+public:
+	/**
+	 * Construct a resolver of pointers to the given pool. The address of
+	 * the pool is learned from the first pointer into it.
+	 */
+	explicit ptr_resolver(pool_base &pool) noexcept
+	    : pop(pool.handle()), uuid_lo(0), base(0)
+	{
+	}
+
+	/**
+	 * Get a direct pointer to the object pointed to by ptr.
+	 *
+	 * @return a direct pointer, nullptr for a null ptr.
+	 */
+	template <typename T>
+	typename persistent_ptr<T>::element_type *
+	get(const persistent_ptr<T> &ptr) noexcept
+	{
+		using element_type = typename persistent_ptr<T>::element_type;
+
+		const PMEMoid &oid = ptr.raw();
+		if (oid.pool_uuid_lo == uuid_lo && oid.off != 0)
+			return reinterpret_cast<element_type *>(base + oid.off);
+
+		element_type *direct = ptr.get();
+		if (direct != nullptr && uuid_lo == 0 &&
+		    pmemobj_pool_by_oid(oid) == pop) {
+			uuid_lo = oid.pool_uuid_lo;
+			base = reinterpret_cast<std::uintptr_t>(direct) -
+				oid.off;
+		}
+
+		return direct;
+	}
+
+	/**
+	 * Get a direct pointer to the object identified by oid.
+	 *
+	 * @return a direct pointer, nullptr for OID_NULL.
+	 */
+	void *
+	get(PMEMoid oid) noexcept
+	{
+		return get(persistent_ptr<void>(oid));
+	}
+
+private:
+	PMEMobjpool *pop;
+
+	/* uuid_lo and mapping address of the pool, 0 until learned */
+	uint64_t uuid_lo;
+	std::uintptr_t base;
+};
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_PTR_RESOLVER_HPP */
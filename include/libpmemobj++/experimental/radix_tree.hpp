@@ -0,0 +1,1571 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Persistent radix tree with sorted iteration.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_RADIX_TREE_HPP
+#define LIBPMEMOBJ_CPP_RADIX_TREE_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/pexceptions.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+namespace internal
+{
+
+/**
+ * Checks if T is a string of chars which exposes data() and size(), like
+ * std::string and pmem::obj::experimental::string.
+ */
+template <typename T, typename = void>
+struct is_char_string : std::false_type {
+};
+
+template <typename T>
+struct is_char_string<
+	T,
+	typename std::enable_if<
+		std::is_same<decltype(std::declval<const T &>().data()),
+			     const char *>::value &&
+		std::is_integral<decltype(
+			std::declval<const T &>().size())>::value>::type>
+	: std::true_type {
+};
+
+} /* namespace internal */
+
+/**
+ * Default view of a key of radix_tree as a sequence of bytes. The tree
+ * orders the keys by their views, compared lexicographically as unsigned
+ * bytes.
+ *
+ * Integral keys are viewed as big endian numbers with flipped sign bit, so
+ * that they are ordered by their values. Strings of chars are viewed as
+ * they are.
+ *
+ * A custom view has to be constructible from a pointer to the key and
+ * provide size() and operator[] returning the byte at the given position.
+ */
+template <typename T, typename Enable = void>
+struct bytes_view;
+
+template <typename T>
+struct bytes_view<T,
+		  typename std::enable_if<std::is_integral<T>::value>::type> {
+	using unsigned_type = typename std::make_unsigned<T>::type;
+
+	bytes_view(const T *k) : k(k)
+	{
+	}
+
+	uint8_t operator[](std::size_t p) const
+	{
+		unsigned_type v = static_cast<unsigned_type>(*k);
+
+		if (std::is_signed<T>::value)
+			v = static_cast<unsigned_type>(
+				v ^ (unsigned_type(1) << (sizeof(T) * 8 - 1)));
+
+		return static_cast<uint8_t>(v >> (8 * (sizeof(T) - 1 - p)));
+	}
+
+	constexpr std::size_t
+	size() const
+	{
+		return sizeof(T);
+	}
+
+	const T *k;
+};
+
+template <typename T>
+struct bytes_view<
+	T, typename std::enable_if<internal::is_char_string<T>::value>::type> {
+	bytes_view(const T *s) : s(s)
+	{
+	}
+
+	uint8_t operator[](std::size_t p) const
+	{
+		return static_cast<uint8_t>(s->data()[p]);
+	}
+
+	std::size_t
+	size() const
+	{
+		return static_cast<std::size_t>(s->size());
+	}
+
+	const T *s;
+};
+
+/**
+ * pmem::obj::experimental::radix_tree - EXPERIMENTAL persistent ordered
+ * map, implemented as a compressed radix tree.
+ *
+ * Every inner node of the tree splits its keys by one nibble (4 bits) of
+ * the key at a given position into 16 children. Nodes exist only where
+ * the keys differ, so a shared prefix is not stored again for every key
+ * and the height of the tree does not depend on the length of the keys.
+ * A key which is a prefix of other keys is held by the node at the
+ * position where it ends.
+ *
+ * Each element lives in a leaf, together with its key, so keys and values
+ * which fit in the small string buffer of pmem::obj::experimental::string
+ * or are scalar need no other allocation. Leaves never move, so iterators
+ * stay valid until the element is erased.
+ *
+ * All modifiers are transactional, like the ones of
+ * pmem::obj::experimental::vector, and the number of elements is
+ * persistent, so nothing has to be rebuilt after a restart.
+ *
+ * The container is not thread safe.
+ *
+ * @tparam Key integral type or pmem::obj::experimental::string, or any
+ * type supported by BytesView.
+ * @tparam Value type of the mapped values.
+ * @tparam BytesView view of a key as a sequence of bytes, see bytes_view.
+ */
+template <typename Key, typename Value, typename BytesView = bytes_view<Key>>
+class radix_tree {
+	template <bool IsConst>
+	class radix_tree_iterator;
+
+	/* Lookup keys of other types, e.g. std::string for string keys */
+	template <typename K>
+	using enable_heterogeneous = typename std::enable_if<
+		!std::is_same<typename std::decay<K>::type, Key>::value &&
+		internal::is_char_string<Key>::value &&
+		internal::is_char_string<typename std::decay<K>::type>::value &&
+		std::is_same<BytesView, bytes_view<Key>>::value>::type;
+
+public:
+	/* Member types */
+	using key_type = Key;
+	using mapped_type = Value;
+	using value_type = std::pair<const Key, Value>;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = value_type &;
+	using const_reference = const value_type &;
+	using pointer = value_type *;
+	using const_pointer = const value_type *;
+	using iterator = radix_tree_iterator<false>;
+	using const_iterator = radix_tree_iterator<true>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	/* Constructors */
+	radix_tree();
+	template <typename InputIt>
+	radix_tree(InputIt first, InputIt last);
+	radix_tree(std::initializer_list<value_type> init);
+
+	radix_tree(const radix_tree &) = delete;
+	radix_tree &operator=(const radix_tree &) = delete;
+
+	/* Destructor */
+	~radix_tree();
+
+	/* Iterators */
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	reverse_iterator rbegin();
+	reverse_iterator rend();
+	const_reverse_iterator rbegin() const;
+	const_reverse_iterator rend() const;
+
+	/* Capacity */
+	bool empty() const noexcept;
+	size_type size() const noexcept;
+
+	/* Lookup */
+	iterator
+	find(const key_type &k)
+	{
+		return iterator(this, internal_find(BytesView(&k)));
+	}
+
+	const_iterator
+	find(const key_type &k) const
+	{
+		return const_iterator(this, internal_find(BytesView(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	iterator
+	find(const K &k)
+	{
+		return iterator(this, internal_find(bytes_view<K>(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	const_iterator
+	find(const K &k) const
+	{
+		return const_iterator(this, internal_find(bytes_view<K>(&k)));
+	}
+
+	size_type
+	count(const key_type &k) const
+	{
+		return internal_find(BytesView(&k)) ? 1 : 0;
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	size_type
+	count(const K &k) const
+	{
+		return internal_find(bytes_view<K>(&k)) ? 1 : 0;
+	}
+
+	iterator
+	lower_bound(const key_type &k)
+	{
+		return iterator(this, internal_lower_bound(BytesView(&k)));
+	}
+
+	const_iterator
+	lower_bound(const key_type &k) const
+	{
+		return const_iterator(this,
+				      internal_lower_bound(BytesView(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	iterator
+	lower_bound(const K &k)
+	{
+		return iterator(this, internal_lower_bound(bytes_view<K>(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	const_iterator
+	lower_bound(const K &k) const
+	{
+		return const_iterator(this,
+				      internal_lower_bound(bytes_view<K>(&k)));
+	}
+
+	iterator
+	upper_bound(const key_type &k)
+	{
+		return iterator(this, internal_upper_bound(BytesView(&k)));
+	}
+
+	const_iterator
+	upper_bound(const key_type &k) const
+	{
+		return const_iterator(this,
+				      internal_upper_bound(BytesView(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	iterator
+	upper_bound(const K &k)
+	{
+		return iterator(this, internal_upper_bound(bytes_view<K>(&k)));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	const_iterator
+	upper_bound(const K &k) const
+	{
+		return const_iterator(this,
+				      internal_upper_bound(bytes_view<K>(&k)));
+	}
+
+	/* Modifiers */
+	std::pair<iterator, bool> insert(const value_type &v);
+	std::pair<iterator, bool> insert(value_type &&v);
+	template <typename InputIt>
+	void insert(InputIt first, InputIt last);
+	void insert(std::initializer_list<value_type> ilist);
+
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(Args &&... args);
+
+	template <typename... Args>
+	std::pair<iterator, bool> try_emplace(const key_type &k,
+					      Args &&... args);
+	template <typename... Args>
+	std::pair<iterator, bool> try_emplace(key_type &&k, Args &&... args);
+	template <typename K, typename... Args,
+		  typename = enable_heterogeneous<K>>
+	std::pair<iterator, bool> try_emplace(K &&k, Args &&... args);
+
+	template <typename M>
+	std::pair<iterator, bool> insert_or_assign(const key_type &k,
+						   M &&obj);
+	template <typename M>
+	std::pair<iterator, bool> insert_or_assign(key_type &&k, M &&obj);
+	template <typename M, typename K,
+		  typename = enable_heterogeneous<K>>
+	std::pair<iterator, bool> insert_or_assign(K &&k, M &&obj);
+
+	iterator erase(const_iterator pos);
+
+	size_type
+	erase(const key_type &k)
+	{
+		return internal_erase(BytesView(&k));
+	}
+
+	template <typename K, typename = enable_heterogeneous<K>>
+	size_type
+	erase(const K &k)
+	{
+		return internal_erase(bytes_view<K>(&k));
+	}
+
+	void clear();
+
+private:
+	/* Number of bits of the key by which a node splits its children */
+	static constexpr std::size_t slice = 4;
+	static constexpr std::size_t slots = std::size_t(1) << slice;
+	static constexpr uint8_t slice_mask = slots - 1;
+	/* Shift of the nibble of a byte which is compared first */
+	static constexpr uint8_t first_nib = 8 - slice;
+
+	struct node;
+
+	/* Common part of leaves and nodes */
+	struct tree_entry {
+		tree_entry(bool leaf) : is_leaf(leaf), parent(nullptr)
+		{
+		}
+
+		p<bool> is_leaf;
+		persistent_ptr<node> parent;
+	};
+
+	struct leaf : tree_entry {
+		template <typename... Args>
+		leaf(Args &&... args)
+		    : tree_entry(true), item(std::forward<Args>(args)...)
+		{
+		}
+
+		value_type item;
+	};
+
+	struct node : tree_entry {
+		node(size_type b, uint8_t sh)
+		    : tree_entry(false), byte(b), bit(sh)
+		{
+		}
+
+		/* Leaf whose key ends at this node, if any */
+		persistent_ptr<tree_entry> embedded_entry;
+		persistent_ptr<tree_entry> child[slots];
+
+		/* Position of the nibble by which the children are split */
+		p<size_type> byte;
+		p<uint8_t> bit;
+	};
+
+	using entry_ptr = persistent_ptr<tree_entry>;
+
+	static leaf *
+	as_leaf(tree_entry *e)
+	{
+		assert(e == nullptr || e->is_leaf);
+		return static_cast<leaf *>(e);
+	}
+
+	static node *
+	as_node(tree_entry *e)
+	{
+		assert(e == nullptr || !e->is_leaf);
+		return static_cast<node *>(e);
+	}
+
+	static std::size_t
+	slice_index(uint8_t b, uint8_t bit)
+	{
+		return static_cast<std::size_t>((b >> bit) & slice_mask);
+	}
+
+	template <typename K>
+	static entry_ptr *child_slot(node *n, const K &key);
+	static entry_ptr *slot_of(node *n, const tree_entry *e);
+	static int index_in(node *n, const tree_entry *e);
+
+	static leaf *leftmost_leaf(tree_entry *e);
+	static leaf *rightmost_leaf(tree_entry *e);
+	static leaf *next_leaf(tree_entry *e);
+	static leaf *prev_leaf(tree_entry *e);
+
+	template <typename K1, typename K2>
+	static size_type prefix_diff(const K1 &lhs, const K2 &rhs);
+	template <typename K1, typename K2>
+	static uint8_t bit_diff(const K1 &lhs, const K2 &rhs, size_type diff);
+
+	template <typename K>
+	leaf *common_prefix_leaf(const K &key) const;
+	template <typename K>
+	entry_ptr *descend(const K &key, size_type diff, uint8_t sh,
+			   node **prev) const;
+
+	template <typename K>
+	leaf *internal_find(const K &key) const;
+	template <typename K>
+	leaf *internal_lower_bound(const K &key) const;
+	template <typename K>
+	leaf *internal_upper_bound(const K &key) const;
+	template <typename K, typename F>
+	std::pair<iterator, bool> internal_emplace(const K &key, F &&make);
+	template <typename K, typename... Args>
+	std::pair<iterator, bool> internal_try_emplace(const K &key,
+						       Args &&... args);
+	template <typename K, typename M>
+	std::pair<iterator, bool> internal_insert_or_assign(K &&k, M &&obj);
+	template <typename K>
+	size_type internal_erase(const K &key);
+	void erase_leaf(leaf *l);
+	void delete_entry(entry_ptr e);
+
+	void check_pmem();
+	void check_tx_stage_work();
+	pool_base get_pool() const noexcept;
+
+	entry_ptr root;
+	p<size_type> size_;
+};
+
+/**
+ * Bidirectional iterator over the leaves of radix_tree in the order of the
+ * keys.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <bool IsConst>
+class radix_tree<Key, Value, BytesView>::radix_tree_iterator {
+	using tree_type = typename std::conditional<IsConst, const radix_tree,
+						    radix_tree>::type;
+
+	friend class radix_tree;
+
+	template <bool C>
+	friend class radix_tree_iterator;
+
+public:
+	using iterator_category = std::bidirectional_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+	using value_type = typename radix_tree::value_type;
+	using reference =
+		typename std::conditional<IsConst, const value_type &,
+					  value_type &>::type;
+	using pointer = typename std::conditional<IsConst, const value_type *,
+						  value_type *>::type;
+
+	radix_tree_iterator() : tree(nullptr), l(nullptr)
+	{
+	}
+
+	/** Conversion from iterator to const_iterator. */
+	template <bool C = IsConst, typename = typename std::enable_if<C>::type>
+	radix_tree_iterator(const radix_tree_iterator<false> &other)
+	    : tree(other.tree), l(other.l)
+	{
+	}
+
+	reference operator*() const
+	{
+		assert(l != nullptr);
+		return l->item;
+	}
+
+	pointer operator->() const
+	{
+		return &operator*();
+	}
+
+	radix_tree_iterator &
+	operator++()
+	{
+		assert(l != nullptr);
+		l = radix_tree::next_leaf(l);
+		return *this;
+	}
+
+	radix_tree_iterator
+	operator++(int)
+	{
+		radix_tree_iterator tmp(*this);
+		operator++();
+		return tmp;
+	}
+
+	/** Decrementing end() moves to the last element. */
+	radix_tree_iterator &
+	operator--()
+	{
+		if (l == nullptr)
+			l = radix_tree::rightmost_leaf(tree->root.get());
+		else
+			l = radix_tree::prev_leaf(l);
+
+		return *this;
+	}
+
+	radix_tree_iterator
+	operator--(int)
+	{
+		radix_tree_iterator tmp(*this);
+		operator--();
+		return tmp;
+	}
+
+	template <bool C>
+	bool
+	operator==(const radix_tree_iterator<C> &rhs) const
+	{
+		return l == rhs.l;
+	}
+
+	template <bool C>
+	bool
+	operator!=(const radix_tree_iterator<C> &rhs) const
+	{
+		return l != rhs.l;
+	}
+
+private:
+	radix_tree_iterator(tree_type *tree, leaf *l) : tree(tree), l(l)
+	{
+	}
+
+	tree_type *tree;
+	leaf *l;
+};
+
+/**
+ * Default constructor. Constructs an empty tree.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ */
+template <typename Key, typename Value, typename BytesView>
+radix_tree<Key, Value, BytesView>::radix_tree()
+{
+	check_pmem();
+	check_tx_stage_work();
+
+	root = nullptr;
+	size_ = 0;
+}
+
+/**
+ * Constructs the tree with the contents of the range [first, last). Of
+ * the elements with the same key only the first one is inserted.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw pmem::transaction_alloc_error when allocating memory for the
+ * elements failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename InputIt>
+radix_tree<Key, Value, BytesView>::radix_tree(InputIt first, InputIt last)
+    : radix_tree()
+{
+	insert(first, last);
+}
+
+/**
+ * Constructs the tree with the contents of the initializer list.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw pmem::transaction_alloc_error when allocating memory for the
+ * elements failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+radix_tree<Key, Value, BytesView>::radix_tree(
+	std::initializer_list<value_type> init)
+    : radix_tree(init.begin(), init.end())
+{
+}
+
+/**
+ * Destructor. Frees all the elements.
+ */
+template <typename Key, typename Value, typename BytesView>
+radix_tree<Key, Value, BytesView>::~radix_tree()
+{
+	clear();
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::iterator
+radix_tree<Key, Value, BytesView>::begin()
+{
+	return iterator(this, leftmost_leaf(root.get()));
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::iterator
+radix_tree<Key, Value, BytesView>::end()
+{
+	return iterator(this, nullptr);
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_iterator
+radix_tree<Key, Value, BytesView>::begin() const
+{
+	return const_iterator(this, leftmost_leaf(root.get()));
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_iterator
+radix_tree<Key, Value, BytesView>::end() const
+{
+	return const_iterator(this, nullptr);
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_iterator
+radix_tree<Key, Value, BytesView>::cbegin() const
+{
+	return begin();
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_iterator
+radix_tree<Key, Value, BytesView>::cend() const
+{
+	return end();
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::reverse_iterator
+radix_tree<Key, Value, BytesView>::rbegin()
+{
+	return reverse_iterator(end());
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::reverse_iterator
+radix_tree<Key, Value, BytesView>::rend()
+{
+	return reverse_iterator(begin());
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_reverse_iterator
+radix_tree<Key, Value, BytesView>::rbegin() const
+{
+	return const_reverse_iterator(end());
+}
+
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::const_reverse_iterator
+radix_tree<Key, Value, BytesView>::rend() const
+{
+	return const_reverse_iterator(begin());
+}
+
+/**
+ * Checks whether the container is empty.
+ *
+ * @return true if container is empty, false otherwise.
+ */
+template <typename Key, typename Value, typename BytesView>
+bool
+radix_tree<Key, Value, BytesView>::empty() const noexcept
+{
+	return root == nullptr;
+}
+
+/**
+ * @return number of elements, which is kept persistent and valid after a
+ * restart.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::size_type
+radix_tree<Key, Value, BytesView>::size() const noexcept
+{
+	return size_;
+}
+
+/**
+ * Inserts the element unless an element with the same key exists.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::insert(const value_type &v)
+{
+	return internal_try_emplace(BytesView(&v.first), v);
+}
+
+/**
+ * Inserts the element unless an element with the same key exists. The
+ * element is moved from only if it is inserted.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::insert(value_type &&v)
+{
+	return internal_try_emplace(BytesView(&v.first), std::move(v));
+}
+
+/**
+ * Inserts the elements of the range [first, last) in a single
+ * transaction.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename InputIt>
+void
+radix_tree<Key, Value, BytesView>::insert(InputIt first, InputIt last)
+{
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		for (; first != last; ++first)
+			insert(*first);
+	});
+}
+
+/**
+ * Inserts the elements of the initializer list in a single transaction.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::insert(
+	std::initializer_list<value_type> ilist)
+{
+	insert(ilist.begin(), ilist.end());
+}
+
+/**
+ * Constructs the element from @arg args in persistent memory and inserts
+ * it unless an element with the same key exists, in which case the new
+ * element is destroyed in the same transaction.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename... Args>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::emplace(Args &&... args)
+{
+	std::pair<iterator, bool> ret;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		persistent_ptr<leaf> l =
+			make_persistent<leaf>(std::forward<Args>(args)...);
+
+		ret = internal_emplace(BytesView(&l->item.first),
+				       [&] { return l; });
+
+		if (!ret.second)
+			delete_persistent<leaf>(l);
+	});
+
+	return ret;
+}
+
+/**
+ * Inserts the element with key @arg k and the value constructed from
+ * @arg args unless an element with the key exists. Nothing is constructed
+ * otherwise.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename... Args>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::try_emplace(const key_type &k,
+					       Args &&... args)
+{
+	return internal_try_emplace(
+		BytesView(&k), std::piecewise_construct,
+		std::forward_as_tuple(k),
+		std::forward_as_tuple(std::forward<Args>(args)...));
+}
+
+/**
+ * Inserts the element with key @arg k and the value constructed from
+ * @arg args unless an element with the key exists. Nothing is constructed
+ * or moved from otherwise.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename... Args>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::try_emplace(key_type &&k, Args &&... args)
+{
+	return internal_try_emplace(
+		BytesView(&k), std::piecewise_construct,
+		std::forward_as_tuple(std::move(k)),
+		std::forward_as_tuple(std::forward<Args>(args)...));
+}
+
+/**
+ * Inserts the element with the key constructed from @arg k, e.g. a string
+ * key from std::string, and the value constructed from @arg args unless an
+ * element with the key exists. Nothing is constructed otherwise.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K, typename... Args, typename>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::try_emplace(K &&k, Args &&... args)
+{
+	using view_type = bytes_view<typename std::decay<K>::type>;
+
+	return internal_try_emplace(
+		view_type(&k), std::piecewise_construct,
+		std::forward_as_tuple(std::forward<K>(k)),
+		std::forward_as_tuple(std::forward<Args>(args)...));
+}
+
+/**
+ * Assigns @arg obj to the value of the element with key @arg k or inserts
+ * a new element if there is no such key.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor or assignment exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename M>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::insert_or_assign(const key_type &k,
+						    M &&obj)
+{
+	return internal_insert_or_assign(k, std::forward<M>(obj));
+}
+
+/**
+ * Assigns @arg obj to the value of the element with key @arg k or inserts
+ * a new element if there is no such key.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor or assignment exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename M>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::insert_or_assign(key_type &&k, M &&obj)
+{
+	return internal_insert_or_assign(std::move(k), std::forward<M>(obj));
+}
+
+/**
+ * Assigns @arg obj to the value of the element with the key constructed
+ * from @arg k or inserts a new element if there is no such key.
+ *
+ * @return iterator to the element with the key and true if the element
+ * was inserted.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ * @throw rethrows element constructor or assignment exception.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename M, typename K, typename>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::insert_or_assign(K &&k, M &&obj)
+{
+	return internal_insert_or_assign(std::forward<K>(k),
+					 std::forward<M>(obj));
+}
+
+/**
+ * Removes the element at @arg pos.
+ *
+ * @return iterator following the removed element.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_free_error when freeing the memory failed.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::iterator
+radix_tree<Key, Value, BytesView>::erase(const_iterator pos)
+{
+	leaf *l = pos.l;
+	leaf *next = next_leaf(l);
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] { erase_leaf(l); });
+
+	return iterator(this, next);
+}
+
+/**
+ * Removes all elements in a single transaction.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_free_error when freeing the memory failed.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::clear()
+{
+	if (root == nullptr)
+		return;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		delete_entry(root);
+
+		root = nullptr;
+		size_ = 0;
+	});
+}
+
+/**
+ * Slot of @arg n to which the @arg key belongs.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::entry_ptr *
+radix_tree<Key, Value, BytesView>::child_slot(node *n, const K &key)
+{
+	if (n->byte == key.size())
+		return &n->embedded_entry;
+
+	return &n->child[slice_index(key[n->byte], n->bit)];
+}
+
+/**
+ * Slot of @arg n which holds @arg e.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::entry_ptr *
+radix_tree<Key, Value, BytesView>::slot_of(node *n, const tree_entry *e)
+{
+	int i = index_in(n, e);
+
+	return i < 0 ? &n->embedded_entry : &n->child[i];
+}
+
+/**
+ * Index of the child @arg e of @arg n, -1 for the embedded entry.
+ *
+ * @throw std::runtime_error if @arg e is not a child of @arg n, which
+ * means the tree is inconsistent.
+ */
+template <typename Key, typename Value, typename BytesView>
+int
+radix_tree<Key, Value, BytesView>::index_in(node *n, const tree_entry *e)
+{
+	if (n->embedded_entry.get() == e)
+		return -1;
+
+	for (std::size_t i = 0; i < slots; ++i) {
+		if (n->child[i].get() == e)
+			return static_cast<int>(i);
+	}
+
+	throw std::runtime_error("radix_tree: entry is not a child of its "
+				 "parent node");
+}
+
+/**
+ * The leaf with the smallest key in the subtree of @arg e.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::leftmost_leaf(tree_entry *e)
+{
+	while (e != nullptr && !e->is_leaf) {
+		node *n = as_node(e);
+
+		e = n->embedded_entry.get();
+		for (std::size_t i = 0; e == nullptr && i < slots; ++i)
+			e = n->child[i].get();
+	}
+
+	return as_leaf(e);
+}
+
+/**
+ * The leaf with the greatest key in the subtree of @arg e.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::rightmost_leaf(tree_entry *e)
+{
+	while (e != nullptr && !e->is_leaf) {
+		node *n = as_node(e);
+
+		e = nullptr;
+		for (std::size_t i = slots; e == nullptr && i > 0; --i)
+			e = n->child[i - 1].get();
+
+		if (e == nullptr)
+			e = n->embedded_entry.get();
+	}
+
+	return as_leaf(e);
+}
+
+/**
+ * The first leaf after the subtree of @arg e.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::next_leaf(tree_entry *e)
+{
+	for (node *n = e->parent.get(); n != nullptr;
+	     e = n, n = n->parent.get()) {
+		for (int i = index_in(n, e) + 1; i < int(slots); ++i) {
+			if (n->child[i] != nullptr)
+				return leftmost_leaf(n->child[i].get());
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * The last leaf before the subtree of @arg e.
+ */
+template <typename Key, typename Value, typename BytesView>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::prev_leaf(tree_entry *e)
+{
+	for (node *n = e->parent.get(); n != nullptr;
+	     e = n, n = n->parent.get()) {
+		int i = index_in(n, e);
+
+		if (i < 0)
+			continue;
+
+		while (i-- > 0) {
+			if (n->child[i] != nullptr)
+				return rightmost_leaf(n->child[i].get());
+		}
+
+		if (n->embedded_entry != nullptr)
+			return as_leaf(n->embedded_entry.get());
+	}
+
+	return nullptr;
+}
+
+/**
+ * Length of the common prefix of the keys, in bytes.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K1, typename K2>
+typename radix_tree<Key, Value, BytesView>::size_type
+radix_tree<Key, Value, BytesView>::prefix_diff(const K1 &lhs, const K2 &rhs)
+{
+	size_type diff = 0;
+
+	while (diff < lhs.size() && diff < rhs.size() &&
+	       lhs[diff] == rhs[diff])
+		++diff;
+
+	return diff;
+}
+
+/**
+ * Shift of the first differing nibble of the byte @arg diff, first_nib if
+ * one of the keys ends there.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K1, typename K2>
+uint8_t
+radix_tree<Key, Value, BytesView>::bit_diff(const K1 &lhs, const K2 &rhs,
+					    size_type diff)
+{
+	if (diff < lhs.size() && diff < rhs.size() &&
+	    ((lhs[diff] ^ rhs[diff]) >> first_nib) == 0)
+		return 0;
+
+	return first_nib;
+}
+
+/**
+ * Walk down along @arg key as long as possible and return a leaf of the
+ * subtree where the walk stopped. All keys of the subtree share the same
+ * prefix up to the position of its root, so the leaf tells where the key
+ * differs from them.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::common_prefix_leaf(const K &key) const
+{
+	tree_entry *e = root.get();
+
+	while (e != nullptr && !e->is_leaf) {
+		node *n = as_node(e);
+
+		if (n->byte >= key.size())
+			return leftmost_leaf(n);
+
+		tree_entry *next = child_slot(n, key)->get();
+		if (next == nullptr)
+			return leftmost_leaf(n);
+
+		e = next;
+	}
+
+	return as_leaf(e);
+}
+
+/**
+ * Walk down along @arg key through the nodes placed before the position
+ * (@arg diff, @arg sh) where the key differs from the tree. Returns the
+ * slot at which the walk stopped and sets @arg prev to the node holding
+ * it, nullptr for the root.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::entry_ptr *
+radix_tree<Key, Value, BytesView>::descend(const K &key, size_type diff,
+					   uint8_t sh, node **prev) const
+{
+	entry_ptr *slot = const_cast<entry_ptr *>(&root);
+	*prev = nullptr;
+
+	while (*slot != nullptr && !(*slot)->is_leaf) {
+		node *n = as_node(slot->get());
+
+		if (n->byte > diff || (n->byte == diff && n->bit < sh))
+			break;
+
+		*prev = n;
+		slot = child_slot(n, key);
+	}
+
+	return slot;
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::internal_find(const K &key) const
+{
+	leaf *l = common_prefix_leaf(key);
+
+	if (l == nullptr)
+		return nullptr;
+
+	BytesView leaf_key(&l->item.first);
+
+	if (leaf_key.size() != key.size() ||
+	    prefix_diff(leaf_key, key) != key.size())
+		return nullptr;
+
+	return l;
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::internal_lower_bound(const K &key) const
+{
+	leaf *l = common_prefix_leaf(key);
+
+	if (l == nullptr)
+		return nullptr;
+
+	BytesView leaf_key(&l->item.first);
+	size_type diff = prefix_diff(key, leaf_key);
+
+	if (diff == key.size() && diff == leaf_key.size())
+		return l;
+
+	node *prev;
+	entry_ptr *slot = descend(key, diff, bit_diff(key, leaf_key, diff),
+				  &prev);
+
+	if (*slot == nullptr) {
+		/* the key falls into an empty slot of prev */
+		assert(prev != nullptr);
+
+		if (slot == &prev->embedded_entry)
+			return leftmost_leaf(prev);
+
+		for (std::size_t i = std::size_t(slot - prev->child) + 1;
+		     i < slots; ++i) {
+			if (prev->child[i] != nullptr)
+				return leftmost_leaf(prev->child[i].get());
+		}
+
+		return next_leaf(prev);
+	}
+
+	/* the whole subtree is either greater or less than the key */
+	if (diff == key.size() ||
+	    (diff < leaf_key.size() && key[diff] < leaf_key[diff]))
+		return leftmost_leaf(slot->get());
+
+	return next_leaf(slot->get());
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::leaf *
+radix_tree<Key, Value, BytesView>::internal_upper_bound(const K &key) const
+{
+	leaf *l = internal_lower_bound(key);
+
+	if (l == nullptr)
+		return nullptr;
+
+	BytesView leaf_key(&l->item.first);
+
+	if (leaf_key.size() == key.size() &&
+	    prefix_diff(leaf_key, key) == key.size())
+		return next_leaf(l);
+
+	return l;
+}
+
+/**
+ * Links the leaf returned by @arg make unless there is a leaf with
+ * @arg key. Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView>
+template <typename K, typename F>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::internal_emplace(const K &key, F &&make)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+
+	leaf *l = common_prefix_leaf(key);
+
+	if (l == nullptr) {
+		root = make();
+		size_ = size_ + 1;
+
+		return {iterator(this, as_leaf(root.get())), true};
+	}
+
+	BytesView leaf_key(&l->item.first);
+	size_type diff = prefix_diff(key, leaf_key);
+
+	if (diff == key.size() && diff == leaf_key.size())
+		return {iterator(this, l), false};
+
+	uint8_t sh = bit_diff(key, leaf_key, diff);
+	node *prev;
+	entry_ptr *slot = descend(key, diff, sh, &prev);
+
+	persistent_ptr<leaf> new_leaf = make();
+
+	if (*slot == nullptr) {
+		new_leaf->parent = prev;
+		*slot = new_leaf;
+	} else {
+		/* split the subtree at the position of the difference */
+		persistent_ptr<node> n = make_persistent<node>(diff, sh);
+
+		n->parent = prev;
+		*child_slot(n.get(), leaf_key) = *slot;
+		(*slot)->parent = n;
+		*child_slot(n.get(), key) = new_leaf;
+		new_leaf->parent = n;
+		*slot = n;
+	}
+
+	size_ = size_ + 1;
+
+	return {iterator(this, new_leaf.get()), true};
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K, typename... Args>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::internal_try_emplace(const K &key,
+							Args &&... args)
+{
+	leaf *l = internal_find(key);
+
+	if (l != nullptr)
+		return {iterator(this, l), false};
+
+	std::pair<iterator, bool> ret;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		ret = internal_emplace(key, [&] {
+			return make_persistent<leaf>(
+				std::forward<Args>(args)...);
+		});
+	});
+
+	return ret;
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K, typename M>
+std::pair<typename radix_tree<Key, Value, BytesView>::iterator, bool>
+radix_tree<Key, Value, BytesView>::internal_insert_or_assign(K &&k, M &&obj)
+{
+	std::pair<iterator, bool> ret;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		ret = try_emplace(std::forward<K>(k), std::forward<M>(obj));
+
+		if (!ret.second)
+			ret.first->second = std::forward<M>(obj);
+	});
+
+	return ret;
+}
+
+template <typename Key, typename Value, typename BytesView>
+template <typename K>
+typename radix_tree<Key, Value, BytesView>::size_type
+radix_tree<Key, Value, BytesView>::internal_erase(const K &key)
+{
+	leaf *l = internal_find(key);
+
+	if (l == nullptr)
+		return 0;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] { erase_leaf(l); });
+
+	return 1;
+}
+
+/**
+ * Unlinks and frees @arg l. A node left with a single entry is replaced
+ * by the entry. Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::erase_leaf(leaf *l)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+
+	node *n = l->parent.get();
+
+	if (n == nullptr) {
+		root = nullptr;
+	} else {
+		*slot_of(n, l) = nullptr;
+
+		entry_ptr only = n->embedded_entry;
+		std::size_t entries = only != nullptr ? 1 : 0;
+
+		for (std::size_t i = 0; i < slots; ++i) {
+			if (n->child[i] != nullptr) {
+				only = n->child[i];
+				++entries;
+			}
+		}
+
+		assert(entries > 0);
+
+		if (entries == 1) {
+			node *parent = n->parent.get();
+			entry_ptr *slot =
+				parent ? slot_of(parent, n) : &root;
+
+			*slot = only;
+			only->parent = n->parent;
+			delete_persistent<node>(persistent_ptr<node>(n));
+		}
+	}
+
+	delete_persistent<leaf>(persistent_ptr<leaf>(l));
+	size_ = size_ - 1;
+}
+
+/**
+ * Frees the subtree of @arg e. Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::delete_entry(entry_ptr e)
+{
+	if (e == nullptr)
+		return;
+
+	if (e->is_leaf) {
+		delete_persistent<leaf>(persistent_ptr<leaf>(as_leaf(e.get())));
+		return;
+	}
+
+	persistent_ptr<node> n(as_node(e.get()));
+
+	delete_entry(n->embedded_entry);
+	for (std::size_t i = 0; i < slots; ++i)
+		delete_entry(n->child[i]);
+
+	delete_persistent<node>(n);
+}
+
+/**
+ * Private helper function. Checks if the tree resides on pmem and throws
+ * an exception if not.
+ *
+ * @throw pool_error if the tree doesn't reside on pmem.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::check_pmem()
+{
+	if (nullptr == pmemobj_pool_by_ptr(this))
+		throw pool_error("Invalid pool handle.");
+}
+
+/**
+ * Private helper function. Checks if current transaction stage is equal to
+ * TX_STAGE_WORK and throws an exception otherwise.
+ *
+ * @throw pmem::transaction_error if current transaction stage is not equal to
+ * TX_STAGE_WORK.
+ */
+template <typename Key, typename Value, typename BytesView>
+void
+radix_tree<Key, Value, BytesView>::check_tx_stage_work()
+{
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw transaction_error(
+			"Function called out of transaction scope.");
+}
+
+/**
+ * Private helper function.
+ *
+ * @return reference to pool_base object where the tree resides.
+ */
+template <typename Key, typename Value, typename BytesView>
+pool_base
+radix_tree<Key, Value, BytesView>::get_pool() const noexcept
+{
+	auto pop = pmemobj_pool_by_ptr(this);
+	assert(pop != nullptr);
+	return pool_base(pop);
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_RADIX_TREE_HPP */
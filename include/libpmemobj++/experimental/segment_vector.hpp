@@ -0,0 +1,1822 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * Persistent vector built from power-of-two segments.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_SEGMENT_VECTOR_HPP
+#define LIBPMEMOBJ_CPP_SEGMENT_VECTOR_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/iterator_traits.hpp>
+#include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+namespace internal
+{
+
+/**
+ * Random access iterator over pmem::obj::experimental::segment_vector.
+ *
+ * The iterator stores the container and an element index, so it is not
+ * invalidated when the container grows. Dereferencing a non-const iterator
+ * adds the element to the active transaction, the same as the non-const
+ * operator[] of the container does.
+ */
+template <typename Container, bool IsConst>
+class segment_vector_iterator {
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = typename Container::value_type;
+	using difference_type = typename Container::difference_type;
+	using size_type = typename Container::size_type;
+	using reference =
+		typename std::conditional<IsConst, const value_type &,
+					  value_type &>::type;
+	using pointer = typename std::conditional<IsConst, const value_type *,
+						  value_type *>::type;
+	using container_pointer =
+		typename std::conditional<IsConst, const Container *,
+					  Container *>::type;
+
+	segment_vector_iterator() noexcept : container(nullptr), index(0)
+	{
+	}
+
+	segment_vector_iterator(container_pointer c, size_type idx) noexcept
+	    : container(c), index(idx)
+	{
+	}
+
+	/**
+	 * Conversion from a non-const to a const iterator.
+	 */
+	template <bool C = IsConst,
+		  typename = typename std::enable_if<C>::type>
+	segment_vector_iterator(
+		const segment_vector_iterator<Container, false> &other) noexcept
+	    : container(other.container), index(other.index)
+	{
+	}
+
+	reference operator*() const
+	{
+		return (*container)[index];
+	}
+
+	pointer operator->() const
+	{
+		return &(*container)[index];
+	}
+
+	reference operator[](difference_type n) const
+	{
+		return (*container)[index + static_cast<size_type>(n)];
+	}
+
+	segment_vector_iterator &
+	operator++() noexcept
+	{
+		++index;
+		return *this;
+	}
+
+	segment_vector_iterator
+	operator++(int) noexcept
+	{
+		segment_vector_iterator tmp = *this;
+		++index;
+		return tmp;
+	}
+
+	segment_vector_iterator &
+	operator--() noexcept
+	{
+		--index;
+		return *this;
+	}
+
+	segment_vector_iterator
+	operator--(int) noexcept
+	{
+		segment_vector_iterator tmp = *this;
+		--index;
+		return tmp;
+	}
+
+	segment_vector_iterator &
+	operator+=(difference_type n) noexcept
+	{
+		index += static_cast<size_type>(n);
+		return *this;
+	}
+
+	segment_vector_iterator &
+	operator-=(difference_type n) noexcept
+	{
+		index -= static_cast<size_type>(n);
+		return *this;
+	}
+
+	segment_vector_iterator
+	operator+(difference_type n) const noexcept
+	{
+		size_type idx = index + static_cast<size_type>(n);
+		return segment_vector_iterator(container, idx);
+	}
+
+	friend segment_vector_iterator
+	operator+(difference_type n, const segment_vector_iterator &it) noexcept
+	{
+		return it + n;
+	}
+
+	segment_vector_iterator
+	operator-(difference_type n) const noexcept
+	{
+		size_type idx = index - static_cast<size_type>(n);
+		return segment_vector_iterator(container, idx);
+	}
+
+	template <bool C>
+	difference_type
+	operator-(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return static_cast<difference_type>(index) -
+			static_cast<difference_type>(rhs.index);
+	}
+
+	template <bool C>
+	bool
+	operator==(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index == rhs.index;
+	}
+
+	template <bool C>
+	bool
+	operator!=(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index != rhs.index;
+	}
+
+	template <bool C>
+	bool
+	operator<(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index < rhs.index;
+	}
+
+	template <bool C>
+	bool
+	operator>(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index > rhs.index;
+	}
+
+	template <bool C>
+	bool
+	operator<=(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index <= rhs.index;
+	}
+
+	template <bool C>
+	bool
+	operator>=(const segment_vector_iterator<Container, C> &rhs) const
+		noexcept
+	{
+		return index >= rhs.index;
+	}
+
+private:
+	template <typename, bool>
+	friend class segment_vector_iterator;
+
+	container_pointer container;
+	size_type index;
+};
+
+} /* namespace internal */
+
+/**
+ * pmem::obj::experimental::segment_vector - EXPERIMENTAL persistent container
+ * with a subset of the std::vector interface, built from power-of-two
+ * segments.
+ *
+ * Unlike pmem::obj::experimental::vector, the elements are not stored in a
+ * single array. Segment 0 holds the first 2^first_segment_bits elements and
+ * every next segment is as big as all the previous ones together, until the
+ * size of a segment reaches the largest power of two which fits into
+ * PMEMOBJ_MAX_ALLOC_SIZE. From that point on all segments have the same size.
+ *
+ * Growing the container only allocates the next segment, existing elements
+ * are never moved or copied. Pointers and references to the elements stay
+ * valid until the element is removed. The price is that the elements are not
+ * contiguous, so there is no data() and the iterators are random access, but
+ * not contiguous.
+ */
+template <typename T>
+class segment_vector {
+public:
+	/* Member types */
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = value_type &;
+	using const_reference = const value_type &;
+	using pointer = value_type *;
+	using const_pointer = const value_type *;
+	using iterator =
+		internal::segment_vector_iterator<segment_vector, false>;
+	using const_iterator =
+		internal::segment_vector_iterator<segment_vector, true>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	/* Constructors */
+	segment_vector();
+	segment_vector(size_type count, const value_type &value);
+	explicit segment_vector(size_type count);
+	template <typename InputIt,
+		  typename std::enable_if<
+			  detail::is_input_iterator<InputIt>::value,
+			  InputIt>::type * = nullptr>
+	segment_vector(InputIt first, InputIt last);
+	segment_vector(const segment_vector &other);
+	segment_vector(std::initializer_list<T> init);
+
+	/* Assign operators */
+	segment_vector &operator=(const segment_vector &other);
+	segment_vector &operator=(std::initializer_list<T> ilist);
+
+	/* Assign methods */
+	void assign(size_type count, const T &value);
+	template <typename InputIt,
+		  typename std::enable_if<
+			  detail::is_input_iterator<InputIt>::value,
+			  InputIt>::type * = nullptr>
+	void assign(InputIt first, InputIt last);
+	void assign(std::initializer_list<T> ilist);
+
+	/* Destructor */
+	~segment_vector();
+
+	/* Element access */
+	reference at(size_type n);
+	const_reference at(size_type n) const;
+	const_reference const_at(size_type n) const;
+	reference operator[](size_type n);
+	const_reference operator[](size_type n) const;
+	reference front();
+	const_reference front() const;
+	const_reference cfront() const;
+	reference back();
+	const_reference back() const;
+	const_reference cback() const;
+
+	/* Iterators */
+	iterator begin();
+	const_iterator begin() const noexcept;
+	const_iterator cbegin() const noexcept;
+	iterator end();
+	const_iterator end() const noexcept;
+	const_iterator cend() const noexcept;
+	reverse_iterator rbegin();
+	const_reverse_iterator rbegin() const noexcept;
+	const_reverse_iterator crbegin() const noexcept;
+	reverse_iterator rend();
+	const_reverse_iterator rend() const noexcept;
+	const_reverse_iterator crend() const noexcept;
+
+	/* Capacity */
+	bool empty() const noexcept;
+	size_type size() const noexcept;
+	size_type max_size() const noexcept;
+	void reserve(size_type capacity_new);
+	size_type capacity() const noexcept;
+	void shrink_to_fit();
+
+	/* Modifiers */
+	void clear();
+	void free_data();
+	template <class... Args>
+	reference emplace_back(Args &&... args);
+	void push_back(const T &value);
+	void push_back(T &&value);
+	void pop_back();
+	void resize(size_type count);
+	void resize(size_type count, const value_type &value);
+	void swap(segment_vector &other);
+
+private:
+	/* Number of elements in segment 0, as a power of two */
+	static constexpr size_type first_segment_bits = 3;
+	/* Number of elements in the biggest segment, as a power of two */
+	static constexpr size_type big_segment_bits =
+		detail::static_log2(PMEMOBJ_MAX_ALLOC_SIZE / sizeof(T));
+	/* Index of the first segment of the biggest size */
+	static constexpr size_type first_big_segment =
+		big_segment_bits - first_segment_bits + 1;
+	/* Size of the segment table */
+	static constexpr size_type max_segments = 64;
+
+	static_assert(big_segment_bits >= first_segment_bits,
+		      "value_type is too big for segment_vector");
+
+	/* segment layout */
+	static size_type segment_of(size_type idx) noexcept;
+	static size_type segment_base(size_type k) noexcept;
+	static size_type segment_size(size_type k) noexcept;
+	static size_type segments_for(size_type count) noexcept;
+
+	/* helper functions */
+	void alloc_segments(size_type segments_new);
+	void check_pmem();
+	void check_tx_stage_work();
+	template <typename... Args>
+	void construct(size_type idx, size_type count, Args &&... args);
+	template <typename InputIt,
+		  typename std::enable_if<
+			  detail::is_input_iterator<InputIt>::value,
+			  InputIt>::type * = nullptr>
+	void construct_range(size_type idx, InputIt first, InputIt last);
+	void dealloc_segments(size_type segments_new);
+	pointer element(size_type idx) const noexcept;
+	template <typename F>
+	void for_each_chunk(size_type first, size_type last, F f) const;
+	pool_base get_pool() const noexcept;
+	void shrink(size_type size_new);
+	void snapshot_data(size_type idx_first, size_type idx_last);
+
+	p<size_type> _size;
+	p<size_type> _segments_used;
+
+	/* Segment table, only the first _segments_used entries are allocated */
+	persistent_ptr<T[]> _segments[max_segments];
+};
+
+/* Non-member swap */
+template <typename T>
+void swap(segment_vector<T> &lhs, segment_vector<T> &rhs);
+
+/* Comparison operators */
+template <typename T>
+bool operator==(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+template <typename T>
+bool operator!=(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+template <typename T>
+bool operator<(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+template <typename T>
+bool operator<=(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+template <typename T>
+bool operator>(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+template <typename T>
+bool operator>=(const segment_vector<T> &lhs, const segment_vector<T> &rhs);
+
+/**
+ * Default constructor. Constructs an empty container.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ */
+template <typename T>
+segment_vector<T>::segment_vector()
+{
+	check_pmem();
+	check_tx_stage_work();
+
+	_size = 0;
+	_segments_used = 0;
+}
+
+/**
+ * Constructs the container with count copies of elements with value value.
+ *
+ * @param[in] count number of elements to construct.
+ * @param[in] value value of all constructed elements.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw std::length_error if count > max_size().
+ * @throw rethrows element constructor exception.
+ */
+template <typename T>
+segment_vector<T>::segment_vector(size_type count, const value_type &value)
+    : segment_vector()
+{
+	assign(count, value);
+}
+
+/**
+ * Constructs the container with count default inserted instances of T.
+ *
+ * @param[in] count number of elements to construct.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw std::length_error if count > max_size().
+ * @throw rethrows element constructor exception.
+ */
+template <typename T>
+segment_vector<T>::segment_vector(size_type count) : segment_vector()
+{
+	resize(count);
+}
+
+/**
+ * Constructs the container with the contents of the range [first, last).
+ *
+ * @param[in] first first iterator.
+ * @param[in] last last iterator.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw std::length_error if std::distance(first, last) > max_size().
+ * @throw rethrows element constructor exception.
+ */
+template <typename T>
+template <typename InputIt,
+	  typename std::enable_if<detail::is_input_iterator<InputIt>::value,
+				  InputIt>::type *>
+segment_vector<T>::segment_vector(InputIt first, InputIt last)
+    : segment_vector()
+{
+	assign(first, last);
+}
+
+/**
+ * Copy constructor. Constructs the container with the copy of the contents
+ * of other.
+ *
+ * @param[in] other reference to the segment_vector to be copied.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw rethrows element constructor exception.
+ */
+template <typename T>
+segment_vector<T>::segment_vector(const segment_vector &other)
+    : segment_vector()
+{
+	assign(other.cbegin(), other.cend());
+}
+
+/**
+ * Constructs the container with the contents of the initializer list init.
+ *
+ * @param[in] init initializer list with content to be constructed.
+ *
+ * @pre must be called in transaction scope.
+ *
+ * @throw pmem::pool_error if an object is not in persistent memory.
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error if constructor wasn't called in transaction.
+ * @throw std::length_error if init.size() > max_size().
+ * @throw rethrows element constructor exception.
+ */
+template <typename T>
+segment_vector<T>::segment_vector(std::initializer_list<T> init)
+    : segment_vector()
+{
+	assign(init.begin(), init.end());
+}
+
+/**
+ * Copy assignment operator. Replaces the contents with a copy of the
+ * contents of other transactionally.
+ *
+ * @param[in] other reference to the segment_vector to be copied.
+ *
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+segment_vector<T> &
+segment_vector<T>::operator=(const segment_vector &other)
+{
+	if (this != &other)
+		assign(other.cbegin(), other.cend());
+
+	return *this;
+}
+
+/**
+ * Replaces the contents with those identified by initializer list ilist
+ * transactionally.
+ *
+ * @param[in] ilist initializer list with content to be assigned.
+ *
+ * @throw std::length_error if ilist.size() > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+segment_vector<T> &
+segment_vector<T>::operator=(std::initializer_list<T> ilist)
+{
+	assign(ilist.begin(), ilist.end());
+
+	return *this;
+}
+
+/**
+ * Replaces the contents with count copies of value value transactionally.
+ * Segments which are already allocated are reused, new ones are allocated
+ * only if count > capacity().
+ *
+ * @param[in] count number of elements to construct.
+ * @param[in] value value of all constructed elements.
+ *
+ * @post size() == count
+ *
+ * @throw std::length_error if count > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::assign(size_type count, const T &value)
+{
+	if (count > max_size())
+		throw std::length_error("Assignable range exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		shrink(0);
+		alloc_segments(segments_for(count));
+		construct(0, count, value);
+	});
+}
+
+/**
+ * Replaces the contents with copies of those in the range [first, last)
+ * transactionally. Segments which are already allocated are reused, new ones
+ * are allocated only if std::distance(first, last) > capacity().
+ *
+ * @param[in] first first iterator.
+ * @param[in] last last iterator.
+ *
+ * @post size() == std::distance(first, last)
+ *
+ * @throw std::length_error if std::distance(first, last) > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+template <typename InputIt,
+	  typename std::enable_if<detail::is_input_iterator<InputIt>::value,
+				  InputIt>::type *>
+void
+segment_vector<T>::assign(InputIt first, InputIt last)
+{
+	size_type count = static_cast<size_type>(std::distance(first, last));
+	if (count > max_size())
+		throw std::length_error("Assignable range exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		shrink(0);
+		alloc_segments(segments_for(count));
+		construct_range(0, first, last);
+	});
+}
+
+/**
+ * Replaces the contents with the elements from the initializer list ilist
+ * transactionally.
+ *
+ * @param[in] ilist initializer list with content to be assigned.
+ *
+ * @throw std::length_error if ilist.size() > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::assign(std::initializer_list<T> ilist)
+{
+	assign(ilist.begin(), ilist.end());
+}
+
+/**
+ * Destructor. Destroys the elements and frees all segments.
+ */
+template <typename T>
+segment_vector<T>::~segment_vector()
+{
+	free_data();
+}
+
+/**
+ * Access element at specific index with bounds checking and add it to a
+ * transaction.
+ *
+ * @param[in] n index number.
+ *
+ * @return reference to element number n.
+ *
+ * @throw std::out_of_range if n is not within the range of the container.
+ * @throw pmem::transaction_error when adding the object to the transaction
+ * failed.
+ */
+template <typename T>
+typename segment_vector<T>::reference
+segment_vector<T>::at(size_type n)
+{
+	if (n >= _size)
+		throw std::out_of_range("segment_vector::at");
+
+	return (*this)[n];
+}
+
+/**
+ * Access element at specific index with bounds checking.
+ *
+ * @param[in] n index number.
+ *
+ * @return const_reference to element number n.
+ *
+ * @throw std::out_of_range if n is not within the range of the container.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::at(size_type n) const
+{
+	return const_at(n);
+}
+
+/**
+ * Access element at specific index with bounds checking. In contrast to
+ * at(), const_at() returns const_reference regardless of whether the
+ * segment_vector is const or not.
+ *
+ * @param[in] n index number.
+ *
+ * @return const_reference to element number n.
+ *
+ * @throw std::out_of_range if n is not within the range of the container.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::const_at(size_type n) const
+{
+	if (n >= _size)
+		throw std::out_of_range("segment_vector::const_at");
+
+	return *element(n);
+}
+
+/**
+ * Access element at specific index and add it to a transaction. No bounds
+ * checking is performed.
+ *
+ * @param[in] n index number.
+ *
+ * @return reference to element number n.
+ *
+ * @throw pmem::transaction_error when adding the object to the transaction
+ * failed.
+ */
+template <typename T>
+typename segment_vector<T>::reference segment_vector<T>::operator[](size_type n)
+{
+	pointer elem = element(n);
+	detail::conditional_add_to_tx(elem);
+
+	return *elem;
+}
+
+/**
+ * Access element at specific index. No bounds checking is performed.
+ *
+ * @param[in] n index number.
+ *
+ * @return const_reference to element number n.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+	segment_vector<T>::operator[](size_type n) const
+{
+	return *element(n);
+}
+
+/**
+ * Access the first element and add it to a transaction.
+ *
+ * @return reference to the first element.
+ *
+ * @throw pmem::transaction_error when adding the object to the transaction
+ * failed.
+ */
+template <typename T>
+typename segment_vector<T>::reference
+segment_vector<T>::front()
+{
+	return (*this)[0];
+}
+
+/**
+ * Access the first element.
+ *
+ * @return const_reference to the first element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::front() const
+{
+	return *element(0);
+}
+
+/**
+ * Access the first element. In contrast to front(), cfront() returns
+ * const_reference regardless of whether the segment_vector is const or not.
+ *
+ * @return const_reference to the first element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::cfront() const
+{
+	return *element(0);
+}
+
+/**
+ * Access the last element and add it to a transaction.
+ *
+ * @return reference to the last element.
+ *
+ * @throw pmem::transaction_error when adding the object to the transaction
+ * failed.
+ */
+template <typename T>
+typename segment_vector<T>::reference
+segment_vector<T>::back()
+{
+	return (*this)[size() - 1];
+}
+
+/**
+ * Access the last element.
+ *
+ * @return const_reference to the last element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::back() const
+{
+	return *element(size() - 1);
+}
+
+/**
+ * Access the last element. In contrast to back(), cback() returns
+ * const_reference regardless of whether the segment_vector is const or not.
+ *
+ * @return const_reference to the last element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reference
+segment_vector<T>::cback() const
+{
+	return *element(size() - 1);
+}
+
+/**
+ * Returns an iterator to the beginning.
+ *
+ * @return iterator pointing to the first element in the segment_vector.
+ */
+template <typename T>
+typename segment_vector<T>::iterator
+segment_vector<T>::begin()
+{
+	return iterator(this, 0);
+}
+
+/**
+ * Returns const iterator to the beginning.
+ *
+ * @return const_iterator pointing to the first element in the segment_vector.
+ */
+template <typename T>
+typename segment_vector<T>::const_iterator
+segment_vector<T>::begin() const noexcept
+{
+	return const_iterator(this, 0);
+}
+
+/**
+ * Returns const iterator to the beginning. In contrast to begin(), cbegin()
+ * returns const_iterator regardless of whether the segment_vector is const
+ * or not.
+ *
+ * @return const_iterator pointing to the first element in the segment_vector.
+ */
+template <typename T>
+typename segment_vector<T>::const_iterator
+segment_vector<T>::cbegin() const noexcept
+{
+	return const_iterator(this, 0);
+}
+
+/**
+ * Returns an iterator to the end.
+ *
+ * @return iterator referring to the past-the-end element.
+ */
+template <typename T>
+typename segment_vector<T>::iterator
+segment_vector<T>::end()
+{
+	return iterator(this, _size);
+}
+
+/**
+ * Returns a const iterator to the end.
+ *
+ * @return const_iterator referring to the past-the-end element.
+ */
+template <typename T>
+typename segment_vector<T>::const_iterator
+segment_vector<T>::end() const noexcept
+{
+	return const_iterator(this, _size);
+}
+
+/**
+ * Returns a const iterator to the end. In contrast to end(), cend() returns
+ * const_iterator regardless of whether the segment_vector is const or not.
+ *
+ * @return const_iterator referring to the past-the-end element.
+ */
+template <typename T>
+typename segment_vector<T>::const_iterator
+segment_vector<T>::cend() const noexcept
+{
+	return const_iterator(this, _size);
+}
+
+/**
+ * Returns a reverse iterator to the beginning.
+ *
+ * @return reverse_iterator pointing to the last element.
+ */
+template <typename T>
+typename segment_vector<T>::reverse_iterator
+segment_vector<T>::rbegin()
+{
+	return reverse_iterator(end());
+}
+
+/**
+ * Returns a const reverse iterator to the beginning.
+ *
+ * @return const_reverse_iterator pointing to the last element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reverse_iterator
+segment_vector<T>::rbegin() const noexcept
+{
+	return const_reverse_iterator(cend());
+}
+
+/**
+ * Returns a const reverse iterator to the beginning. In contrast to rbegin(),
+ * crbegin() returns const_reverse_iterator regardless of whether the
+ * segment_vector is const or not.
+ *
+ * @return const_reverse_iterator pointing to the last element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reverse_iterator
+segment_vector<T>::crbegin() const noexcept
+{
+	return const_reverse_iterator(cend());
+}
+
+/**
+ * Returns a reverse iterator to the end.
+ *
+ * @return reverse_iterator pointing to the theoretical element preceding the
+ * first element.
+ */
+template <typename T>
+typename segment_vector<T>::reverse_iterator
+segment_vector<T>::rend()
+{
+	return reverse_iterator(begin());
+}
+
+/**
+ * Returns a const reverse iterator to the end.
+ *
+ * @return const_reverse_iterator pointing to the theoretical element
+ * preceding the first element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reverse_iterator
+segment_vector<T>::rend() const noexcept
+{
+	return const_reverse_iterator(cbegin());
+}
+
+/**
+ * Returns a const reverse iterator to the end. In contrast to rend(),
+ * crend() returns const_reverse_iterator regardless of whether the
+ * segment_vector is const or not.
+ *
+ * @return const_reverse_iterator pointing to the theoretical element
+ * preceding the first element.
+ */
+template <typename T>
+typename segment_vector<T>::const_reverse_iterator
+segment_vector<T>::crend() const noexcept
+{
+	return const_reverse_iterator(cbegin());
+}
+
+/**
+ * Checks whether the container is empty.
+ *
+ * @return true if container is empty, false otherwise.
+ */
+template <typename T>
+bool
+segment_vector<T>::empty() const noexcept
+{
+	return _size == 0;
+}
+
+/**
+ * @return number of elements.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::size() const noexcept
+{
+	return _size;
+}
+
+/**
+ * @return maximum number of elements the container is able to hold, which is
+ * the total size of all segments in the segment table.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::max_size() const noexcept
+{
+	return segment_base(max_segments);
+}
+
+/**
+ * Increases the capacity of the segment_vector to at least capacity_new
+ * transactionally. Only the missing segments are allocated, the elements
+ * are never moved, so iterators, pointers and references stay valid.
+ *
+ * @param[in] capacity_new new capacity.
+ *
+ * @post capacity() >= capacity_new
+ *
+ * @throw std::length_error if capacity_new > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+segment_vector<T>::reserve(size_type capacity_new)
+{
+	if (capacity_new <= capacity())
+		return;
+
+	if (capacity_new > max_size())
+		throw std::length_error("New capacity exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb,
+			 [&] { alloc_segments(segments_for(capacity_new)); });
+}
+
+/**
+ * @return number of elements that can be held in currently allocated
+ * segments.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::capacity() const noexcept
+{
+	return segment_base(_segments_used);
+}
+
+/**
+ * Frees the segments which do not hold any element transactionally. The
+ * remaining elements are not moved.
+ *
+ * @post capacity() is the total size of the segments needed to hold size()
+ * elements.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_free_error when freeing a segment failed.
+ */
+template <typename T>
+void
+segment_vector<T>::shrink_to_fit()
+{
+	if (segments_for(_size) == _segments_used)
+		return;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] { dealloc_segments(segments_for(_size)); });
+}
+
+/**
+ * Clears the content of a segment_vector transactionally. The segments are
+ * kept for reuse.
+ *
+ * @post size() == 0
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::clear()
+{
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] { shrink(0); });
+}
+
+/**
+ * Clears the content of a segment_vector and frees all segments
+ * transactionally.
+ *
+ * @post size() == 0
+ * @post capacity() == 0
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows destructor exception.
+ * @throw pmem::transaction_free_error when freeing a segment failed.
+ */
+template <typename T>
+void
+segment_vector<T>::free_data()
+{
+	if (_segments_used == 0)
+		return;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		shrink(0);
+		dealloc_segments(0);
+	});
+}
+
+/**
+ * Appends a new element to the end of the container transactionally. If
+ * size() == capacity(), the next segment is allocated. No existing element
+ * is moved or copied, so all iterators, pointers and references stay valid.
+ *
+ * @param[in] args arguments to forward to the constructor of the element.
+ *
+ * @return reference to the inserted element.
+ *
+ * @pre value_type must meet the requirements of EmplaceConstructible.
+ *
+ * @throw std::length_error if size() == max_size().
+ * @throw pmem::transaction_alloc_error when allocating a segment in
+ * transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+template <class... Args>
+typename segment_vector<T>::reference
+segment_vector<T>::emplace_back(Args &&... args)
+{
+	if (_size == max_size())
+		throw std::length_error("New size exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		if (_size == capacity())
+			alloc_segments(_segments_used + 1);
+
+		construct(_size, 1, std::forward<Args>(args)...);
+	});
+
+	return back();
+}
+
+/**
+ * Appends the given element value to the end of the container
+ * transactionally. See emplace_back() for the growth guarantees.
+ *
+ * @param[in] value the value of the element to be appended.
+ *
+ * @pre value_type must meet the requirements of CopyInsertable.
+ *
+ * @throw std::length_error if size() == max_size().
+ * @throw pmem::transaction_alloc_error when allocating a segment in
+ * transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::push_back(const T &value)
+{
+	emplace_back(value);
+}
+
+/**
+ * Appends the given element value to the end of the container
+ * transactionally. value is moved into the new element. See emplace_back()
+ * for the growth guarantees.
+ *
+ * @param[in] value the value of the element to be appended.
+ *
+ * @pre value_type must meet the requirements of MoveInsertable.
+ *
+ * @throw std::length_error if size() == max_size().
+ * @throw pmem::transaction_alloc_error when allocating a segment in
+ * transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::push_back(T &&value)
+{
+	emplace_back(std::move(value));
+}
+
+/**
+ * Removes the last element of the container transactionally. Calling
+ * pop_back on an empty container does nothing. The segment of the removed
+ * element is kept.
+ *
+ * @post size() == std::max(0, size() - 1)
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::pop_back()
+{
+	if (empty())
+		return;
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] { shrink(size() - 1); });
+}
+
+/**
+ * Resizes the container to count elements transactionally. If the current
+ * size is greater than count, the container is reduced to its first count
+ * elements. If the current size is less than count, default inserted
+ * elements are appended.
+ *
+ * @param[in] count new size of the container.
+ *
+ * @post size() == count
+ *
+ * @throw std::length_error if count > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::resize(size_type count)
+{
+	if (count > max_size())
+		throw std::length_error("New size exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		if (count <= _size) {
+			shrink(count);
+		} else {
+			alloc_segments(segments_for(count));
+			construct(_size, count - _size);
+		}
+	});
+}
+
+/**
+ * Resizes the container to count elements transactionally. If the current
+ * size is greater than count, the container is reduced to its first count
+ * elements. If the current size is less than count, additional copies of
+ * value are appended.
+ *
+ * @param[in] count new size of the container.
+ * @param[in] value the value to initialize the new elements with.
+ *
+ * @post size() == count
+ *
+ * @throw std::length_error if count > max_size().
+ * @throw pmem::transaction_alloc_error when allocating memory for segments
+ * in transaction failed.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows constructor or destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::resize(size_type count, const value_type &value)
+{
+	if (count > max_size())
+		throw std::length_error("New size exceeds max size.");
+
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		if (count <= _size) {
+			shrink(count);
+		} else {
+			alloc_segments(segments_for(count));
+			construct(_size, count - _size, value);
+		}
+	});
+}
+
+/**
+ * Exchanges the contents of the container with other transactionally. Only
+ * the segment tables are exchanged, the elements are not touched.
+ *
+ * @param[in] other the segment_vector to exchange the contents with.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+segment_vector<T>::swap(segment_vector &other)
+{
+	pool_base pb = get_pool();
+	transaction::run(pb, [&] {
+		size_type used = (std::max)(_segments_used.get_ro(),
+					    other._segments_used.get_ro());
+		for (size_type k = 0; k < used; ++k)
+			std::swap(_segments[k], other._segments[k]);
+
+		std::swap(_size, other._size);
+		std::swap(_segments_used, other._segments_used);
+	});
+}
+
+/**
+ * Private helper function.
+ *
+ * @return index of the segment which holds element number idx.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::segment_of(size_type idx) noexcept
+{
+	if (idx < (size_type(1) << first_segment_bits))
+		return 0;
+
+	size_type log = static_cast<size_type>(detail::Log2(idx));
+	if (log < big_segment_bits)
+		return log - first_segment_bits + 1;
+
+	return first_big_segment + (idx >> big_segment_bits) - 1;
+}
+
+/**
+ * Private helper function.
+ *
+ * @return index of the first element held by segment k, which is also the
+ * total size of segments [0, k).
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::segment_base(size_type k) noexcept
+{
+	if (k == 0)
+		return 0;
+
+	if (k < first_big_segment)
+		return size_type(1) << (first_segment_bits + k - 1);
+
+	return (k - first_big_segment + 1) << big_segment_bits;
+}
+
+/**
+ * Private helper function.
+ *
+ * @return number of elements held by segment k.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::segment_size(size_type k) noexcept
+{
+	if (k == 0)
+		return size_type(1) << first_segment_bits;
+
+	if (k < first_big_segment)
+		return size_type(1) << (first_segment_bits + k - 1);
+
+	return size_type(1) << big_segment_bits;
+}
+
+/**
+ * Private helper function.
+ *
+ * @return number of segments needed to hold count elements.
+ */
+template <typename T>
+typename segment_vector<T>::size_type
+segment_vector<T>::segments_for(size_type count) noexcept
+{
+	return count == 0 ? 0 : segment_of(count - 1) + 1;
+}
+
+/**
+ * Private helper function. Must be called during transaction. Allocates
+ * segments [_segments_used, segments_new). Does nothing if segments_new is
+ * not greater than the number of already allocated segments.
+ *
+ * @param[in] segments_new number of segments the container should have.
+ *
+ * @pre pmemobj_tx_stage() == TX_STAGE_WORK
+ *
+ * @throw std::length_error if segments_new > max_segments.
+ * @throw pmem::transaction_alloc_error when allocating a segment in
+ * transaction failed.
+ */
+template <typename T>
+void
+segment_vector<T>::alloc_segments(size_type segments_new)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+
+	if (segments_new > max_segments)
+		throw std::length_error("New capacity exceeds max size.");
+
+	for (size_type k = _segments_used; k < segments_new; ++k) {
+		/*
+		 * We need to cache pmemobj_tx_alloc return value and only
+		 * after that assign it to the segment table, because when
+		 * pmemobj_tx_alloc fails, it aborts transaction.
+		 */
+		persistent_ptr<T[]> res =
+			pmemobj_tx_alloc(sizeof(value_type) * segment_size(k),
+					 detail::type_num<value_type>());
+
+		if (res == nullptr)
+			throw transaction_alloc_error(
+				"Failed to allocate persistent memory object");
+
+		_segments[k] = res;
+		_segments_used = k + 1;
+	}
+}
+
+/**
+ * Private helper function. Checks if segment_vector resides on pmem and
+ * throws an exception if not.
+ *
+ * @throw pool_error if segment_vector doesn't reside on pmem.
+ */
+template <typename T>
+void
+segment_vector<T>::check_pmem()
+{
+	if (nullptr == pmemobj_pool_by_ptr(this))
+		throw pool_error("Invalid pool handle.");
+}
+
+/**
+ * Private helper function. Checks if current transaction stage is equal to
+ * TX_STAGE_WORK and throws an exception otherwise.
+ *
+ * @throw pmem::transaction_error if current transaction stage is not equal to
+ * TX_STAGE_WORK.
+ */
+template <typename T>
+void
+segment_vector<T>::check_tx_stage_work()
+{
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw transaction_error(
+			"Function called out of transaction scope.");
+}
+
+/**
+ * Private helper function. Must be called during transaction. Assumes that
+ * the segments for elements [idx, idx + count) are allocated and that
+ * idx == size(). Constructs count elements at index idx with the given
+ * arguments and persists them segment by segment.
+ *
+ * The constructed range wasn't snapshotted, so it won't be persisted
+ * automatically on tx commit if it lies in a segment allocated by an earlier
+ * transaction.
+ *
+ * @param[in] idx index of the first constructed element.
+ * @param[in] count number of elements to construct.
+ * @param[in] args arguments to forward to the constructor of the elements.
+ *
+ * @pre pmemobj_tx_stage() == TX_STAGE_WORK
+ *
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+template <typename... Args>
+void
+segment_vector<T>::construct(size_type idx, size_type count, Args &&... args)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+	assert(idx == _size);
+	assert(capacity() >= idx + count);
+
+	pool_base pb = get_pool();
+	for_each_chunk(idx, idx + count, [&](pointer dest, size_type n) {
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_ADD_TO_TX(dest, sizeof(T) * n);
+#endif
+		for (size_type i = 0; i < n; ++i)
+			detail::create<value_type, Args...>(
+				dest + i, std::forward<Args>(args)...);
+		_size += n;
+		pb.persist(dest, sizeof(T) * n);
+	});
+}
+
+/**
+ * Private helper function. Must be called during transaction. Assumes that
+ * the segments for the copied elements are allocated and that idx == size().
+ * Copy constructs elements at index idx with the contents of the range
+ * [first, last) and persists them segment by segment.
+ *
+ * @param[in] idx index of the first constructed element.
+ * @param[in] first first iterator.
+ * @param[in] last last iterator.
+ *
+ * @pre pmemobj_tx_stage() == TX_STAGE_WORK
+ *
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+template <typename InputIt,
+	  typename std::enable_if<detail::is_input_iterator<InputIt>::value,
+				  InputIt>::type *>
+void
+segment_vector<T>::construct_range(size_type idx, InputIt first, InputIt last)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+	assert(idx == _size);
+
+	size_type count = static_cast<size_type>(std::distance(first, last));
+	assert(capacity() >= idx + count);
+
+	pool_base pb = get_pool();
+	for_each_chunk(idx, idx + count, [&](pointer dest, size_type n) {
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_ADD_TO_TX(dest, sizeof(T) * n);
+#endif
+		for (size_type i = 0; i < n; ++i, ++first)
+			detail::create<value_type>(dest + i, *first);
+		_size += n;
+		pb.persist(dest, sizeof(T) * n);
+	});
+}
+
+/**
+ * Private helper function. Must be called during transaction. Frees
+ * segments [segments_new, _segments_used).
+ *
+ * @param[in] segments_new number of segments the container should keep.
+ *
+ * @pre pmemobj_tx_stage() == TX_STAGE_WORK
+ * @pre size() <= segment_base(segments_new)
+ *
+ * @throw pmem::transaction_free_error when freeing a segment failed.
+ */
+template <typename T>
+void
+segment_vector<T>::dealloc_segments(size_type segments_new)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+	assert(_size <= segment_base(segments_new));
+
+	while (_segments_used > segments_new) {
+		size_type k = _segments_used - 1;
+		if (pmemobj_tx_free(*_segments[k].raw_ptr()) != 0)
+			throw transaction_free_error(
+				"failed to delete persistent memory object");
+		_segments[k] = nullptr;
+		_segments_used = k;
+	}
+}
+
+/**
+ * Private helper function.
+ *
+ * @return pointer to element number idx.
+ *
+ * @pre the segment holding element number idx is allocated.
+ */
+template <typename T>
+typename segment_vector<T>::pointer
+segment_vector<T>::element(size_type idx) const noexcept
+{
+	size_type k = segment_of(idx);
+	assert(k < _segments_used);
+
+	return _segments[k].get() + (idx - segment_base(k));
+}
+
+/**
+ * Private helper function. Calls f(pointer, count) for every contiguous part
+ * of the range [first, last), i.e. once per segment the range spans.
+ *
+ * @param[in] first index of the first element.
+ * @param[in] last index past the last element.
+ * @param[in] f function to call.
+ */
+template <typename T>
+template <typename F>
+void
+segment_vector<T>::for_each_chunk(size_type first, size_type last, F f) const
+{
+	while (first < last) {
+		size_type k = segment_of(first);
+		size_type segment_end = segment_base(k) + segment_size(k);
+		size_type n = (std::min)(last, segment_end) - first;
+
+		f(element(first), n);
+		first += n;
+	}
+}
+
+/**
+ * Private helper function.
+ *
+ * @return reference to pool_base object where segment_vector resides.
+ *
+ * @pre segment_vector must reside in persistent memory pool.
+ */
+template <typename T>
+pool_base
+segment_vector<T>::get_pool() const noexcept
+{
+	auto pop = pmemobj_pool_by_ptr(this);
+	assert(pop != nullptr);
+	return pool_base(pop);
+}
+
+/**
+ * Private helper function. Must be called during transaction. Destroys
+ * elements [size_new, size()) after adding them to the transaction. The
+ * segments are not freed.
+ *
+ * @param[in] size_new new size of the container.
+ *
+ * @pre pmemobj_tx_stage() == TX_STAGE_WORK
+ * @pre size_new <= size()
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw rethrows destructor exception.
+ */
+template <typename T>
+void
+segment_vector<T>::shrink(size_type size_new)
+{
+	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+	assert(size_new <= _size);
+
+	snapshot_data(size_new, _size);
+
+	for_each_chunk(size_new, _size, [&](pointer dest, size_type n) {
+		for (size_type i = 0; i < n; ++i)
+			detail::destroy<value_type>(dest[i]);
+	});
+	_size = size_new;
+}
+
+/**
+ * Private helper function. Adds elements [idx_first, idx_last) to the
+ * transaction, with one range per segment.
+ *
+ * @param[in] idx_first first index.
+ * @param[in] idx_last last index.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+segment_vector<T>::snapshot_data(size_type idx_first, size_type idx_last)
+{
+	for_each_chunk(idx_first, idx_last, [](pointer dest, size_type n) {
+		detail::conditional_add_to_tx(dest, n);
+	});
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if contents of the containers are equal, false otherwise
+ */
+template <typename T>
+bool
+operator==(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return lhs.size() == rhs.size() &&
+		std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if contents of the containers are not equal, false otherwise
+ */
+template <typename T>
+bool
+operator!=(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return !(lhs == rhs);
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers
+ * lexicographically.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if lhs is lexicographically less than rhs, false otherwise
+ */
+template <typename T>
+bool
+operator<(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return std::lexicographical_compare(lhs.begin(), lhs.end(),
+					    rhs.begin(), rhs.end());
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers
+ * lexicographically.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if lhs is lexicographically less than or equal to rhs, false
+ * otherwise
+ */
+template <typename T>
+bool
+operator<=(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return !(rhs < lhs);
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers
+ * lexicographically.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if lhs is lexicographically greater than rhs, false otherwise
+ */
+template <typename T>
+bool
+operator>(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return rhs < lhs;
+}
+
+/**
+ * Comparison operator. Compares the contents of two containers
+ * lexicographically.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ *
+ * @return true if lhs is lexicographically greater than or equal to rhs,
+ * false otherwise
+ */
+template <typename T>
+bool
+operator>=(const segment_vector<T> &lhs, const segment_vector<T> &rhs)
+{
+	return !(lhs < rhs);
+}
+
+/**
+ * Swaps the contents of lhs and rhs.
+ *
+ * @param[in] lhs first segment_vector
+ * @param[in] rhs second segment_vector
+ */
+template <typename T>
+void
+swap(segment_vector<T> &lhs, segment_vector<T> &rhs)
+{
+	lhs.swap(rhs);
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_SEGMENT_VECTOR_HPP */
@@ -43,6 +43,7 @@
 
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/pexceptions.hpp>
+#include <libpmemobj++/detail/tx_callback_list.hpp>
 #include <libpmemobj++/pool.hpp>
 #include <libpmemobj/tx_base.h>
 
@@ -107,8 +108,7 @@ public:
 		template <typename... L>
 		manual(obj::pool_base &pop, L &... locks)
 		{
-			if (pmemobj_tx_begin(pop.handle(), nullptr,
-					     TX_PARAM_NONE) != 0)
+			if (tx_begin(pop) != 0)
 				throw transaction_error(
 					"failed to start transaction");
 
@@ -307,6 +307,79 @@ public:
 	 */
 	~transaction() noexcept = delete;
 
+	/**
+	 * Possible stages of a transaction, see pobj_tx_stage.
+	 */
+	enum class stage {
+		work = TX_STAGE_WORK,	      /**< transaction in progress */
+		oncommit = TX_STAGE_ONCOMMIT, /**< successfully committed */
+		onabort = TX_STAGE_ONABORT,   /**< transaction aborted */
+		finally = TX_STAGE_FINALLY,   /**< ready for cleanup */
+	};
+
+	/**
+	 * Register a callback to be executed when the outermost transaction
+	 * ends.
+	 *
+	 * Callbacks for stage::oncommit are executed only if the transaction
+	 * was committed and callbacks for stage::onabort only if it was
+	 * aborted. Callbacks for stage::finally are executed in both cases,
+	 * after the other ones. Callbacks of a stage are executed in the order
+	 * of registration. Callbacks registered in a nested transaction are
+	 * executed when the outermost transaction ends, so a committed
+	 * transaction executes each of its stage::oncommit callbacks exactly
+	 * once.
+	 *
+	 * The callbacks are executed after the transaction is ended and its
+	 * locks are released, so they may start new transactions. They must
+	 * not throw, an exception escaping a callback calls std::terminate.
+	 *
+	 * The callbacks are stored in a fixed-capacity per-thread list, so
+	 * registering a callback never allocates memory. A transaction can
+	 * register up to 16 callbacks for each stage. A callable has to fit
+	 * in the size of four pointers (e.g. a lambda capturing up to four
+	 * pointers or references), which is checked at compile time.
+	 *
+	 * This is the way to keep volatile state, like caches and indexes of
+	 * persistent data, in sync with the outcome of a transaction.
+	 *
+	 * @param[in] stg stage::oncommit, stage::onabort or stage::finally.
+	 * @param[in] cb callable to execute, without arguments.
+	 *
+	 * @throw transaction_scope_error if called outside of a transaction,
+	 *	in a transaction nested in one not started by this class, or
+	 *	with stage::work.
+	 * @throw transaction_error if the list of callbacks of the stage is
+	 *	full.
+	 * @throw rethrows the exception of the copy constructor of the
+	 *	callable.
+	 */
+	template <typename F>
+	static void
+	register_callback(stage stg, F &&cb)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw transaction_scope_error(
+				"register_callback must be called during a "
+				"transaction");
+
+		if (stg == stage::work)
+			throw transaction_scope_error(
+				"callback cannot be registered for work stage");
+
+		auto &data = get_tx_data();
+		if (!data.active)
+			throw transaction_scope_error(
+				"register_callback must be called in a "
+				"transaction started by the C++ API");
+
+		if (!data.lists[callback_index(stg)].push_back(
+			    std::forward<F>(cb)))
+			throw transaction_error(
+				"too many callbacks registered in the "
+				"transaction");
+	}
+
 	/**
 	 * Manually abort the current transaction.
 	 *
@@ -397,8 +470,7 @@ public:
 	static void
 	run(pool_base &pool, std::function<void()> tx, Locks &... locks)
 	{
-		if (pmemobj_tx_begin(pool.handle(), nullptr, TX_PARAM_NONE) !=
-		    0)
+		if (tx_begin(pool) != 0)
 			throw transaction_error("failed to start transaction");
 
 		auto err = add_lock(locks...);
@@ -478,12 +550,114 @@ public:
 			throw transaction_error(
 				"wrong stage for taking a snapshot.");
 
-		if (pmemobj_tx_add_range_direct(addr, sizeof(*addr) * num))
+		if (detail::tx_add_range(addr, sizeof(*addr) * num))
 			throw transaction_error(
 				"Could not take a snapshot of given memory range.");
 	}
 
 private:
+	/**
+	 * Per-thread state of transaction callbacks.
+	 */
+	struct tx_data {
+		/** Set when the outermost transaction was started by us. */
+		bool active = false;
+
+		/**
+		 * Lists of callbacks for stage::oncommit, onabort and
+		 * finally, of the current outermost transaction.
+		 */
+		detail::tx_callback_list *lists = own_lists;
+
+		detail::tx_callback_list own_lists[3];
+	};
+
+	static tx_data &
+	get_tx_data()
+	{
+		static thread_local tx_data data;
+		return data;
+	}
+
+	static std::size_t
+	callback_index(stage stg) noexcept
+	{
+		return stg == stage::oncommit ? 0
+					      : stg == stage::onabort ? 1 : 2;
+	}
+
+	/**
+	 * Start a transaction. The outermost transaction gets the stage
+	 * callback which executes the registered callbacks and enables the
+	 * snapshot cache of the thread. A nested transaction keeps the
+	 * callback of the outer one, which may have been started by the
+	 * C API with its own callback or without any.
+	 *
+	 * @return 0 on success, error number otherwise.
+	 */
+	static int
+	tx_begin(pool_base &pop) noexcept
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_NONE)
+			return pmemobj_tx_begin(pop.handle(), nullptr,
+						TX_PARAM_NONE);
+
+		int ret = pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_CB,
+					   &transaction::c_callback, nullptr,
+					   TX_PARAM_NONE);
+		if (ret == 0) {
+			get_tx_data().active = true;
+
+			/* only ranges added after this point are known */
+			detail::get_tx_snapshot_cache().reset(pop.handle());
+		}
+
+		return ret;
+	}
+
+	/**
+	 * Stage callback of libpmemobj transactions, called only for the
+	 * outermost transaction. Disables the snapshot cache and executes the
+	 * registered callbacks once the transaction is over. While they
+	 * run, the thread registers callbacks in new lists on the stack, so
+	 * the callbacks may start transactions with their own callbacks.
+	 */
+	static void
+	c_callback(PMEMobjpool *, enum pobj_tx_stage obj_stage, void *) noexcept
+	{
+		if (obj_stage != TX_STAGE_NONE)
+			return;
+
+		detail::get_tx_snapshot_cache().reset(nullptr);
+
+		auto &data = get_tx_data();
+		data.active = false;
+
+		detail::tx_callback_list *lists = data.lists;
+		detail::tx_callback_list nested_lists[3];
+		data.lists = nested_lists;
+
+		auto &commit_cbs = lists[callback_index(stage::oncommit)];
+		auto &abort_cbs = lists[callback_index(stage::onabort)];
+		auto &finally_cbs = lists[callback_index(stage::finally)];
+
+		if (pmemobj_tx_errno() == 0) {
+			abort_cbs.clear();
+			commit_cbs.run();
+			commit_cbs.clear();
+		} else {
+			commit_cbs.clear();
+			abort_cbs.run();
+			abort_cbs.clear();
+		}
+
+		finally_cbs.run();
+		finally_cbs.clear();
+
+		/* transactions of the callbacks have run their callbacks */
+		data.lists = lists;
+	}
+
 	/**
 	 * Recursively add locks to the active transaction.
 	 *
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * action_batch.cpp -- pmem::obj::experimental::action_batch test
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/action_batch.hpp>
+
+#include <stdexcept>
+
+#define LAYOUT "action_batch"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+struct node {
+	node(uint64_t v) : value(v), next(nullptr)
+	{
+	}
+
+	nvobj::p<uint64_t> value;
+	nvobj::persistent_ptr<node> next;
+};
+
+struct throwing {
+	throwing()
+	{
+		throw std::runtime_error("constructor");
+	}
+
+	nvobj::p<uint64_t> value;
+};
+
+struct root {
+	nvobj::persistent_ptr<node> head;
+	nvobj::p<uint64_t> count;
+	nvobj::p<double> ratio;
+};
+
+/*
+ * push_front -- (internal) allocate a node and link it at the head of the
+ * list with a single publish
+ */
+void
+push_front(nvobj::pool<root> &pop, uint64_t value)
+{
+	auto r = pop.root();
+
+	nvobjexp::action_batch batch(pop);
+	auto n = batch.make_persistent<node>(value);
+	batch.set(n->next, r->head);
+	batch.set(r->head, n);
+	batch.set(r->count, r->count + 1);
+	UT_ASSERTeq(batch.size(), 6);
+
+	/* nothing is visible before publishing */
+	UT_ASSERT(r->head != n);
+
+	batch.publish();
+	UT_ASSERT(batch.empty());
+}
+
+void
+check_list(nvobj::pool<root> &pop, uint64_t n)
+{
+	auto r = pop.root();
+	UT_ASSERTeq(r->count, n);
+
+	auto it = r->head;
+	for (uint64_t i = n; i > 0; --i, it = it->next) {
+		UT_ASSERT(it != nullptr);
+		UT_ASSERTeq(it->value, i - 1);
+	}
+	UT_ASSERT(it == nullptr);
+}
+
+/*
+ * test_publish -- (internal) build a list and remove its head with batches
+ */
+void
+test_publish(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	for (uint64_t i = 0; i < 100; ++i)
+		push_front(pop, i);
+	check_list(pop, 100);
+
+	nvobjexp::action_batch batch(pop);
+	auto old_head = r->head;
+	batch.set(r->head, old_head->next);
+	batch.set(r->count, r->count - 1);
+	batch.free(old_head);
+	batch.set(r->ratio, 0.5);
+	batch.publish();
+
+	check_list(pop, 99);
+	UT_ASSERT(r->ratio == 0.5);
+
+	/* an empty batch publishes nothing */
+	batch.publish();
+}
+
+/*
+ * test_cancel -- (internal) cancelled and destroyed batches leave the pool
+ * untouched
+ */
+void
+test_cancel(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto head = r->head;
+
+	{
+		nvobjexp::action_batch batch(pop);
+		auto n = batch.make_persistent<node>(uint64_t(1000));
+		batch.set(r->head, n);
+		batch.set(r->count, uint64_t(0));
+	}
+
+	UT_ASSERT(r->head == head);
+	check_list(pop, 99);
+
+	nvobjexp::action_batch batch(pop);
+	batch.set(r->count, uint64_t(0));
+	batch.cancel();
+	UT_ASSERT(batch.empty());
+	batch.publish();
+	check_list(pop, 99);
+
+	try {
+		batch.make_persistent<throwing>();
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+	UT_ASSERT(batch.empty());
+
+	/* constructors would snapshot memory which is not allocated yet */
+	nvobj::transaction::run(pop, [&] {
+		try {
+			batch.make_persistent<node>(uint64_t(1000));
+			UT_ASSERT(0);
+		} catch (pmem::transaction_scope_error &) {
+		}
+	});
+	UT_ASSERT(batch.empty());
+}
+
+/*
+ * test_tx_publish -- (internal) actions published in a transaction are
+ * rolled back with it
+ */
+void
+test_tx_publish(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobjexp::action_batch batch(pop);
+	auto n = batch.make_persistent<node>(uint64_t(99));
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			batch.set(n->next, r->head);
+			batch.set(r->head, n);
+			batch.set(r->count, r->count + 1);
+			batch.publish();
+			UT_ASSERT(r->head == n);
+
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	}
+
+	check_list(pop, 99);
+
+	auto m = batch.make_persistent<node>(uint64_t(99));
+	nvobj::transaction::run(pop, [&] {
+		batch.set(m->next, r->head);
+		batch.set(r->head, m);
+		batch.set(r->count, r->count + 1);
+		batch.publish();
+	});
+
+	check_list(pop, 100);
+}
+
+/*
+ * test_tx_publish_failure -- (internal) actions which failed to be
+ * published in a transaction are cancelled by its abort, not by the batch
+ */
+void
+test_tx_publish_failure(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	uint64_t volatile_word = 0;
+
+	nvobjexp::action_batch batch(pop);
+	auto n = batch.make_persistent<node>(uint64_t(100));
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			batch.set(n->next, r->head);
+			batch.set(r->head, n);
+
+			/* a store outside of the pool makes publishing fail */
+			batch.set_value(&volatile_word, 1);
+
+			try {
+				batch.publish();
+				UT_ASSERT(0);
+			} catch (pmem::transaction_error &) {
+			}
+
+			UT_ASSERT(batch.empty());
+			UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_ONABORT);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_error &) {
+	}
+
+	UT_ASSERT(batch.empty());
+	check_list(pop, 100);
+
+	push_front(pop, 100);
+	check_list(pop, 101);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 2, S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_publish(pop);
+	test_cancel(pop);
+	test_tx_publish(pop);
+	test_tx_publish_failure(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	check_list(pop, 101);
+
+	pop.close();
+
+	return 0;
+}
@@ -41,7 +41,9 @@
 #include <libpmemobj++/p.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
 
+#include <atomic>
 #include <iterator>
 #include <thread>
 #include <vector>
@@ -150,6 +152,20 @@ insert_and_lookup_test(nvobj::pool<root> &pop)
 
 	UT_ASSERT(map->size() == TOTAL_ITEMS);
 
+	auto stats = map->initialize(false, concurrency);
+
+	UT_ASSERT(map->bucket_count() == buckets);
+
+	UT_ASSERT(map->size() == TOTAL_ITEMS);
+	UT_ASSERT(stats.size == TOTAL_ITEMS);
+	UT_ASSERT(stats.buckets == buckets);
+	UT_ASSERT(stats.threads == concurrency);
+
+	stats = map->initialize(false, 0);
+
+	UT_ASSERT(map->size() == TOTAL_ITEMS);
+	UT_ASSERT(stats.threads == 1);
+
 	map->clear();
 
 	UT_ASSERT(map->size() == 0);
@@ -258,6 +274,281 @@ insert_erase_lookup_test(nvobj::pool<root> &pop)
 		UT_ASSERT(e.first <= e.second);
 	}
 }
+
+/*
+ * erase_accessor_test -- (internal) test erasing items held by accessors
+ * concurrently with erasing them by key
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+erase_accessor_test(nvobj::pool<root> &pop)
+{
+	const size_t NUMBER_ITEMS_INSERT = 500;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	for (int i = 0; i < int(NUMBER_ITEMS_INSERT); ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	std::atomic<size_t> erased(0);
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (int i = 0; i < int(NUMBER_ITEMS_INSERT); ++i) {
+			if (thread_id % 2) {
+				erased += map->erase(i);
+				continue;
+			}
+
+			persistent_map_type::accessor acc;
+			if (map->find(acc, i)) {
+				UT_ASSERTeq(acc->first, i);
+				erased += map->erase(acc);
+			}
+		}
+	});
+
+	UT_ASSERTeq(erased.load(), NUMBER_ITEMS_INSERT);
+	UT_ASSERTeq(map->size(), 0);
+}
+
+/*
+ * insert_bulk_test -- (internal) test bulk insert of overlapping ranges
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+insert_bulk_test(nvobj::pool<root> &pop)
+{
+	const size_t NUMBER_ITEMS_INSERT = 500;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	/* every thread inserts a range which overlaps with its neighbours */
+	std::vector<persistent_map_type::value_type> items;
+	for (int i = 0; i < int(NUMBER_ITEMS_INSERT * (concurrency + 1) / 2);
+	     ++i)
+		items.emplace_back(i, i);
+
+	std::atomic<size_t> inserted(0);
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		auto first = items.begin() +
+			static_cast<std::ptrdiff_t>(thread_id *
+						    NUMBER_ITEMS_INSERT / 2);
+		auto last = first + NUMBER_ITEMS_INSERT;
+
+		inserted += map->insert_bulk(first, last, thread_id * 16);
+	});
+
+	UT_ASSERTeq(inserted.load(), items.size());
+	UT_ASSERTeq(map->size(), items.size());
+	UT_ASSERT(std::distance(map->begin(), map->end()) ==
+		  int(items.size()));
+
+	for (auto &e : items) {
+		persistent_map_type::const_accessor acc;
+		bool res = map->find(acc, e.first);
+		UT_ASSERT(res == true);
+		UT_ASSERTeq(acc->second, e.second);
+	}
+
+	/* nothing to insert */
+	UT_ASSERTeq(map->insert_bulk(items.begin(), items.end()), 0);
+
+	map->initialize();
+
+	UT_ASSERTeq(map->size(), items.size());
+}
+
+/*
+ * insert_or_assign_test -- (internal) test concurrent upserts of the same keys
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+insert_or_assign_test(nvobj::pool<root> &pop)
+{
+	const size_t NUMBER_ITEMS_INSERT = 100;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	std::atomic<size_t> inserted(0);
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (int i = 0; i < int(NUMBER_ITEMS_INSERT); ++i) {
+			if (map->insert_or_assign(i, int(thread_id)))
+				++inserted;
+		}
+	});
+
+	UT_ASSERTeq(inserted.load(), NUMBER_ITEMS_INSERT);
+	UT_ASSERTeq(map->size(), NUMBER_ITEMS_INSERT);
+
+	for (int i = 0; i < int(NUMBER_ITEMS_INSERT); ++i) {
+		persistent_map_type::const_accessor acc;
+		bool res = map->find(acc, i);
+		UT_ASSERT(res == true);
+		UT_ASSERT(acc->second >= 0 && acc->second < int(concurrency));
+	}
+}
+
+struct split_tag {
+};
+
+/*
+ * count_range -- (internal) count items in the range after splitting it into
+ * indivisible subranges
+ */
+size_t
+count_range(persistent_map_type::const_range_type &r)
+{
+	if (!r.is_divisible()) {
+		UT_ASSERT(r.empty() == (r.begin() == r.end()));
+		return static_cast<size_t>(std::distance(r.begin(), r.end()));
+	}
+
+	persistent_map_type::const_range_type second(r, split_tag());
+
+	return count_range(r) + count_range(second);
+}
+
+/*
+ * parallel_for_test -- (internal) test parallel traversal of the map
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+parallel_for_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 1000;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	std::vector<std::atomic<int>> visits(NUMBER_ITEMS_INSERT);
+	for (auto &v : visits)
+		v.store(0);
+
+	map->parallel_for(concurrency, [&](persistent_map_type::range_type &r) {
+		for (auto &e : r) {
+			++visits[static_cast<size_t>(e.first.get_ro())];
+			e.second.get_rw() += 1;
+			pop.persist(e.second);
+		}
+	});
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i) {
+		UT_ASSERTeq(visits[static_cast<size_t>(i)].load(), 1);
+
+		persistent_map_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, i));
+		UT_ASSERTeq(acc->second, i + 1);
+	}
+
+	/* exception propagation */
+	const persistent_map_type &cmap = *map;
+	std::atomic<size_t> ranges(0);
+
+	try {
+		cmap.parallel_for(
+			concurrency,
+			[&](persistent_map_type::const_range_type &r) {
+				++ranges;
+				if (r.begin() == cmap.begin())
+					throw std::runtime_error("first range");
+			});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	UT_ASSERTeq(ranges.load(), concurrency);
+
+	auto range = cmap.range(16);
+	UT_ASSERTeq(count_range(range), size_t(NUMBER_ITEMS_INSERT));
+}
+
+/*
+ * parallel_clear_test -- (internal) test clearing the map with multiple
+ * threads pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+parallel_clear_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 5000;
+
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	const auto initial_buckets = map->bucket_count();
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	UT_ASSERT(map->bucket_count() > initial_buckets);
+
+	/* small batches, so that every thread runs many transactions */
+	map->clear(concurrency, 16);
+
+	UT_ASSERTeq(map->size(), 0);
+	UT_ASSERT(map->empty());
+	UT_ASSERTeq(map->bucket_count(), initial_buckets);
+	UT_ASSERT(map->begin() == map->end());
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		UT_ASSERTeq(map->count(i), 0);
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		UT_ASSERT(map->insert(persistent_map_type::value_type(i, i)));
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS_INSERT));
+
+	/* more threads than buckets and a zero batch size */
+	map->clear(1000, 0);
+	UT_ASSERTeq(map->size(), 0);
+
+	try {
+		nvobj::transaction::run(pop, [&] { map->clear(concurrency); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	}
+}
 }
 
 int
@@ -288,6 +579,16 @@ main(int argc, char *argv[])
 
 	insert_erase_lookup_test(pop);
 
+	erase_accessor_test(pop);
+
+	insert_bulk_test(pop);
+
+	insert_or_assign_test(pop);
+
+	parallel_for_test(pop);
+
+	parallel_clear_test(pop);
+
 	pop.close();
 
 	return 0;
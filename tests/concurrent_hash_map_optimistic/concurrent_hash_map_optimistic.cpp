@@ -0,0 +1,291 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_hash_map_optimistic.cpp -- pmem::obj::concurrent_hash_map
+ * find_optimistic test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/experimental/concurrent_hash_map.hpp>
+
+#define LAYOUT "concurrent_hash_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+/* both fields are always updated together */
+struct mapped_value {
+	mapped_value() : first(0), second(0)
+	{
+	}
+
+	mapped_value(int v) : first(v), second(v)
+	{
+	}
+
+	nvobj::p<int> first;
+	nvobj::p<int> second;
+};
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, mapped_value,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::transactional_node_allocation,
+	nvobj::experimental::no_statistics,
+	nvobj::experimental::load_factor_growth<1>,
+	nvobj::experimental::optimistic_lookup>
+	persistent_map_type;
+
+typedef nvobj::experimental::concurrent_hash_map<nvobj::p<int>, mapped_value>
+	persistent_map_locked_type;
+
+typedef persistent_map_type::value_type value_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+	nvobj::persistent_ptr<persistent_map_locked_type> locked;
+};
+
+static constexpr size_t CONCURRENCY = 4;
+
+template <typename Function>
+void
+parallel_exec(size_t concurrency, Function f)
+{
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency);
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back(f, i);
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+/*
+ * basic_test -- (internal) test find_optimistic in a single thread, including
+ * buckets which are not rehashed yet
+ */
+template <typename MapType>
+void
+basic_test(nvobj::persistent_ptr<MapType> map)
+{
+	const int NUMBER_ITEMS = 2048;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+
+	mapped_value value;
+	UT_ASSERT(!map->find_optimistic(0, value));
+
+	/* inserts enable new segments, lookups have to rehash buckets */
+	for (int i = 0; i < NUMBER_ITEMS; ++i)
+		map->insert(typename MapType::value_type(i, i));
+
+	for (int i = 0; i < NUMBER_ITEMS; ++i) {
+		UT_ASSERT(map->find_optimistic(i, value));
+		UT_ASSERTeq(value.first, i);
+		UT_ASSERTeq(value.second, i);
+	}
+
+	UT_ASSERT(!map->find_optimistic(NUMBER_ITEMS, value));
+	UT_ASSERT(!map->find_optimistic(-1, value));
+
+	for (int i = 0; i < NUMBER_ITEMS; i += 2)
+		UT_ASSERT(map->erase(i));
+
+	for (int i = 0; i < NUMBER_ITEMS; ++i)
+		UT_ASSERTeq(map->find_optimistic(i, value), i % 2 != 0);
+
+	map->clear();
+}
+
+/*
+ * layout_test -- (internal) the sequence counters are a part of the layout
+ * of the table
+ */
+void
+layout_test(nvobj::pool<root> &pop)
+{
+	nvobj::persistent_ptr<persistent_map_locked_type> locked(
+		pop.root()->cons.raw());
+
+	try {
+		locked->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	nvobj::persistent_ptr<persistent_map_type> optimistic(
+		pop.root()->locked.raw());
+
+	try {
+		optimistic->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+/*
+ * concurrent_test -- (internal) run find_optimistic concurrently with
+ * updates, erases and inserts; torn reads are detected by comparing the
+ * fields of the value
+ */
+void
+concurrent_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS = 512;
+	const int NUMBER_ROUNDS = 50;
+
+	auto map = pop.root()->cons;
+
+	map->initialize();
+
+	for (int i = 0; i < NUMBER_ITEMS; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	std::atomic<size_t> writers_done(0);
+
+	parallel_exec(CONCURRENCY * 2, [&](size_t thread_id) {
+		if (thread_id < CONCURRENCY) {
+			/* writers: update, erase and reinsert own keys */
+			for (int r = 0; r < NUMBER_ROUNDS; ++r) {
+				for (int i = int(thread_id); i < NUMBER_ITEMS;
+				     i += int(CONCURRENCY)) {
+					persistent_map_type::accessor acc;
+					if (map->find(acc, i)) {
+						int v = acc->second.first + 1;
+						acc->second.first = v;
+						acc->second.second = v;
+						pop.persist(
+							&acc->second,
+							sizeof(acc->second));
+					}
+					acc.release();
+
+					if (i % 8 == r % 8) {
+						map->erase(i);
+						map->insert(value_type(i, i));
+					}
+				}
+
+				/* grow the map while readers are running */
+				int key = NUMBER_ITEMS +
+					int(thread_id) * NUMBER_ROUNDS + r;
+				map->insert(value_type(key, key));
+			}
+
+			++writers_done;
+		} else {
+			/* readers */
+			mapped_value value;
+			while (writers_done.load() != CONCURRENCY) {
+				for (int i = 0; i < NUMBER_ITEMS; ++i) {
+					if (map->find_optimistic(i, value)) {
+						UT_ASSERTeq(value.first,
+							    value.second);
+						UT_ASSERT(value.first >= i);
+					}
+				}
+			}
+		}
+	});
+
+	mapped_value value;
+	for (int i = 0; i < NUMBER_ITEMS; ++i) {
+		UT_ASSERT(map->find_optimistic(i, value));
+		UT_ASSERTeq(value.first, value.second);
+	}
+
+	UT_ASSERTeq(map->size(),
+		    size_t(NUMBER_ITEMS) + CONCURRENCY * NUMBER_ROUNDS);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->cons);
+		nvobj::make_persistent_atomic<persistent_map_locked_type>(
+			pop, pop.root()->locked);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	basic_test(pop.root()->cons);
+
+	basic_test(pop.root()->locked);
+
+	layout_test(pop);
+
+	concurrent_test(pop);
+
+	pop.close();
+
+	return 0;
+}
@@ -42,6 +42,7 @@
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pool.hpp>
 
+#include <atomic>
 #include <iterator>
 #include <thread>
 #include <vector>
@@ -62,6 +63,42 @@ struct root {
 	nvobj::persistent_ptr<persistent_map_type> cons;
 };
 
+/*
+ * map_internals -- exposes the buckets of the map, to build the state left
+ * by an interrupted rehash
+ */
+class map_internals : public persistent_map_type {
+public:
+	/* @returns index of the bucket which stores key */
+	hashcode_t
+	bucket_of(int key) const
+	{
+		return my_hash_compare.hash(key) & mask();
+	}
+
+	/*
+	 * Link the nodes of bucket h also at the head of its parent bucket
+	 * and mark bucket h as not rehashed, as if the rehashing was
+	 * interrupted right after the first node was linked to bucket h.
+	 */
+	void
+	interrupt_rehash(nvobj::pool_base &pop, hashcode_t h, hashcode_t parent)
+	{
+		bucket *b = get_bucket(h);
+		bucket *p = get_bucket(parent);
+
+		nvobj::transaction::run(pop, [&] {
+			node_base_ptr_t last = b->node_list;
+			while (is_valid(last(my_pool_uuid)->next))
+				last = last(my_pool_uuid)->next;
+
+			last(my_pool_uuid)->next = p->node_list;
+			p->node_list = b->node_list;
+			b->rehashed.get_rw() = false;
+		});
+	}
+};
+
 /*
  * insert_and_erase_test -- (internal) test insert and erase operations
  * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
@@ -127,6 +164,207 @@ insert_erase_lookup_test(nvobj::pool<root> &pop)
 		UT_ASSERT(e.first <= e.second);
 	}
 }
+
+/*
+ * rehash_step_test -- (internal) test incremental rehashing concurrently with
+ * inserts and lookups
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+rehash_step_test(nvobj::pool<root> &pop)
+{
+	const size_t NUMBER_ITEMS_INSERT = 500;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	std::atomic<size_t> inserters(concurrency);
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency * 2);
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back([&, i]() {
+			int begin = static_cast<int>(i * NUMBER_ITEMS_INSERT);
+			int end = begin + static_cast<int>(NUMBER_ITEMS_INSERT);
+			for (int i = begin; i < end; ++i) {
+				bool ret = map->insert(
+					persistent_map_type::value_type(i, i));
+				UT_ASSERT(ret == true);
+			}
+
+			--inserters;
+		});
+	}
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back([&]() {
+			while (inserters.load() > 0) {
+				map->rehash_step(4);
+				std::this_thread::yield();
+			}
+		});
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	while (map->rehash_step(16) == 16)
+		;
+
+	UT_ASSERTeq(map->rehash_step(), 0);
+
+	size_t total_items = NUMBER_ITEMS_INSERT * concurrency;
+
+	UT_ASSERTeq(map->size(), total_items);
+
+	for (int i = 0; i < static_cast<int>(total_items); ++i) {
+		persistent_map_type::const_accessor acc;
+		bool res = map->find(acc, i);
+		UT_ASSERT(res == true);
+		UT_ASSERTeq(acc->first, i);
+		UT_ASSERTeq(acc->second, i);
+	}
+
+	map->clear();
+
+	UT_ASSERTeq(map->rehash_step(), 0);
+}
+
+/*
+ * check_items -- (internal) check that exactly keys [0, n) are in the map
+ */
+void
+check_items(persistent_map_type &map, int n, int total)
+{
+	UT_ASSERTeq(map.size(), static_cast<size_t>(n));
+	UT_ASSERTeq(static_cast<int>(std::distance(map.begin(), map.end())),
+		    n);
+
+	for (int i = 0; i < total; ++i) {
+		persistent_map_type::const_accessor acc;
+		bool res = map.find(acc, i);
+		UT_ASSERT(res == (i < n));
+		if (res)
+			UT_ASSERTeq(acc->second, i);
+	}
+}
+
+/*
+ * shrink_to_fit_test -- (internal) test releasing segments after erase
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+shrink_to_fit_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 5000;
+	const int NUMBER_ITEMS_LEFT = 100;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	size_t buckets = map->bucket_count();
+
+	/* nothing to release */
+	map->shrink_to_fit();
+	UT_ASSERTeq(map->bucket_count(), buckets);
+
+	for (int i = NUMBER_ITEMS_LEFT; i < NUMBER_ITEMS_INSERT; ++i)
+		map->erase(i);
+
+	map->shrink_to_fit();
+	UT_ASSERT(map->bucket_count() < buckets);
+	UT_ASSERT(map->bucket_count() > static_cast<size_t>(NUMBER_ITEMS_LEFT));
+	check_items(*map, NUMBER_ITEMS_LEFT, NUMBER_ITEMS_INSERT);
+
+	/* the table grows again */
+	for (int i = NUMBER_ITEMS_LEFT; i < NUMBER_ITEMS_INSERT; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	check_items(*map, NUMBER_ITEMS_INSERT, NUMBER_ITEMS_INSERT);
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		map->erase(i);
+
+	map->shrink_to_fit();
+	UT_ASSERTeq(map->bucket_count(), 2);
+	check_items(*map, 0, NUMBER_ITEMS_INSERT);
+
+	map->insert(persistent_map_type::value_type(1, 1));
+	map->initialize();
+	UT_ASSERTeq(map->size(), 1);
+	UT_ASSERTeq(map->count(1), 1);
+
+	map->clear();
+}
+
+/*
+ * shrink_interrupted_rehash_test -- (internal) test releasing a segment
+ * with a bucket whose rehashing was interrupted
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+shrink_interrupted_rehash_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 5000;
+
+	auto map = pop.root()->cons;
+	auto &internals = static_cast<map_internals &>(*map);
+
+	map->initialize();
+	map->clear();
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		map->insert(persistent_map_type::value_type(i, i));
+
+	/* a key in the upper half of the buckets and one in its parent */
+	size_t m = map->bucket_count() - 1;
+	int child = NUMBER_ITEMS_INSERT - 1;
+	size_t h = internals.bucket_of(child);
+	for (; h <= m / 2; h = internals.bucket_of(--child))
+		;
+
+	size_t top_bit = (m + 1) / 2;
+	while (top_bit > h)
+		top_bit /= 2;
+
+	int parent = 0;
+	while (internals.bucket_of(parent) != h - top_bit)
+		++parent;
+
+	for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i)
+		if (i != child && i != parent)
+			map->erase(i);
+
+	internals.interrupt_rehash(pop, h, h - top_bit);
+
+	map->shrink_to_fit();
+	UT_ASSERT(map->bucket_count() < m + 1);
+
+	UT_ASSERTeq(map->size(), 2);
+	UT_ASSERTeq(std::distance(map->begin(), map->end()), 2);
+	UT_ASSERTeq(map->count(child), 1);
+	UT_ASSERTeq(map->count(parent), 1);
+
+	map->initialize();
+	UT_ASSERTeq(map->size(), 2);
+
+	map->clear();
+}
 }
 
 int
@@ -153,6 +391,12 @@ main(int argc, char *argv[])
 
 	insert_erase_lookup_test(pop);
 
+	rehash_step_test(pop);
+
+	shrink_to_fit_test(pop);
+
+	shrink_interrupted_rehash_test(pop);
+
 	pop.close();
 
 	return 0;
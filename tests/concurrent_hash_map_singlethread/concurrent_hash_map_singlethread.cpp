@@ -43,6 +43,7 @@
 #include <libpmemobj++/pool.hpp>
 
 #include <iterator>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
@@ -88,11 +89,219 @@ typedef nvobj::experimental::concurrent_hash_map<nvobj::p<int>, move_element>
 
 typedef persistent_map_move_type::value_type value_move_type;
 
+/* hash_compare which makes nodes store hash codes and counts hash calls */
+struct cached_hash_compare {
+	using cache_hash_code = void;
+
+	static size_t hash_calls;
+
+	static size_t
+	hash(const nvobj::p<int> &key)
+	{
+		++hash_calls;
+
+		/* few distinct hash codes, so that chains are long */
+		return std::hash<int>{}(key % 64);
+	}
+
+	static bool
+	equal(const nvobj::p<int> &a, const nvobj::p<int> &b)
+	{
+		return a == b;
+	}
+};
+
+size_t cached_hash_compare::hash_calls = 0;
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>, cached_hash_compare>
+	persistent_map_cached_type;
+
+/* key which cannot be implicitly constructed from its lookup type */
+struct id_key {
+	explicit id_key(int id) : id(id)
+	{
+	}
+
+	nvobj::p<int> id;
+};
+
+/* hash_compare which allows looking up id_key by int */
+struct transparent_hash_compare {
+	using is_transparent = void;
+
+	static size_t
+	hash(const id_key &key)
+	{
+		return hash(key.id.get_ro());
+	}
+
+	static size_t
+	hash(int id)
+	{
+		return std::hash<int>{}(id);
+	}
+
+	static bool
+	equal(const id_key &a, const id_key &b)
+	{
+		return a.id == b.id;
+	}
+
+	static bool
+	equal(int id, const id_key &b)
+	{
+		return id == b.id;
+	}
+};
+
+typedef nvobj::experimental::concurrent_hash_map<id_key, nvobj::p<int>,
+						 transparent_hash_compare>
+	persistent_map_transparent_type;
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::cache_aligned_bucket_layout<true>>
+	persistent_map_fingerprints_type;
+
+/* value which can be copied to pmem only in a transaction, or never */
+struct tx_only_value {
+	tx_only_value(int v) : val(v)
+	{
+	}
+
+	tx_only_value(const tx_only_value &other) : val(other.val)
+	{
+		if (pmemobj_pool_by_ptr(this) == nullptr)
+			return;
+
+		if (val < 0)
+			throw std::runtime_error("negative value");
+
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw pmem::transaction_scope_error(
+				"copied outside of a transaction");
+	}
+
+	nvobj::p<int> val;
+};
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, tx_only_value,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::transactional_node_allocation>
+	persistent_map_tx_type;
+
+typedef nvobj::experimental::concurrent_hash_map<nvobj::p<int>,
+						 tx_only_value>
+	persistent_map_default_type;
+
+/* trivially copyable value whose construction from int may throw */
+struct atomic_value {
+	atomic_value(int v) : val(v)
+	{
+		if (v < 0)
+			throw std::runtime_error("negative value");
+	}
+
+	int val;
+};
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, atomic_value,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::atomic_node_allocation>
+	persistent_map_atomic_type;
+
+typedef nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::atomic_node_allocation,
+	nvobj::experimental::collect_statistics>
+	persistent_map_stats_type;
+
+template <typename GrowthPolicy>
+using persistent_map_growth_type = nvobj::experimental::concurrent_hash_map<
+	nvobj::p<int>, nvobj::p<int>,
+	nvobj::experimental::hash_compare<nvobj::p<int>>,
+	nvobj::experimental::compact_bucket_layout,
+	nvobj::experimental::atomic_node_allocation,
+	nvobj::experimental::no_statistics, GrowthPolicy>;
+
+typedef persistent_map_growth_type<nvobj::experimental::load_factor_growth<4>>
+	persistent_map_dense_type;
+
+typedef persistent_map_growth_type<
+	nvobj::experimental::load_factor_growth<1, 2>>
+	persistent_map_sparse_type;
+
+/*
+ * old_layout_map -- (internal) gives access to the layout features, to make
+ * a table look like one created before they were added, which stores its
+ * element counter in place of the layout magic
+ */
+class old_layout_map : public persistent_map_cached_type {
+public:
+	void
+	clear_layout_magic(nvobj::pool_base &pop)
+	{
+		uint64_t counter = static_cast<uint64_t>(size());
+
+		nvobj::transaction::run(
+			pop, [&] { my_layout_features.magic = counter; });
+	}
+};
+
+/*
+ * aligned_buckets_map -- (internal) gives access to the buckets, to check
+ * their alignment
+ */
+class aligned_buckets_map : public persistent_map_fingerprints_type {
+public:
+	/* checks if the buckets out of the table object are cache aligned */
+	bool
+	buckets_aligned() const
+	{
+		hashcode_t m = mask().load();
+
+		for (hashcode_t h = embedded_buckets; h <= m; ++h) {
+			auto addr = reinterpret_cast<uintptr_t>(get_bucket(h));
+			if (addr % 64 != 0)
+				return false;
+		}
+
+		return true;
+	}
+};
+
 struct root {
 	nvobj::persistent_ptr<persistent_map_type> map1;
 	nvobj::persistent_ptr<persistent_map_type> map2;
 
 	nvobj::persistent_ptr<persistent_map_move_type> map_move;
+
+	nvobj::persistent_ptr<persistent_map_cached_type> map_cached;
+
+	nvobj::persistent_ptr<persistent_map_transparent_type> map_transparent;
+
+	nvobj::persistent_ptr<persistent_map_fingerprints_type>
+		map_fingerprints;
+
+	nvobj::persistent_ptr<persistent_map_tx_type> map_tx;
+
+	nvobj::persistent_ptr<persistent_map_default_type> map_default;
+
+	nvobj::persistent_ptr<persistent_map_atomic_type> map_atomic;
+
+	nvobj::persistent_ptr<persistent_map_stats_type> map_stats;
+
+	nvobj::persistent_ptr<persistent_map_dense_type> map_dense;
+
+	nvobj::persistent_ptr<persistent_map_sparse_type> map_sparse;
 };
 
 void
@@ -393,6 +602,701 @@ insert_test(nvobj::pool<root> &pop)
 	pmem::detail::destroy<persistent_map_type>(*map1);
 	pmem::detail::destroy<persistent_map_move_type>(*map_move);
 }
+
+/*
+ * emplace_test -- (internal) test emplace, try_emplace and insert_or_assign
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+emplace_test(nvobj::pool<root> &pop)
+{
+	auto &map1 = pop.root()->map1;
+	auto &map_move = pop.root()->map_move;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+	tx_alloc_wrapper<persistent_map_move_type>(pop, map_move);
+
+	{
+		persistent_map_type::accessor accessor;
+		UT_ASSERT(map1->emplace(accessor, 1, 1));
+
+		UT_ASSERTeq(accessor->first, 1);
+		UT_ASSERTeq(accessor->second, 1);
+	}
+
+	{
+		persistent_map_type::const_accessor accessor;
+		UT_ASSERT(!map1->emplace(accessor, 1, 2));
+
+		UT_ASSERTeq(accessor->first, 1);
+		UT_ASSERTeq(accessor->second, 1);
+	}
+
+	UT_ASSERT(map1->emplace(2, 2));
+	UT_ASSERT(!map1->emplace(value_type(2, 3)));
+
+	{
+		persistent_map_type::const_accessor accessor;
+		UT_ASSERT(map1->try_emplace(accessor, 3, 3));
+
+		UT_ASSERTeq(accessor->first, 3);
+		UT_ASSERTeq(accessor->second, 3);
+	}
+
+	{
+		persistent_map_type::accessor accessor;
+		int key = 3;
+		UT_ASSERT(!map1->try_emplace(accessor, key, 4));
+
+		UT_ASSERTeq(accessor->first, 3);
+		UT_ASSERTeq(accessor->second, 3);
+	}
+
+	/* mapped value is default constructed if there are no arguments */
+	UT_ASSERT(map1->try_emplace(4));
+
+	UT_ASSERT(map1->insert_or_assign(5, 5));
+	UT_ASSERT(!map1->insert_or_assign(5, 6));
+
+	{
+		int key = 4;
+		nvobj::p<int> value = 7;
+		UT_ASSERT(!map1->insert_or_assign(key, value));
+	}
+
+	UT_ASSERTeq(map1->size(), 5);
+
+	for (int i = 1; i <= 5; i++) {
+		static const int expected[] = {1, 2, 3, 7, 6};
+
+		persistent_map_type::const_accessor accessor;
+		UT_ASSERT(map1->find(accessor, i));
+		UT_ASSERTeq(accessor->second, expected[i - 1]);
+	}
+
+	/* move only mapped value is constructed in place from an int */
+	{
+		persistent_map_move_type::accessor accessor;
+		UT_ASSERT(map_move->try_emplace(accessor, 1, 1));
+
+		UT_ASSERTeq(accessor->first, 1);
+		UT_ASSERTeq(accessor->second.val, 1);
+	}
+
+	{
+		move_element e(2);
+		UT_ASSERT(!map_move->try_emplace(1, std::move(e)));
+
+		/* the argument is not consumed if the key is present */
+		UT_ASSERTeq(e.val, 2);
+
+		UT_ASSERT(!map_move->insert_or_assign(1, std::move(e)));
+	}
+
+	UT_ASSERT(map_move->insert_or_assign(2, move_element(3)));
+
+	{
+		persistent_map_move_type::const_accessor accessor;
+		UT_ASSERT(map_move->find(accessor, 1));
+		UT_ASSERTeq(accessor->second.val, 2);
+
+		UT_ASSERT(map_move->find(accessor, 2));
+		UT_ASSERTeq(accessor->second.val, 3);
+	}
+
+	UT_ASSERTeq(map_move->size(), 2);
+
+	pmem::detail::destroy<persistent_map_type>(*map1);
+	pmem::detail::destroy<persistent_map_move_type>(*map_move);
+}
+
+/*
+ * cached_hash_test -- (internal) test nodes storing hash codes
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+ * cached_hash_compare>
+ */
+void
+cached_hash_test(nvobj::pool<root> &pop)
+{
+	auto &map = pop.root()->map_cached;
+
+	tx_alloc_wrapper<persistent_map_cached_type>(pop, map);
+
+	map->initialize();
+
+	const int NUMBER_ITEMS = 1000;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(
+			persistent_map_cached_type::value_type(i, i)));
+	}
+
+	/* rehashing uses the stored hash codes */
+	size_t hash_calls = cached_hash_compare::hash_calls;
+
+	map->rehash(NUMBER_ITEMS * 4);
+
+	UT_ASSERTeq(cached_hash_compare::hash_calls, hash_calls);
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		persistent_map_cached_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, i));
+		UT_ASSERTeq(acc->second, i);
+	}
+
+	UT_ASSERT(map->erase(NUMBER_ITEMS / 2));
+	UT_ASSERTeq(map->count(NUMBER_ITEMS / 2), 0);
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS - 1));
+
+	map->initialize();
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS - 1));
+
+	/* a table must not be opened with a different node layout */
+	nvobj::persistent_ptr<persistent_map_type> other(map.raw());
+
+	try {
+		other->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	/* nor a table with an older layout */
+	static_cast<old_layout_map &>(*map).clear_layout_magic(pop);
+
+	try {
+		map->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	pmem::detail::destroy<persistent_map_cached_type>(*map);
+}
+
+/*
+ * erase_accessor_test -- (internal) test erasing items held by accessors
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+ * cached_hash_compare>
+ */
+void
+erase_accessor_test(nvobj::pool<root> &pop)
+{
+	auto &map = pop.root()->map_cached;
+
+	tx_alloc_wrapper<persistent_map_cached_type>(pop, map);
+
+	map->initialize();
+
+	const int NUMBER_ITEMS = 1000;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(
+			persistent_map_cached_type::value_type(i, i)));
+	}
+
+	{
+		persistent_map_cached_type::accessor acc;
+		UT_ASSERT(!map->erase(acc));
+	}
+
+	/* erase every odd item, the key is hashed only by find() */
+	for (int i = 1; i < NUMBER_ITEMS; i += 2) {
+		persistent_map_cached_type::accessor acc;
+		UT_ASSERT(map->find(acc, i));
+
+		size_t hash_calls = cached_hash_compare::hash_calls;
+
+		UT_ASSERT(map->erase(acc));
+		UT_ASSERT(acc.empty());
+
+		UT_ASSERTeq(cached_hash_compare::hash_calls, hash_calls);
+	}
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS / 2));
+
+	for (int i = 0; i < NUMBER_ITEMS; i++)
+		UT_ASSERTeq(map->count(i), size_t(1 - i % 2));
+
+	/* accessor obtained by insert */
+	{
+		persistent_map_cached_type::accessor acc;
+		UT_ASSERT(map->insert(acc, 1));
+		UT_ASSERT(map->erase(acc));
+		UT_ASSERTeq(map->count(1), 0);
+	}
+
+	/* accessor of an item of another map */
+	{
+		nvobj::persistent_ptr<persistent_map_cached_type> other;
+		tx_alloc_wrapper<persistent_map_cached_type>(pop, other);
+		other->initialize();
+
+		persistent_map_cached_type::accessor acc;
+		UT_ASSERT(map->find(acc, 0));
+
+		try {
+			other->erase(acc);
+			UT_ASSERT(0);
+		} catch (std::invalid_argument &) {
+		} catch (...) {
+			UT_ASSERT(0);
+		}
+
+		UT_ASSERT(!acc.empty());
+		UT_ASSERT(map->erase(acc));
+		UT_ASSERT(map->insert(
+			persistent_map_cached_type::value_type(0, 0)));
+
+		nvobj::transaction::run(pop, [&] {
+			nvobj::delete_persistent<persistent_map_cached_type>(
+				other);
+		});
+	}
+
+	map->initialize();
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS / 2));
+
+	pmem::detail::destroy<persistent_map_cached_type>(*map);
+}
+
+/*
+ * transparent_lookup_test -- (internal) test lookup with a key of type
+ * different than the Key
+ * pmem::obj::concurrent_hash_map<id_key, nvobj::p<int>,
+ * transparent_hash_compare>
+ */
+void
+transparent_lookup_test(nvobj::pool<root> &pop)
+{
+	using map_type = persistent_map_transparent_type;
+
+	auto &map = pop.root()->map_transparent;
+
+	tx_alloc_wrapper<map_type>(pop, map);
+
+	map->initialize();
+
+	const int NUMBER_ITEMS = 100;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(map_type::value_type(id_key(i), i)));
+	}
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERTeq(map->count(i), 1);
+
+		{
+			map_type::const_accessor acc;
+			UT_ASSERT(map->find(acc, i));
+			UT_ASSERTeq(acc->first.id, i);
+			UT_ASSERTeq(acc->second, i);
+		}
+
+		{
+			map_type::accessor acc;
+			UT_ASSERT(map->find(acc, i));
+			acc->second.get_rw() += 1;
+			pop.persist(acc->second);
+		}
+
+		nvobj::p<int> value;
+		UT_ASSERT(map->find_optimistic(i, value));
+		UT_ASSERTeq(value, i + 1);
+
+		/* the Key overloads still work */
+		UT_ASSERTeq(map->count(id_key(i)), 1);
+	}
+
+	UT_ASSERTeq(map->count(NUMBER_ITEMS), 0);
+
+	for (int i = 0; i < NUMBER_ITEMS; i += 2) {
+		UT_ASSERT(map->erase(i));
+		UT_ASSERT(!map->erase(i));
+	}
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS / 2));
+
+	for (int i = 0; i < NUMBER_ITEMS; i++)
+		UT_ASSERTeq(map->count(i), size_t(i % 2));
+
+	pmem::detail::destroy<map_type>(*map);
+}
+
+/*
+ * bucket_layout_test -- (internal) test cache line aligned buckets with
+ * fingerprints
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+ * hash_compare<nvobj::p<int>>, cache_aligned_bucket_layout<true>>
+ */
+void
+bucket_layout_test(nvobj::pool<root> &pop)
+{
+	using map_type = persistent_map_fingerprints_type;
+
+	using nvobj::experimental::cache_aligned_bucket_layout;
+	using nvobj::experimental::internal::hash_map_bucket;
+
+	using padded_layout = cache_aligned_bucket_layout<>;
+	using fingerprints_layout = cache_aligned_bucket_layout<true>;
+
+	static_assert(sizeof(hash_map_bucket<padded_layout, false>) % 64 == 0,
+		      "bucket is not padded");
+	static_assert(sizeof(hash_map_bucket<padded_layout, true>) % 64 == 0,
+		      "bucket is not padded");
+	static_assert(sizeof(hash_map_bucket<fingerprints_layout, false>) %
+				      64 ==
+			      0,
+		      "bucket is not padded");
+
+	auto &map = pop.root()->map_fingerprints;
+
+	tx_alloc_wrapper<map_type>(pop, map);
+
+	map->initialize();
+
+	const int NUMBER_ITEMS = 1000;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(map_type::value_type(i, i)));
+		UT_ASSERT(!map->insert(map_type::value_type(i, i)));
+	}
+
+	auto check = [&](int n) {
+		for (int i = 0; i < 2 * NUMBER_ITEMS; i++) {
+			bool present = i < n && i % 2 == 0;
+			UT_ASSERTeq(map->count(i), size_t(present));
+
+			map_type::const_accessor acc;
+			UT_ASSERT(map->find(acc, i) == present);
+
+			nvobj::p<int> value;
+			UT_ASSERT(map->find_optimistic(i, value) == present);
+		}
+	};
+
+	for (int i = 1; i < NUMBER_ITEMS; i += 2)
+		UT_ASSERT(map->erase(i));
+
+	check(NUMBER_ITEMS);
+
+	/* rehashing moves the fingerprints with the nodes */
+	map->rehash(NUMBER_ITEMS * 4);
+	check(NUMBER_ITEMS);
+
+	UT_ASSERT(static_cast<aligned_buckets_map &>(*map).buckets_aligned());
+
+	/* fingerprints are rebuilt */
+	map->initialize();
+	check(NUMBER_ITEMS);
+
+	for (int i = NUMBER_ITEMS / 2; i < NUMBER_ITEMS; i += 2)
+		UT_ASSERT(map->erase(i));
+
+	map->shrink_to_fit();
+	check(NUMBER_ITEMS / 2);
+
+	map->clear();
+	check(0);
+
+	std::vector<map_type::value_type> items;
+	for (int i = 0; i < NUMBER_ITEMS; i += 2)
+		items.emplace_back(i, i);
+
+	UT_ASSERTeq(map->insert_bulk(items.begin(), items.end()),
+		    items.size());
+	check(NUMBER_ITEMS);
+
+	/* a table must not be opened with a different bucket layout */
+	nvobj::persistent_ptr<persistent_map_type> other(map.raw());
+
+	try {
+		other->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	pmem::detail::destroy<map_type>(*map);
+}
+
+/*
+ * tx_node_allocation_test -- (internal) test inserts of values which can be
+ * copied only in a transaction
+ */
+template <typename MapType>
+void
+tx_node_allocation_test(nvobj::pool<root> &pop,
+			nvobj::persistent_ptr<MapType> &map)
+{
+	tx_alloc_wrapper<MapType>(pop, map);
+
+	map->initialize();
+
+	const int NUMBER_ITEMS = 100;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(
+			typename MapType::value_type(i, tx_only_value(i))));
+	}
+
+	UT_ASSERTeq(map->size(), size_t(NUMBER_ITEMS));
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		typename MapType::const_accessor acc;
+		UT_ASSERT(map->find(acc, i));
+		UT_ASSERTeq(acc->second.val, i);
+	}
+
+	pmem::detail::destroy<MapType>(*map);
+}
+
+/*
+ * node_allocation_test -- (internal) test atomic and transactional node
+ * allocation policies
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, tx_only_value,
+ * hash_compare<nvobj::p<int>>, compact_bucket_layout,
+ * transactional_node_allocation>
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, tx_only_value>
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, atomic_value,
+ * hash_compare<nvobj::p<int>>, compact_bucket_layout,
+ * atomic_node_allocation>
+ */
+void
+node_allocation_test(nvobj::pool<root> &pop)
+{
+	tx_node_allocation_test(pop, pop.root()->map_tx);
+
+	/* the default policy is the transactional one */
+	tx_node_allocation_test(pop, pop.root()->map_default);
+
+	auto &map_atomic = pop.root()->map_atomic;
+
+	tx_alloc_wrapper<persistent_map_atomic_type>(pop, map_atomic);
+
+	map_atomic->initialize();
+
+	const int NUMBER_ITEMS = 100;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		persistent_map_atomic_type::const_accessor acc;
+		UT_ASSERT(map_atomic->try_emplace(acc, i, i));
+	}
+
+	/* the reserved node is released if its constructor throws */
+	try {
+		persistent_map_atomic_type::const_accessor acc;
+		map_atomic->try_emplace(acc, NUMBER_ITEMS, -1);
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(map_atomic->size(), size_t(NUMBER_ITEMS));
+	UT_ASSERTeq(map_atomic->count(NUMBER_ITEMS), 0);
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		persistent_map_atomic_type::const_accessor acc;
+		UT_ASSERT(map_atomic->find(acc, i));
+		UT_ASSERTeq(acc->second.val, i);
+	}
+
+	map_atomic->initialize();
+	UT_ASSERTeq(map_atomic->size(), size_t(NUMBER_ITEMS));
+
+	pmem::detail::destroy<persistent_map_atomic_type>(*map_atomic);
+}
+
+/*
+ * check_occupancy -- (internal) check the histogram and the segments of
+ * statistics of a table with the given number of elements
+ */
+void
+check_occupancy(const nvobj::experimental::concurrent_hash_map_stats &stats,
+		size_t elements)
+{
+	size_t buckets = 0, nodes = 0, used_buckets = 0;
+
+	for (auto &s : stats.segments) {
+		UT_ASSERT(s.used_buckets <= s.buckets);
+		UT_ASSERT(s.used_buckets <= s.nodes);
+
+		buckets += s.buckets;
+		nodes += s.nodes;
+		used_buckets += s.used_buckets;
+	}
+
+	UT_ASSERTeq(nodes, elements);
+
+	size_t histogram_buckets = 0;
+	for (auto n : stats.chain_length)
+		histogram_buckets += n;
+
+	UT_ASSERTeq(histogram_buckets, buckets);
+	UT_ASSERTeq(stats.chain_length[0], buckets - used_buckets);
+
+	/* the number of buckets is a power of two */
+	UT_ASSERTeq(buckets & (buckets - 1), 0);
+}
+
+/*
+ * stats_test -- (internal) test statistics of the table
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+ * hash_compare, compact_bucket_layout, atomic_node_allocation,
+ * collect_statistics>
+ */
+void
+stats_test(nvobj::pool<root> &pop)
+{
+	auto &map = pop.root()->map_stats;
+	auto &map1 = pop.root()->map1;
+
+	tx_alloc_wrapper<persistent_map_stats_type>(pop, map);
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	map->initialize();
+	map1->initialize();
+
+	auto stats = map->stats();
+
+	UT_ASSERTeq(stats.restarts, 0);
+	UT_ASSERTeq(stats.backoff_pauses, 0);
+	UT_ASSERTeq(stats.rehashed_buckets, 0);
+	UT_ASSERTeq(stats.segments.size(), 1);
+	check_occupancy(stats, 0);
+
+	const int NUMBER_ITEMS = 1000;
+
+	for (int i = 0; i < NUMBER_ITEMS; i++) {
+		UT_ASSERT(map->insert(
+			persistent_map_stats_type::value_type(i, i)));
+		UT_ASSERT(map1->insert(value_type(i, i)));
+	}
+
+	map->rehash();
+	map1->rehash();
+
+	stats = map->stats();
+
+	UT_ASSERT(stats.rehashed_buckets > 0);
+	UT_ASSERTeq(stats.restarts, 0);
+	UT_ASSERTeq(stats.backoff_pauses, 0);
+	UT_ASSERT(stats.segments.size() > 1);
+	check_occupancy(stats, NUMBER_ITEMS);
+
+	/* the counters are not collected by default */
+	auto stats1 = map1->stats();
+
+	UT_ASSERTeq(stats1.rehashed_buckets, 0);
+	UT_ASSERTeq(stats1.segments.size(), stats.segments.size());
+	check_occupancy(stats1, NUMBER_ITEMS);
+
+	for (int i = 0; i < NUMBER_ITEMS; i += 2)
+		UT_ASSERT(map->erase(i));
+
+	check_occupancy(map->stats(), NUMBER_ITEMS / 2);
+
+	/* the counters are a part of the layout of the table */
+	using no_stats_type = persistent_map_growth_type<
+		nvobj::experimental::load_factor_growth<1>>;
+	nvobj::persistent_ptr<no_stats_type> no_stats(map.raw());
+
+	try {
+		no_stats->initialize();
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	pmem::detail::destroy<persistent_map_stats_type>(*map);
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
+
+/*
+ * check_growth_policy -- (internal) fill the map, check that its load factor
+ * does not exceed the maximum one and that reserve() and shrink_to_fit()
+ * follow it
+ */
+template <typename Map>
+void
+check_growth_policy(Map &map, int n_items)
+{
+	map.initialize();
+
+	for (int i = 0; i < n_items; i++)
+		UT_ASSERT(map.insert(typename Map::value_type(i, i)));
+
+	UT_ASSERT(map.load_factor() <= Map::max_load_factor());
+
+	/* the table is at most twice as big as needed */
+	UT_ASSERT(map.load_factor() * 2 > Map::max_load_factor());
+
+	for (int i = 0; i < n_items; i++)
+		UT_ASSERTeq(map.count(i), 1);
+
+	/* reserve() takes the number of elements */
+	size_t buckets = map.bucket_count();
+
+	map.reserve(size_t(n_items) * 4);
+
+	UT_ASSERT(map.bucket_count() > buckets);
+	UT_ASSERT(float(n_items) * 4 / float(map.bucket_count()) <=
+		  Map::max_load_factor());
+
+	map.shrink_to_fit();
+
+	UT_ASSERTeq(map.bucket_count(), buckets);
+	UT_ASSERTeq(map.size(), size_t(n_items));
+
+	for (int i = 0; i < n_items; i++)
+		UT_ASSERTeq(map.count(i), 1);
+}
+
+/*
+ * growth_policy_test -- (internal) test maximum load factors other than 1
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>,
+ * hash_compare, compact_bucket_layout, atomic_node_allocation,
+ * no_statistics, load_factor_growth>
+ */
+void
+growth_policy_test(nvobj::pool<root> &pop)
+{
+	auto &map_dense = pop.root()->map_dense;
+	auto &map_sparse = pop.root()->map_sparse;
+	auto &map1 = pop.root()->map1;
+
+	static_assert(persistent_map_type::max_load_factor() == 1, "");
+	static_assert(persistent_map_dense_type::max_load_factor() == 4, "");
+	static_assert(persistent_map_sparse_type::max_load_factor() == 0.5,
+		      "");
+
+	tx_alloc_wrapper<persistent_map_dense_type>(pop, map_dense);
+	tx_alloc_wrapper<persistent_map_sparse_type>(pop, map_sparse);
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	const int NUMBER_ITEMS = 10000;
+
+	check_growth_policy(*map_dense, NUMBER_ITEMS);
+	check_growth_policy(*map_sparse, NUMBER_ITEMS);
+
+	/* the default table is between the two */
+	for (int i = 0; i < NUMBER_ITEMS; i++)
+		UT_ASSERT(map1->insert(value_type(i, i)));
+
+	UT_ASSERT(map_dense->bucket_count() < map1->bucket_count());
+	UT_ASSERT(map1->bucket_count() < map_sparse->bucket_count());
+
+	pmem::detail::destroy<persistent_map_dense_type>(*map_dense);
+	pmem::detail::destroy<persistent_map_sparse_type>(*map_sparse);
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
 }
 
 int
@@ -420,6 +1324,14 @@ main(int argc, char *argv[])
 	access_test(pop);
 	swap_test(pop);
 	insert_test(pop);
+	emplace_test(pop);
+	cached_hash_test(pop);
+	erase_accessor_test(pop);
+	transparent_lookup_test(pop);
+	bucket_layout_test(pop);
+	node_allocation_test(pop);
+	stats_test(pop);
+	growth_policy_test(pop);
 
 	pop.close();
 
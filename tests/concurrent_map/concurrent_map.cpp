@@ -0,0 +1,396 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * concurrent_map.cpp -- pmem::obj::experimental::concurrent_map test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+
+#define LAYOUT "concurrent_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::experimental::concurrent_map<nvobj::p<int>, nvobj::p<int>>
+	persistent_map_type;
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+template <typename Function>
+void
+parallel_exec(size_t concurrency, Function f)
+{
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency);
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back(f, i);
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+/*
+ * check_order -- (internal) check that the map holds the keys
+ * [0, n * step) which are multiples of step, in ascending order
+ */
+void
+check_order(persistent_map_type &map, int n, int step)
+{
+	int expected = 0;
+	for (auto &e : map) {
+		UT_ASSERTeq(e.first, expected);
+		UT_ASSERTeq(e.second, expected);
+		expected += step;
+	}
+
+	UT_ASSERTeq(expected, n * step);
+	UT_ASSERTeq(map.size(), static_cast<size_t>(n));
+	UT_ASSERTeq(std::distance(map.begin(), map.end()), n);
+}
+
+/*
+ * singlethread_test -- (internal) test lookups, bounds and modifiers of
+ * pmem::obj::experimental::concurrent_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+singlethread_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS = 200;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	UT_ASSERT(map->empty());
+	UT_ASSERT(map->begin() == map->end());
+	UT_ASSERT(map->lower_bound(0) == map->end());
+
+	/* insert even keys in descending order */
+	for (int i = NUMBER_ITEMS - 1; i >= 0; --i) {
+		auto ret = map->insert(
+			persistent_map_type::value_type(i * 2, i * 2));
+		UT_ASSERT(ret.second);
+		UT_ASSERTeq(ret.first->first, i * 2);
+	}
+
+	check_order(*map, NUMBER_ITEMS, 2);
+
+	auto ret = map->insert(persistent_map_type::value_type(10, 0));
+	UT_ASSERT(!ret.second);
+	UT_ASSERTeq(ret.first->second, 10);
+
+	ret = map->try_emplace(20, 0);
+	UT_ASSERT(!ret.second);
+	UT_ASSERTeq(ret.first->second, 20);
+
+	for (int i = 0; i < NUMBER_ITEMS * 2; ++i) {
+		const persistent_map_type &cmap = *map;
+
+		UT_ASSERTeq(cmap.count(i), size_t(i % 2 == 0));
+
+		auto lb = cmap.lower_bound(i);
+		auto ub = cmap.upper_bound(i);
+		int next_even = i + i % 2;
+
+		if (next_even < NUMBER_ITEMS * 2) {
+			UT_ASSERTeq(lb->first, next_even);
+		} else {
+			UT_ASSERT(lb == cmap.end());
+		}
+
+		if (i + 2 - i % 2 < NUMBER_ITEMS * 2) {
+			UT_ASSERTeq(ub->first, i + 2 - i % 2);
+		} else {
+			UT_ASSERT(ub == cmap.end());
+		}
+
+		auto range = cmap.equal_range(i);
+		UT_ASSERTeq(std::distance(range.first, range.second),
+			    i % 2 == 0 ? 1 : 0);
+	}
+
+	UT_ASSERT(map->lower_bound(-1) == map->begin());
+
+	/* odd keys */
+	for (int i = 0; i < NUMBER_ITEMS; ++i) {
+		auto r = i % 2 ? map->emplace(i * 2 + 1, i * 2 + 1)
+			       : map->try_emplace(i * 2 + 1, i * 2 + 1);
+		UT_ASSERT(r.second);
+	}
+
+	check_order(*map, NUMBER_ITEMS * 2, 1);
+
+	auto it = map->find(7);
+	UT_ASSERT(it != map->end());
+	nvobj::transaction::run(pop, [&] { it->second = 70; });
+	UT_ASSERTeq(map->find(7)->second, 70);
+	nvobj::transaction::run(pop, [&] { it->second = 7; });
+
+	/* inserts cannot join a transaction of the caller */
+	nvobj::transaction::run(pop, [&] {
+		try {
+			map->insert(persistent_map_type::value_type(-1, 1));
+			UT_ASSERT(0);
+		} catch (pmem::transaction_scope_error &) {
+		}
+	});
+	UT_ASSERTeq(map->count(-1), 0);
+
+	for (int i = 0; i < NUMBER_ITEMS * 2; i += 2)
+		UT_ASSERTeq(map->unsafe_erase(i + 1), 1);
+
+	UT_ASSERTeq(map->unsafe_erase(1), 0);
+	UT_ASSERTeq(map->unsafe_erase(NUMBER_ITEMS * 2), 0);
+
+	check_order(*map, NUMBER_ITEMS, 2);
+
+	map->clear();
+
+	UT_ASSERT(map->empty());
+	UT_ASSERTeq(map->size(), 0);
+	UT_ASSERT(map->find(0) == map->end());
+}
+
+/*
+ * insert_and_lookup_test -- (internal) test concurrent inserts of
+ * separate keys with lookups and bounds of the inserted ones
+ */
+void
+insert_and_lookup_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 1000;
+
+	// Adding more concurrency will increase DRD test time
+	const size_t concurrency = 8;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->initialize();
+	map->clear();
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		int begin = static_cast<int>(thread_id) * NUMBER_ITEMS_INSERT;
+		int end = begin + NUMBER_ITEMS_INSERT;
+
+		/* interleaved keys of the threads make them contend */
+		for (int i = begin; i < end; ++i) {
+			int key = (i % NUMBER_ITEMS_INSERT) *
+					static_cast<int>(concurrency) +
+				static_cast<int>(thread_id);
+			UT_ASSERT(map->insert(
+					      persistent_map_type::value_type(
+						      key, key))
+					  .second);
+		}
+
+		for (int i = begin; i < end; ++i) {
+			int key = (i % NUMBER_ITEMS_INSERT) *
+					static_cast<int>(concurrency) +
+				static_cast<int>(thread_id);
+			auto it = map->find(key);
+			UT_ASSERT(it != map->end());
+			UT_ASSERTeq(it->second, key);
+
+			/* the next key is not greater than the own next one */
+			auto ub = map->upper_bound(key);
+			UT_ASSERT(ub == map->end() ||
+				  ub->first <=
+					  key + static_cast<int>(concurrency));
+		}
+	});
+
+	check_order(*map, NUMBER_ITEMS_INSERT * static_cast<int>(concurrency),
+		    1);
+}
+
+/*
+ * insert_same_keys_test -- (internal) test concurrent inserts of the same
+ * keys, exactly one of them succeeds for each key
+ */
+void
+insert_same_keys_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 500;
+
+	const size_t concurrency = 8;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->clear();
+
+	std::atomic<int> inserted(0);
+
+	parallel_exec(concurrency, [&](size_t) {
+		for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i) {
+			if (map->try_emplace(i, i).second)
+				++inserted;
+		}
+	});
+
+	UT_ASSERTeq(inserted.load(), NUMBER_ITEMS_INSERT);
+
+	check_order(*map, NUMBER_ITEMS_INSERT, 1);
+}
+
+/*
+ * insert_and_scan_test -- (internal) test range scans concurrent with
+ * inserts, the scanned keys have to be always sorted
+ */
+void
+insert_and_scan_test(nvobj::pool<root> &pop)
+{
+	const int NUMBER_ITEMS_INSERT = 1000;
+
+	const size_t writers = 4;
+	const size_t readers = 4;
+
+	auto map = pop.root()->cons;
+
+	UT_ASSERT(map != nullptr);
+
+	map->clear();
+
+	std::atomic<size_t> running(writers);
+
+	parallel_exec(writers + readers, [&](size_t thread_id) {
+		if (thread_id < writers) {
+			int id = static_cast<int>(thread_id);
+			for (int i = 0; i < NUMBER_ITEMS_INSERT; ++i) {
+				int key = i * static_cast<int>(writers) + id;
+				map->insert(persistent_map_type::value_type(
+					key, key));
+			}
+			--running;
+			return;
+		}
+
+		do {
+			int prev = -1;
+			auto it = map->lower_bound(
+				NUMBER_ITEMS_INSERT *
+				static_cast<int>(thread_id - writers));
+			for (int n = 0; n < 100 && it != map->end(); ++n) {
+				UT_ASSERT(it->first > prev);
+				UT_ASSERTeq(it->first, it->second);
+				prev = it->first;
+				++it;
+			}
+		} while (running.load() != 0);
+	});
+
+	check_order(*map, NUMBER_ITEMS_INSERT * static_cast<int>(writers), 1);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::make_persistent_atomic<persistent_map_type>(
+			pop, pop.root()->cons);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	singlethread_test(pop);
+
+	insert_and_lookup_test(pop);
+
+	insert_same_keys_test(pop);
+
+	insert_and_scan_test(pop);
+
+	size_t size = pop.root()->cons->size();
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	auto map = pop.root()->cons;
+
+	map->initialize();
+
+	UT_ASSERTeq(map->size(), size);
+	UT_ASSERTeq(std::distance(map->begin(), map->end()),
+		    static_cast<ptrdiff_t>(size));
+
+	map->clear();
+
+	pop.close();
+
+	return 0;
+}
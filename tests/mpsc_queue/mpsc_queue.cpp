@@ -0,0 +1,315 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mpsc_queue.cpp -- pmem::obj::experimental::mpsc_queue test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/experimental/mpsc_queue.hpp>
+
+#define LAYOUT "mpsc_queue"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+struct record {
+	size_t producer;
+	size_t seq;
+};
+
+typedef nvobj::experimental::mpsc_queue<record> queue_type;
+
+struct root {
+	nvobj::persistent_ptr<queue_type> queue;
+};
+
+const size_t PRODUCERS = 4;
+const size_t CAPACITY = 64;
+
+template <typename Function>
+void
+parallel_exec(size_t concurrency, Function f)
+{
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency);
+
+	for (size_t i = 0; i < concurrency; ++i) {
+		threads.emplace_back(f, i);
+	}
+
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+/*
+ * consume_all -- (internal) drain the queue and check that the records of
+ * each producer come in order, starting from next[producer]
+ */
+size_t
+consume_all(queue_type &queue, std::vector<size_t> &next)
+{
+	return queue.try_consume_batch([&](queue_type::const_range range) {
+		UT_ASSERT(range.size() > 0);
+		for (auto &r : range) {
+			UT_ASSERT(r.producer < next.size());
+			UT_ASSERTeq(r.seq, next[r.producer]);
+			++next[r.producer];
+		}
+	});
+}
+
+/*
+ * singlethread_test -- (internal) test full rings, wrap around and
+ * all-or-nothing batches
+ */
+void
+singlethread_test(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+
+	UT_ASSERTeq(queue.capacity(), CAPACITY);
+	UT_ASSERTeq(queue.max_producers(), PRODUCERS);
+	UT_ASSERT(queue.empty());
+
+	auto producer = queue.register_producer();
+	std::vector<size_t> next(PRODUCERS, 0);
+
+	size_t seq = 0;
+	for (; seq < CAPACITY; ++seq)
+		UT_ASSERT(producer.try_produce(record{0, seq}));
+
+	UT_ASSERT(!producer.try_produce(record{0, seq}));
+	UT_ASSERTeq(queue.size(), CAPACITY);
+
+	UT_ASSERTeq(consume_all(queue, next), CAPACITY);
+	UT_ASSERT(queue.empty());
+	UT_ASSERTeq(consume_all(queue, next), 0);
+
+	/* move the ring positions to the middle so the next batch wraps */
+	for (size_t i = 0; i < CAPACITY / 2; ++i)
+		UT_ASSERT(producer.try_produce(record{0, seq++}));
+	UT_ASSERTeq(consume_all(queue, next), CAPACITY / 2);
+
+	std::vector<record> batch;
+	for (size_t i = 0; i < CAPACITY; ++i)
+		batch.push_back(record{0, seq++});
+
+	UT_ASSERT(producer.try_produce(batch.data(),
+				       batch.data() + batch.size()));
+	UT_ASSERT(!producer.try_produce(batch.data(), batch.data() + 1));
+	UT_ASSERTeq(queue.size(), CAPACITY);
+
+	size_t ranges = 0;
+	queue.try_consume_batch([&](queue_type::const_range range) {
+		UT_ASSERTeq(range.size(), CAPACITY / 2);
+		for (auto &r : range)
+			UT_ASSERTeq(r.seq, next[0]++);
+		++ranges;
+	});
+	UT_ASSERTeq(ranges, 2);
+	UT_ASSERT(queue.empty());
+
+	/* a batch bigger than the free space is rejected as a whole */
+	UT_ASSERT(producer.try_produce(batch.data(), batch.data() + 1));
+	UT_ASSERT(!producer.try_produce(batch.data(),
+					batch.data() + batch.size()));
+	UT_ASSERTeq(queue.size(), 1);
+	queue.try_consume_batch([](queue_type::const_range) {});
+	UT_ASSERT(queue.empty());
+}
+
+/*
+ * concurrent_test -- (internal) produce from all the producers while a
+ * single consumer drains the queue, the records of each producer must be
+ * consumed in order
+ */
+void
+concurrent_test(nvobj::pool<root> &pop, size_t per_producer)
+{
+	auto &queue = *pop.root()->queue;
+
+	const size_t producers = PRODUCERS;
+	std::atomic<size_t> done(0);
+	std::vector<size_t> next(PRODUCERS, 0);
+	size_t consumed = 0;
+
+	parallel_exec(producers + 1, [&](size_t thread_id) {
+		if (thread_id == producers) {
+			while (done.load() != producers || !queue.empty())
+				consumed += consume_all(queue, next);
+			return;
+		}
+
+		auto producer = queue.register_producer();
+		for (size_t i = 0; i < per_producer;) {
+			if (producer.try_produce(record{thread_id, i}))
+				++i;
+			else
+				std::this_thread::yield();
+		}
+		done++;
+	});
+
+	UT_ASSERTeq(consumed, producers * per_producer);
+	for (size_t i = 0; i < producers; ++i)
+		UT_ASSERTeq(next[i], per_producer);
+}
+
+/*
+ * registration_test -- (internal) destroyed producer handles release their
+ * rings, so registering and unregistering producers does not exhaust them
+ */
+void
+registration_test(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+
+	parallel_exec(PRODUCERS * 2, [&](size_t) {
+		for (size_t i = 0; i < 100; ++i) {
+			try {
+				auto producer = queue.register_producer();
+			} catch (std::length_error &) {
+			}
+		}
+	});
+
+	std::vector<queue_type::producer> producers;
+	for (size_t i = 0; i < PRODUCERS; ++i)
+		producers.push_back(queue.register_producer());
+
+	try {
+		queue.register_producer();
+		UT_ASSERT(0);
+	} catch (std::length_error &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	/* records of an unregistered producer stay in the queue */
+	UT_ASSERT(producers.back().try_produce(record{0, 0}));
+	producers.pop_back();
+
+	auto producer = queue.register_producer();
+	UT_ASSERT(producer.try_produce(record{0, 1}));
+
+	std::vector<size_t> next(PRODUCERS, 0);
+	UT_ASSERTeq(consume_all(queue, next), 2);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->queue = nvobj::make_persistent<queue_type>(
+				PRODUCERS, CAPACITY - 1);
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	singlethread_test(pop);
+
+	concurrent_test(pop, 10000);
+
+	registration_test(pop);
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	auto &queue = *pop.root()->queue;
+	UT_ASSERT(queue.empty());
+
+	/* registrations are volatile, all producers are available again */
+	std::vector<queue_type::producer> producers;
+	for (size_t i = 0; i < PRODUCERS; ++i) {
+		producers.push_back(queue.register_producer());
+		for (size_t seq = 0; seq < CAPACITY / 2; ++seq)
+			UT_ASSERT(producers[i].try_produce(record{i, seq}));
+	}
+	UT_ASSERTeq(queue.size(), PRODUCERS * CAPACITY / 2);
+
+	producers.clear();
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	/* published, but not consumed records survive reopening */
+	std::vector<size_t> next(PRODUCERS, 0);
+	UT_ASSERTeq(consume_all(*pop.root()->queue, next),
+		    PRODUCERS * CAPACITY / 2);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<queue_type>(pop.root()->queue);
+	});
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * mpsc_queue_pmreorder.cpp -- pmem::obj::experimental::mpsc_queue test under
+ * pmreorder
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <thread>
+
+#include <libpmemobj++/experimental/mpsc_queue.hpp>
+
+#define LAYOUT "pmreorder"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::experimental::mpsc_queue<size_t> queue_type;
+
+struct root {
+	nvobj::persistent_ptr<queue_type> queue;
+};
+
+const size_t PRODUCERS = 1;
+const size_t CAPACITY = 8;
+
+/* records produced in total, every slot of the ring is reused a few times */
+const size_t RECORDS = CAPACITY * 4;
+
+void
+init(nvobj::pool<root> &pop)
+{
+	try {
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->queue =
+				nvobj::make_persistent<queue_type>(PRODUCERS,
+								   CAPACITY);
+		});
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+/*
+ * run_queue -- (internal) produce consecutive numbers while another thread
+ * consumes them, so the producer reuses slots right after they are consumed
+ */
+void
+run_queue(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+
+	std::thread producer_thread([&] {
+		auto producer = queue.register_producer();
+		for (size_t i = 0; i < RECORDS;) {
+			if (producer.try_produce(i))
+				++i;
+			else
+				std::this_thread::yield();
+		}
+	});
+
+	size_t next = 0;
+	while (next != RECORDS) {
+		queue.try_consume_batch([&](queue_type::const_range range) {
+			for (auto &r : range)
+				UT_ASSERTeq(r, next++);
+		});
+	}
+
+	producer_thread.join();
+}
+
+/*
+ * check_consistency -- (internal) the records left in the queue after a crash
+ * must fit in the ring and be consecutive numbers, none of them may be
+ * overwritten by a record produced later
+ */
+void
+check_consistency(nvobj::pool<root> &pop)
+{
+	auto &queue = *pop.root()->queue;
+
+	size_t size = queue.size();
+	UT_ASSERT(size <= queue.capacity());
+
+	size_t consumed = 0;
+	size_t next = 0;
+	queue.try_consume_batch([&](queue_type::const_range range) {
+		for (auto &r : range) {
+			if (consumed != 0)
+				UT_ASSERTeq(r, next);
+
+			UT_ASSERT(r < RECORDS);
+			next = r + 1;
+			++consumed;
+		}
+	});
+
+	UT_ASSERTeq(consumed, size);
+	UT_ASSERT(queue.empty());
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc != 3 || strchr("coi", argv[1][0]) == nullptr)
+		UT_FATAL("usage: %s <c|o|i> file-name", argv[0]);
+
+	const char *path = argv[2];
+
+	nvobj::pool<root> pop;
+
+	try {
+		if (argv[1][0] == 'o') {
+			pop = nvobj::pool<root>::open(path, LAYOUT);
+
+			check_consistency(pop);
+		} else if (argv[1][0] == 'c') {
+			pop = nvobj::pool<root>::create(path, LAYOUT,
+							PMEMOBJ_MIN_POOL * 20,
+							S_IWUSR | S_IRUSR);
+
+			init(pop);
+		} else if (argv[1][0] == 'i') {
+			pop = nvobj::pool<root>::open(path, LAYOUT);
+
+			run_queue(pop);
+		}
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * ptr_resolver.cpp -- pmem::obj::experimental::ptr_resolver test
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/ptr_resolver.hpp>
+
+#include <string>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+const int n_nodes = 100;
+const int n_values = 10;
+
+struct node {
+	node(int v, nvobj::persistent_ptr<node> n) : value(v), next(n)
+	{
+	}
+
+	nvobj::p<int> value;
+	nvobj::persistent_ptr<node> next;
+};
+
+struct root {
+	nvobj::persistent_ptr<node> head;
+	nvobj::persistent_ptr<int[]> values;
+};
+
+/*
+ * test_list -- (internal) the resolver returns the same pointers as
+ * persistent_ptr::get() while walking a list
+ */
+void
+test_list(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		for (int i = 0; i < n_nodes; ++i)
+			r->head = nvobj::make_persistent<node>(i, r->head);
+	});
+
+	nvobjexp::ptr_resolver res(pop);
+
+	UT_ASSERT(res.get(nvobj::persistent_ptr<node>()) == nullptr);
+
+	int expected = n_nodes - 1;
+	auto ptr = r->head;
+	for (node *n = res.get(r->head); n != nullptr; n = res.get(n->next)) {
+		UT_ASSERT(n == ptr.get());
+		UT_ASSERTeq(n->value, expected);
+
+		ptr = n->next;
+		--expected;
+	}
+
+	UT_ASSERTeq(expected, -1);
+	UT_ASSERT(res.get(nvobj::persistent_ptr<node>()) == nullptr);
+	UT_ASSERT(res.get(OID_NULL) == nullptr);
+	UT_ASSERT(res.get(r->head.raw()) == r->head.get());
+}
+
+/*
+ * test_array -- (internal) pointers to arrays resolve to the first element
+ */
+void
+test_array(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	nvobj::transaction::run(pop, [&] {
+		r->values = nvobj::make_persistent<int[]>(n_values);
+		for (int i = 0; i < n_values; ++i)
+			r->values[i] = i;
+	});
+
+	nvobjexp::ptr_resolver res(pop);
+
+	int *values = res.get(r->values);
+	UT_ASSERT(values == r->values.get());
+	for (int i = 0; i < n_values; ++i)
+		UT_ASSERTeq(values[i], i);
+}
+
+/*
+ * test_other_pool -- (internal) pointers to a different pool are resolved
+ * correctly, before and after the pool of the resolver is learned
+ */
+void
+test_other_pool(nvobj::pool<root> &pop, nvobj::pool<root> &other)
+{
+	auto r = pop.root();
+	auto o = other.root();
+
+	nvobj::transaction::run(other, [&] {
+		o->head = nvobj::make_persistent<node>(-1, nullptr);
+	});
+
+	nvobjexp::ptr_resolver res(pop);
+
+	UT_ASSERT(res.get(o->head) == o->head.get());
+	UT_ASSERT(res.get(r->head) == r->head.get());
+	UT_ASSERT(res.get(o->head) == o->head.get());
+	UT_ASSERTeq(res.get(o->head)->value, -1);
+	UT_ASSERT(res.get(r->head->next) == r->head->next.get());
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	std::string path = argv[1];
+
+	nvobj::pool<root> pop, other;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+		other = nvobj::pool<root>::create(path + "_other", LAYOUT,
+						  PMEMOBJ_MIN_POOL,
+						  S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path.c_str());
+	}
+
+	test_list(pop);
+	test_array(pop);
+	test_other_pool(pop, other);
+
+	pop.close();
+	other.close();
+
+	return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * radix_tree.cpp -- pmem::obj::experimental::radix_tree test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/radix_tree.hpp>
+#include <libpmemobj++/experimental/string.hpp>
+
+#include <iterator>
+#include <map>
+#include <string>
+
+#define LAYOUT "radix_tree"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+typedef nvobjexp::radix_tree<nvobjexp::string, nvobj::p<int>> string_tree_type;
+typedef nvobjexp::radix_tree<int64_t, nvobj::p<int>> int_tree_type;
+
+struct root {
+	nvobj::persistent_ptr<string_tree_type> strings;
+	nvobj::persistent_ptr<int_tree_type> ints;
+};
+
+std::string
+to_std(const nvobjexp::string &s)
+{
+	return std::string(s.cdata(), s.size());
+}
+
+/*
+ * check_content -- (internal) compare the tree with the reference map in
+ * both directions
+ */
+void
+check_content(string_tree_type &tree, const std::map<std::string, int> &ref)
+{
+	UT_ASSERTeq(tree.size(), ref.size());
+	UT_ASSERTeq(tree.empty(), ref.empty());
+
+	auto it = tree.begin();
+	for (auto &e : ref) {
+		UT_ASSERT(it != tree.end());
+		UT_ASSERT(to_std(it->first) == e.first);
+		UT_ASSERTeq(it->second, e.second);
+		++it;
+	}
+	UT_ASSERT(it == tree.end());
+
+	auto rit = tree.rbegin();
+	for (auto e = ref.rbegin(); e != ref.rend(); ++e, ++rit)
+		UT_ASSERT(to_std(rit->first) == e->first);
+	UT_ASSERT(rit == tree.rend());
+}
+
+/*
+ * string_keys_test -- (internal) test keys which are prefixes of each
+ * other, bounds and heterogeneous lookups with std::string
+ */
+void
+string_keys_test(nvobj::pool<root> &pop)
+{
+	auto &tree = *pop.root()->strings;
+
+	std::map<std::string, int> ref;
+
+	/* the last key does not fit in the small string buffer */
+	const std::string keys[] = {"", "a", "ab", "abc", "abd", "abcd", "b",
+				    "ba", "\xff", "a\x01", "a\xf0",
+				    std::string(40, 'z')};
+
+	int v = 0;
+	for (auto &k : keys) {
+		auto ret = tree.try_emplace(k, v);
+		UT_ASSERT(ret.second);
+		UT_ASSERT(to_std(ret.first->first) == k);
+		ref.emplace(k, v++);
+	}
+
+	check_content(tree, ref);
+
+	for (auto &k : keys) {
+		UT_ASSERTeq(tree.count(k), 1);
+		UT_ASSERT(!tree.try_emplace(k, -1).second);
+		UT_ASSERTeq(tree.find(k)->second, ref[k]);
+	}
+
+	const std::string probes[] = {"aa", "abb", "abcc", "abce", "b\x01",
+				      "c", "\x01", "a\x02", "ab\xff", "abcde",
+				      std::string(41, 'z')};
+	for (auto &k : probes) {
+		UT_ASSERTeq(tree.count(k), 0);
+		UT_ASSERT(tree.find(k) == tree.end());
+
+		auto lb = tree.lower_bound(k);
+		auto ref_lb = ref.lower_bound(k);
+		if (ref_lb == ref.end())
+			UT_ASSERT(lb == tree.end());
+		else
+			UT_ASSERT(to_std(lb->first) == ref_lb->first);
+
+		auto ub = tree.upper_bound(k);
+		auto ref_ub = ref.upper_bound(k);
+		if (ref_ub == ref.end())
+			UT_ASSERT(ub == tree.end());
+		else
+			UT_ASSERT(to_std(ub->first) == ref_ub->first);
+	}
+
+	UT_ASSERT(to_std(tree.upper_bound(std::string("ab"))->first) == "abc");
+
+	/* prefix scan */
+	size_t n = 0;
+	for (auto it = tree.lower_bound(std::string("ab"));
+	     it != tree.end() && to_std(it->first).compare(0, 2, "ab") == 0;
+	     ++it)
+		++n;
+	UT_ASSERTeq(n, 4);
+
+	/* insert_or_assign and emplace */
+	auto ret = tree.insert_or_assign(std::string("ab"), 100);
+	UT_ASSERT(!ret.second);
+	UT_ASSERTeq(ret.first->second, 100);
+	ref["ab"] = 100;
+
+	ret = tree.insert_or_assign(std::string("abx"), 101);
+	UT_ASSERT(ret.second);
+	ref["abx"] = 101;
+
+	ret = tree.emplace(std::piecewise_construct,
+			   std::forward_as_tuple("abx"),
+			   std::forward_as_tuple(-1));
+	UT_ASSERT(!ret.second);
+	UT_ASSERTeq(ret.first->second, 101);
+
+	ret = tree.emplace(std::piecewise_construct,
+			   std::forward_as_tuple("aby"),
+			   std::forward_as_tuple(102));
+	UT_ASSERT(ret.second);
+	ref["aby"] = 102;
+
+	check_content(tree, ref);
+
+	/* erase by key and by iterator */
+	UT_ASSERTeq(tree.erase(std::string("ab")), 1);
+	UT_ASSERTeq(tree.erase(std::string("ab")), 0);
+	ref.erase("ab");
+
+	auto next = tree.erase(tree.find(std::string("abc")));
+	UT_ASSERT(to_std(next->first) == "abcd");
+	ref.erase("abc");
+
+	UT_ASSERTeq(tree.erase(std::string("")), 1);
+	ref.erase("");
+
+	check_content(tree, ref);
+
+	/* aborted insert leaves the tree intact */
+	try {
+		nvobj::transaction::run(pop, [&] {
+			tree.try_emplace(std::string("abca"), 1);
+			tree.erase(std::string("a"));
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	}
+
+	check_content(tree, ref);
+
+	for (auto &e : ref)
+		UT_ASSERTeq(tree.erase(e.first), 1);
+
+	UT_ASSERT(tree.empty());
+	UT_ASSERT(tree.begin() == tree.end());
+	UT_ASSERT(tree.lower_bound(std::string("a")) == tree.end());
+}
+
+/*
+ * int_keys_test -- (internal) test the order of signed integral keys
+ */
+void
+int_keys_test(nvobj::pool<root> &pop)
+{
+	auto &tree = *pop.root()->ints;
+
+	for (int64_t i = -300; i <= 300; i += 3)
+		tree.insert(int_tree_type::value_type(i, static_cast<int>(i)));
+
+	int64_t expected = -300;
+	for (auto &e : tree) {
+		UT_ASSERTeq(e.first, expected);
+		expected += 3;
+	}
+	UT_ASSERTeq(expected, 303);
+	UT_ASSERTeq(tree.size(), 201);
+
+	UT_ASSERTeq(tree.lower_bound(-1)->first, 0);
+	UT_ASSERTeq(tree.lower_bound(-3)->first, -3);
+	UT_ASSERTeq(tree.upper_bound(-3)->first, 0);
+	UT_ASSERT(tree.lower_bound(301) == tree.end());
+	UT_ASSERTeq(tree.lower_bound(INT64_MIN)->first, -300);
+
+	auto last = tree.end();
+	--last;
+	UT_ASSERTeq(last->first, 300);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->strings =
+				nvobj::make_persistent<string_tree_type>();
+			pop.root()->ints =
+				nvobj::make_persistent<int_tree_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	string_keys_test(pop);
+
+	int_keys_test(pop);
+
+	pop.close();
+
+	/* the size is persistent, nothing is rebuilt after reopening */
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	auto ints = pop.root()->ints;
+	UT_ASSERTeq(ints->size(), 201);
+	UT_ASSERTeq(std::distance(ints->begin(), ints->end()), 201);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<string_tree_type>(
+			pop.root()->strings);
+		nvobj::delete_persistent<int_tree_type>(ints);
+	});
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * segment_vector.cpp -- pmem::obj::experimental::segment_vector test
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <libpmemobj++/experimental/segment_vector.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#define LAYOUT "segment_vector"
+
+namespace nvobj = pmem::obj;
+namespace nvobjexp = pmem::obj::experimental;
+
+namespace
+{
+
+using vector_type = nvobjexp::segment_vector<int>;
+
+struct root {
+	nvobj::persistent_ptr<vector_type> v1;
+	nvobj::persistent_ptr<vector_type> v2;
+};
+
+const int ELEMENTS = 10000;
+
+/*
+ * check_content -- (internal) compare the container with the reference
+ * vector, using indexes and iterators in both directions
+ */
+void
+check_content(const vector_type &v, const std::vector<int> &ref)
+{
+	UT_ASSERTeq(v.size(), ref.size());
+	UT_ASSERTeq(v.empty(), ref.empty());
+	UT_ASSERT(v.capacity() >= v.size());
+
+	for (size_t i = 0; i < ref.size(); ++i)
+		UT_ASSERTeq(v[i], ref[i]);
+
+	UT_ASSERT(std::equal(v.cbegin(), v.cend(), ref.begin()));
+	UT_ASSERT(std::equal(v.crbegin(), v.crend(), ref.rbegin()));
+	UT_ASSERTeq(v.cend() - v.cbegin(),
+		    static_cast<std::ptrdiff_t>(ref.size()));
+}
+
+/*
+ * push_back_test -- (internal) grow the container element by element and
+ * check that the addresses of the elements never change
+ */
+void
+push_back_test(nvobj::pool<root> &pop)
+{
+	auto &v = *pop.root()->v1;
+
+	std::vector<int> ref;
+	std::vector<const int *> addresses;
+	size_t capacity = v.capacity();
+	UT_ASSERTeq(capacity, 0);
+
+	for (int i = 0; i < ELEMENTS; ++i) {
+		v.push_back(i);
+		ref.push_back(i);
+		addresses.push_back(&v.cback());
+
+		/* capacity grows by one segment at a time */
+		if (v.capacity() != capacity) {
+			UT_ASSERTeq(capacity, static_cast<size_t>(i));
+			capacity = v.capacity();
+		}
+	}
+
+	check_content(v, ref);
+
+	for (size_t i = 0; i < addresses.size(); ++i)
+		UT_ASSERTeq(&v.const_at(i), addresses[i]);
+
+	v.reserve(4 * ELEMENTS);
+	UT_ASSERT(v.capacity() >= 4 * ELEMENTS);
+	for (size_t i = 0; i < addresses.size(); ++i)
+		UT_ASSERTeq(&v.const_at(i), addresses[i]);
+
+	v.shrink_to_fit();
+	UT_ASSERT(v.capacity() < 2 * ELEMENTS);
+	check_content(v, ref);
+
+	for (int i = 0; i < ELEMENTS / 2; ++i) {
+		v.pop_back();
+		ref.pop_back();
+	}
+	check_content(v, ref);
+
+	v.emplace_back(-1);
+	ref.push_back(-1);
+	UT_ASSERTeq(v.back(), -1);
+	check_content(v, ref);
+
+	try {
+		v.at(v.size());
+		UT_ASSERT(0);
+	} catch (std::out_of_range &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+}
+
+/*
+ * resize_assign_test -- (internal) test resize, assign, copy, swap and
+ * comparison
+ */
+void
+resize_assign_test(nvobj::pool<root> &pop)
+{
+	auto &v1 = *pop.root()->v1;
+	auto &v2 = *pop.root()->v2;
+
+	v2.resize(100, 7);
+	check_content(v2, std::vector<int>(100, 7));
+
+	v2.resize(20);
+	check_content(v2, std::vector<int>(20, 7));
+
+	v2.resize(30);
+	std::vector<int> ref(20, 7);
+	ref.resize(30);
+	check_content(v2, ref);
+
+	v2 = {1, 2, 3};
+	check_content(v2, std::vector<int>{1, 2, 3});
+	UT_ASSERT(v2 != v1);
+	UT_ASSERT(v1 < v2);
+
+	std::vector<int> ref1(v1.cbegin(), v1.cend());
+	v1.swap(v2);
+	check_content(v1, std::vector<int>{1, 2, 3});
+	check_content(v2, ref1);
+
+	v2 = v1;
+	UT_ASSERT(v1 == v2);
+
+	/* non-const iterators snapshot the elements they access */
+	nvobj::transaction::run(pop, [&] {
+		std::fill(v2.begin(), v2.end(), 5);
+		std::iota(v2.rbegin(), v2.rend(), 10);
+	});
+	check_content(v2, std::vector<int>{12, 11, 10});
+
+	v2.clear();
+	UT_ASSERT(v2.empty());
+	UT_ASSERT(v2.capacity() > 0);
+
+	v2.free_data();
+	UT_ASSERTeq(v2.capacity(), 0);
+}
+
+/*
+ * tx_abort_test -- (internal) check that growing the container and
+ * modifying its elements is rolled back on abort
+ */
+void
+tx_abort_test(nvobj::pool<root> &pop)
+{
+	auto &v = *pop.root()->v1;
+
+	std::vector<int> ref(v.cbegin(), v.cend());
+	size_t capacity = v.capacity();
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			for (int i = 0; i < ELEMENTS; ++i)
+				v.push_back(i);
+			v[0] = -5;
+			v.pop_back();
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+
+	UT_ASSERTeq(v.capacity(), capacity);
+	check_content(v, ref);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->v1 = nvobj::make_persistent<vector_type>();
+			pop.root()->v2 = nvobj::make_persistent<vector_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	push_back_test(pop);
+
+	resize_assign_test(pop);
+
+	tx_abort_test(pop);
+
+	std::vector<int> ref(pop.root()->v1->cbegin(), pop.root()->v1->cend());
+
+	pop.close();
+
+	try {
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::open: %s %s", pe.what(), path);
+	}
+
+	check_content(*pop.root()->v1, ref);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<vector_type>(pop.root()->v1);
+		nvobj::delete_persistent<vector_type>(pop.root()->v2);
+	});
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transaction_callbacks.cpp -- pmem::obj::transaction::register_callback test
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <string>
+#include <vector>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+using stage = nvobj::transaction::stage;
+
+struct root {
+	nvobj::p<int> value;
+};
+
+std::vector<std::string> events;
+
+/*
+ * register_all -- (internal) register a callback for each of the stages,
+ * recording the stage and the given tag
+ */
+void
+register_all(const std::string &tag)
+{
+	nvobj::transaction::register_callback(
+		stage::oncommit, [=] { events.push_back("commit " + tag); });
+	nvobj::transaction::register_callback(
+		stage::onabort, [=] { events.push_back("abort " + tag); });
+	nvobj::transaction::register_callback(
+		stage::finally, [=] { events.push_back("finally " + tag); });
+}
+
+void
+check_events(const std::vector<std::string> &expected)
+{
+	UT_ASSERTeq(events.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i)
+		UT_ASSERT(events[i] == expected[i]);
+
+	events.clear();
+}
+
+/*
+ * test_commit -- (internal) oncommit and finally callbacks run after the
+ * transaction is committed, in the order of registration
+ */
+void
+test_commit(nvobj::pool<root> &pop)
+{
+	nvobj::transaction::run(pop, [&] {
+		register_all("a");
+		register_all("b");
+		pop.root()->value = 1;
+
+		/* nothing runs before the transaction ends */
+		UT_ASSERT(events.empty());
+	});
+
+	check_events({"commit a", "commit b", "finally a", "finally b"});
+
+	{
+		nvobj::transaction::manual tx(pop);
+		register_all("manual");
+		nvobj::transaction::commit();
+	}
+
+	check_events({"commit manual", "finally manual"});
+}
+
+/*
+ * test_abort -- (internal) onabort and finally callbacks run after an
+ * exception or a manual abort
+ */
+void
+test_abort(nvobj::pool<root> &pop)
+{
+	try {
+		nvobj::transaction::run(pop, [&] {
+			register_all("exception");
+			pop.root()->value = 2;
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	check_events({"abort exception", "finally exception"});
+	UT_ASSERTeq(pop.root()->value, 1);
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			register_all("manual");
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	}
+
+	check_events({"abort manual", "finally manual"});
+
+	{
+		nvobj::transaction::manual tx(pop);
+		register_all("uncommitted");
+	}
+
+	check_events({"abort uncommitted", "finally uncommitted"});
+}
+
+/*
+ * test_nested -- (internal) callbacks of nested transactions run once, when
+ * the outermost transaction ends, and follow its outcome
+ */
+void
+test_nested(nvobj::pool<root> &pop)
+{
+	nvobj::transaction::run(pop, [&] {
+		register_all("outer");
+		nvobj::transaction::run(pop, [&] { register_all("inner"); });
+		UT_ASSERT(events.empty());
+	});
+
+	check_events({"commit outer", "commit inner", "finally outer",
+		      "finally inner"});
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			nvobj::transaction::run(pop,
+						[&] { register_all("inner"); });
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	check_events({"abort inner", "finally inner"});
+}
+
+/*
+ * test_new_tx_in_callback -- (internal) a callback may start a transaction
+ * which registers its own callbacks
+ */
+void
+test_new_tx_in_callback(nvobj::pool<root> &pop)
+{
+	nvobj::transaction::run(pop, [&] {
+		nvobj::transaction::register_callback(stage::oncommit, [&] {
+			UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_NONE);
+			nvobj::transaction::run(pop, [&] {
+				pop.root()->value = 3;
+				register_all("second");
+			});
+			events.push_back("first done");
+		});
+		nvobj::transaction::register_callback(stage::finally, [] {
+			events.push_back("finally first");
+		});
+	});
+
+	/* the finally callback of the first transaction runs only once */
+	check_events({"commit second", "finally second", "first done",
+		      "finally first"});
+	UT_ASSERTeq(pop.root()->value, 3);
+}
+
+/*
+ * test_errors -- (internal) callbacks can be registered only in the work
+ * stage of a transaction and only for the final stages
+ */
+void
+test_errors(nvobj::pool<root> &pop)
+{
+	try {
+		nvobj::transaction::register_callback(stage::oncommit, [] {});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	}
+
+	nvobj::transaction::run(pop, [&] {
+		try {
+			nvobj::transaction::register_callback(stage::work,
+							      [] {});
+			UT_ASSERT(0);
+		} catch (pmem::transaction_scope_error &) {
+		}
+	});
+
+	/* a transaction started with the C API has no callback support */
+	UT_ASSERTeq(pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_NONE),
+		    0);
+	try {
+		nvobj::transaction::register_callback(stage::oncommit, [] {});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	}
+	pmemobj_tx_commit();
+	(void)pmemobj_tx_end();
+
+	UT_ASSERT(events.empty());
+}
+
+/*
+ * test_capacity -- (internal) registering more callbacks than a stage can
+ * hold throws, the registered ones still run
+ */
+void
+test_capacity(nvobj::pool<root> &pop)
+{
+	const int capacity = 16;
+	int calls = 0;
+
+	nvobj::transaction::run(pop, [&] {
+		for (int i = 0; i < capacity; ++i)
+			nvobj::transaction::register_callback(
+				stage::oncommit, [&] { ++calls; });
+
+		try {
+			nvobj::transaction::register_callback(
+				stage::oncommit, [&] { ++calls; });
+			UT_ASSERT(0);
+		} catch (pmem::transaction_error &) {
+		}
+
+		/* other stages have their own lists */
+		nvobj::transaction::register_callback(stage::finally,
+						      [&] { ++calls; });
+	});
+
+	UT_ASSERTeq(calls, capacity + 1);
+
+	/* the lists are empty again */
+	calls = 0;
+	nvobj::transaction::run(pop, [&] {
+		for (int i = 0; i < capacity; ++i)
+			nvobj::transaction::register_callback(
+				stage::oncommit, [&] { ++calls; });
+	});
+
+	UT_ASSERTeq(calls, capacity);
+}
+
+/*
+ * c_callback -- (internal) stage callback of a transaction started with
+ * the C API
+ */
+void
+c_callback(PMEMobjpool *, enum pobj_tx_stage stage, void *)
+{
+	if (stage == TX_STAGE_NONE)
+		events.push_back("c callback");
+}
+
+/*
+ * register_in_nested -- (internal) start a transaction nested in the
+ * current one, check that callbacks cannot be registered in it
+ */
+void
+register_in_nested(nvobj::pool<root> &pop)
+{
+	nvobj::transaction::run(pop, [&] {
+		pop.root()->value = 5;
+
+		try {
+			nvobj::transaction::register_callback(stage::oncommit,
+							      [] {});
+			UT_ASSERT(0);
+		} catch (pmem::transaction_scope_error &) {
+		}
+	});
+}
+
+/*
+ * test_nested_in_c_tx -- (internal) a transaction nested in one started
+ * with the C API keeps the callback of the outer transaction
+ */
+void
+test_nested_in_c_tx(nvobj::pool<root> &pop)
+{
+	/* outer transaction with its own callback */
+	UT_ASSERTeq(pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_CB,
+				     c_callback, nullptr, TX_PARAM_NONE),
+		    0);
+	register_in_nested(pop);
+	UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_WORK);
+	pmemobj_tx_commit();
+	UT_ASSERTeq(pmemobj_tx_end(), 0);
+
+	check_events({"c callback"});
+
+	/* outer transaction without a callback */
+	UT_ASSERTeq(pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_NONE),
+		    0);
+	register_in_nested(pop);
+	UT_ASSERTeq(pmemobj_tx_stage(), TX_STAGE_WORK);
+	pmemobj_tx_commit();
+	UT_ASSERTeq(pmemobj_tx_end(), 0);
+
+	UT_ASSERT(events.empty());
+	UT_ASSERTeq(pop.root()->value, 5);
+
+	/* callbacks still work in the next transaction */
+	nvobj::transaction::run(pop, [&] { register_all("after"); });
+
+	check_events({"commit after", "finally after"});
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_commit(pop);
+	test_abort(pop);
+	test_nested(pop);
+	test_new_tx_in_callback(pop);
+	test_errors(pop);
+	test_nested_in_c_tx(pop);
+	test_capacity(pop);
+
+	pop.close();
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2018-2019, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * transaction_snapshot_cache.cpp -- test of the per-thread cache of ranges
+ * added to a transaction
+ */
+
+#include "unittest.hpp"
+
+#define LIBPMEMOBJ_CPP_TX_SNAPSHOT_CACHE_STATS 1
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <cstdint>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+const int n_fields = 16;
+
+struct record {
+	nvobj::p<uint64_t> fields[n_fields];
+	nvobj::p<uint64_t> other;
+};
+
+struct root {
+	nvobj::persistent_ptr<record> rec;
+};
+
+pmem::detail::tx_snapshot_cache &
+cache()
+{
+	return pmem::detail::get_tx_snapshot_cache();
+}
+
+/*
+ * test_ranges -- (internal) adjacent and overlapping ranges are merged and
+ * lookups find only fully covered ranges
+ */
+void
+test_ranges()
+{
+	pmem::detail::tx_snapshot_cache c;
+	c.reset(reinterpret_cast<PMEMobjpool *>(&c));
+
+	c.insert(100, 110);
+	c.insert(120, 130);
+	UT_ASSERTeq(c.size, 2);
+	UT_ASSERT(c.contains(100, 110));
+	UT_ASSERT(c.contains(102, 108));
+	UT_ASSERT(!c.contains(105, 115));
+	UT_ASSERT(!c.contains(110, 120));
+
+	/* touches both neighbours */
+	c.insert(110, 120);
+	UT_ASSERTeq(c.size, 1);
+	UT_ASSERT(c.contains(100, 130));
+
+	/* overlaps and extends */
+	c.insert(125, 140);
+	c.insert(90, 95);
+	c.insert(50, 60);
+	UT_ASSERTeq(c.size, 3);
+	UT_ASSERT(c.contains(100, 140));
+	UT_ASSERT(!c.contains(90, 100));
+
+	/* covers everything */
+	c.insert(40, 200);
+	UT_ASSERTeq(c.size, 1);
+	UT_ASSERT(c.contains(40, 200));
+
+	/* a full cache starts over */
+	c.reset(reinterpret_cast<PMEMobjpool *>(&c));
+	for (std::uintptr_t i = 0; i < c.capacity; ++i)
+		c.insert(i * 10, i * 10 + 5);
+	UT_ASSERTeq(c.size, c.capacity);
+	UT_ASSERT(c.contains(0, 5));
+
+	c.insert(1000, 1005);
+	UT_ASSERTeq(c.size, 1);
+	UT_ASSERT(!c.contains(0, 5));
+	UT_ASSERT(c.contains(1000, 1005));
+}
+
+/*
+ * test_field_updates -- (internal) repeated snapshots of the same fields
+ * reach libpmemobj once per transaction
+ */
+void
+test_field_updates(nvobj::pool<root> &pop)
+{
+	auto rec = pop.root()->rec;
+
+	UT_ASSERT(!cache().enabled);
+
+	auto hits = cache().hits;
+	auto misses = cache().misses;
+
+	nvobj::transaction::run(pop, [&] {
+		UT_ASSERT(cache().enabled);
+
+		for (int pass = 0; pass < 3; ++pass)
+			for (int i = 0; i < n_fields; ++i)
+				rec->fields[i] += 1u;
+
+		/* all fields were merged into a single range */
+		UT_ASSERTeq(cache().size, 1);
+
+		nvobj::transaction::snapshot(&rec->fields[0].get_ro(),
+					     n_fields);
+
+		nvobj::transaction::run(pop, [&] { rec->fields[3] += 1u; });
+	});
+
+	UT_ASSERT(!cache().enabled);
+	UT_ASSERTeq(cache().misses - misses, n_fields);
+	UT_ASSERTeq(cache().hits - hits, 2 * n_fields + 2);
+
+	for (int i = 0; i < n_fields; ++i)
+		UT_ASSERTeq(rec->fields[i], i == 3 ? 4 : 3);
+
+	/* the next transaction does not reuse the ranges */
+	misses = cache().misses;
+	nvobj::transaction::run(pop, [&] { rec->fields[0] = 0; });
+	UT_ASSERTeq(cache().misses - misses, 1);
+}
+
+/*
+ * test_abort -- (internal) fields updated many times are restored after
+ * an abort
+ */
+void
+test_abort(nvobj::pool<root> &pop)
+{
+	auto rec = pop.root()->rec;
+
+	nvobj::transaction::run(pop, [&] {
+		for (int i = 0; i < n_fields; ++i)
+			rec->fields[i] = static_cast<uint64_t>(i);
+		rec->other = 100;
+	});
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			for (int pass = 0; pass < 3; ++pass) {
+				for (int i = n_fields - 1; i >= 0; --i)
+					rec->fields[i] += 10u;
+				rec->other += 10u;
+			}
+
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	UT_ASSERT(!cache().enabled);
+
+	for (int i = 0; i < n_fields; ++i)
+		UT_ASSERTeq(rec->fields[i], static_cast<uint64_t>(i));
+	UT_ASSERTeq(rec->other, 100);
+}
+
+/*
+ * test_c_tx -- (internal) transactions started with the C API, including
+ * C++ transactions nested in them, do not use the cache
+ */
+void
+test_c_tx(nvobj::pool<root> &pop)
+{
+	auto rec = pop.root()->rec;
+	auto hits = cache().hits;
+
+	UT_ASSERTeq(pmemobj_tx_begin(pop.handle(), nullptr, TX_PARAM_NONE),
+		    0);
+	rec->fields[0] = 5;
+	rec->fields[0] = 6;
+	UT_ASSERT(!cache().enabled);
+
+	nvobj::transaction::run(pop, [&] {
+		rec->fields[1] = 5;
+		rec->fields[1] = 6;
+	});
+	UT_ASSERT(!cache().enabled);
+
+	pmemobj_tx_abort(ECANCELED);
+	(void)pmemobj_tx_end();
+
+	UT_ASSERTeq(cache().hits, hits);
+	UT_ASSERTeq(rec->fields[0], 0);
+	UT_ASSERTeq(rec->fields[1], 1);
+}
+
+/*
+ * test_pool_range -- (internal) addresses between two pool addresses are
+ * known to be in the pool, volatile memory is never snapshotted
+ */
+void
+test_pool_range(nvobj::pool<root> &pop)
+{
+	auto rec = pop.root()->rec;
+	nvobj::p<int> volatile_value = 1;
+
+	auto addr = [](const void *ptr) {
+		return reinterpret_cast<std::uintptr_t>(ptr);
+	};
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			UT_ASSERT(!cache().in_pool(addr(&rec->fields[5])));
+
+			rec->fields[0] = 10;
+			rec->fields[n_fields - 1] = 10;
+			UT_ASSERT(cache().in_pool(addr(&rec->fields[5])));
+
+			volatile_value = 2;
+			UT_ASSERT(!cache().in_pool(addr(&volatile_value)));
+
+			throw std::runtime_error("abort");
+		});
+		UT_ASSERT(0);
+	} catch (std::runtime_error &) {
+	}
+
+	UT_ASSERT(!cache().in_pool(addr(&rec->fields[5])));
+	UT_ASSERTeq(rec->fields[0], 0);
+	UT_ASSERTeq(rec->fields[n_fields - 1], static_cast<uint64_t>(15));
+	UT_ASSERTeq(volatile_value, 2);
+}
+}
+
+int
+main(int argc, char *argv[])
+{
+	START();
+
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->rec = nvobj::make_persistent<record>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_ranges();
+	test_field_updates(pop);
+	test_abort(pop);
+	test_c_tx(pop);
+	test_pool_range(pop);
+
+	pop.close();
+
+	return 0;
+}